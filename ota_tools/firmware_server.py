@@ -9,12 +9,36 @@ for OTA updates. In production, use a proper web server like nginx.
 import http.server
 import socketserver
 import os
+import sys
 import json
 import hashlib
 from urllib.parse import urlparse, parse_qs
 import threading
 import time
 
+# Maximum number of firmware downloads served at the same time. Further
+# requests get 503 + Retry-After so devices back off instead of piling up.
+MAX_CONCURRENT_DOWNLOADS = 20
+RETRY_AFTER_SEC = 15
+
+download_slots = threading.BoundedSemaphore(MAX_CONCURRENT_DOWNLOADS)
+stats_lock = threading.Lock()
+download_stats = {"active": 0, "peak_active": 0, "served": 0, "rejected_busy": 0, "bytes_sent": 0}
+
+
+def set_max_concurrent_downloads(limit):
+    """Resize the download cap (call before the server starts)"""
+    global MAX_CONCURRENT_DOWNLOADS, download_slots
+    MAX_CONCURRENT_DOWNLOADS = limit
+    download_slots = threading.BoundedSemaphore(limit)
+
+
+class ThreadingFirmwareServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+    request_queue_size = 256
+
+
 class FirmwareHandler(http.server.SimpleHTTPRequestHandler):
     def __init__(self, *args, **kwargs):
         super().__init__(*args, directory="firmware", **kwargs)
@@ -25,6 +49,8 @@ class FirmwareHandler(http.server.SimpleHTTPRequestHandler):
         
         if parsed_path.path == "/api/version":
             self.handle_version_check()
+        elif parsed_path.path == "/api/stats":
+            self.handle_stats()
         elif parsed_path.path.startswith("/firmware/"):
             self.handle_firmware_download()
         else:
@@ -49,6 +75,17 @@ class FirmwareHandler(http.server.SimpleHTTPRequestHandler):
         except Exception as e:
             self.send_error(500, f"Server error: {e}")
     
+    def handle_stats(self):
+        """Report download concurrency counters"""
+        with stats_lock:
+            stats = dict(download_stats, max_concurrent=MAX_CONCURRENT_DOWNLOADS)
+        body = json.dumps(stats, indent=2).encode()
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+    
     def handle_firmware_download(self):
         """Handle firmware file downloads with proper headers"""
         # Log the download request
@@ -56,30 +93,57 @@ class FirmwareHandler(http.server.SimpleHTTPRequestHandler):
         print(f"Client IP: {self.client_address[0]}")
         print(f"User-Agent: {self.headers.get('User-Agent', 'Unknown')}")
         
-        # Set appropriate headers for firmware downloads
-        if self.path.endswith('.bin'):
-            self.send_response(200)
-            self.send_header('Content-Type', 'application/octet-stream')
-            self.send_header('Content-Disposition', f'attachment; filename="{os.path.basename(self.path)}"')
-            self.send_header('Cache-Control', 'no-cache')
-            
-            # Add firmware size header
-            firmware_path = "firmware" + self.path.replace("/firmware", "")
-            if os.path.exists(firmware_path):
-                file_size = os.path.getsize(firmware_path)
+        if not self.path.endswith('.bin'):
+            super().do_GET()
+            return
+        
+        firmware_path = "firmware/" + os.path.basename(urlparse(self.path).path)
+        if not os.path.isfile(firmware_path):
+            self.send_error(404, "Firmware file not found")
+            return
+        
+        # Enforce the concurrent download cap
+        if not download_slots.acquire(blocking=False):
+            with stats_lock:
+                download_stats["rejected_busy"] += 1
+            self.send_response(503)
+            self.send_header('Retry-After', str(RETRY_AFTER_SEC))
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            print(f"Download slots full ({MAX_CONCURRENT_DOWNLOADS}), asked client to retry in {RETRY_AFTER_SEC}s")
+            return
+        
+        with stats_lock:
+            download_stats["active"] += 1
+            download_stats["peak_active"] = max(download_stats["peak_active"], download_stats["active"])
+        
+        try:
+            with open(firmware_path, 'rb') as f:
+                file_size = os.fstat(f.fileno()).st_size
+                
+                # Set appropriate headers for firmware downloads
+                self.send_response(200)
+                self.send_header('Content-Type', 'application/octet-stream')
+                self.send_header('Content-Disposition', f'attachment; filename="{os.path.basename(firmware_path)}"')
+                self.send_header('Cache-Control', 'no-cache')
                 self.send_header('Content-Length', str(file_size))
+                self.end_headers()
+                self.wfile.flush()
                 print(f"Serving firmware: {firmware_path} ({file_size:,} bytes)")
+                
+                # Stream the file with sendfile() (falls back to chunked
+                # send() where unsupported) instead of reading it into memory
+                sent = self.connection.sendfile(f)
             
-            self.end_headers()
-            
-            # Serve the file
-            try:
-                with open(firmware_path, 'rb') as f:
-                    self.wfile.write(f.read())
-            except FileNotFoundError:
-                self.send_error(404, "Firmware file not found")
-        else:
-            super().do_GET()
+            with stats_lock:
+                download_stats["served"] += 1
+                download_stats["bytes_sent"] += sent
+        except (BrokenPipeError, ConnectionResetError):
+            print(f"Client {self.client_address[0]} disconnected during download")
+        finally:
+            with stats_lock:
+                download_stats["active"] -= 1
+            download_slots.release()
 
 def create_sample_firmware_info():
     """Create sample firmware metadata"""
@@ -117,6 +181,9 @@ def main():
     """Start the firmware server"""
     PORT = 8080
     
+    if '--max-concurrent' in sys.argv and sys.argv.index('--max-concurrent') + 1 < len(sys.argv):
+        set_max_concurrent_downloads(int(sys.argv[sys.argv.index('--max-concurrent') + 1]))
+    
     print("🚀 ESP32 Firmware Server")
     print("=" * 40)
     
@@ -127,11 +194,13 @@ def main():
     print(f"Firmware files directory: ./firmware/")
     print(f"Version check API: http://localhost:{PORT}/api/version")
     print(f"Firmware downloads: http://localhost:{PORT}/firmware/")
+    print(f"Download stats: http://localhost:{PORT}/api/stats")
+    print(f"Max concurrent downloads: {MAX_CONCURRENT_DOWNLOADS}")
     print("\nPress Ctrl+C to stop the server")
     print("=" * 40)
     
     try:
-        with socketserver.TCPServer(("", PORT), FirmwareHandler) as httpd:
+        with ThreadingFirmwareServer(("", PORT), FirmwareHandler) as httpd:
             print(f"✅ Server running at http://localhost:{PORT}")
             print("\nTo test firmware updates:")
             print("1. Copy your .bin file to ./firmware/")
@@ -66,7 +66,8 @@ def main():
         mqtt_message = f'''{{
   "version": "1.3.0",
   "firmware_url": "https://your-server.com/firmware/{firmware_name}",
-  "signature": "{hash_value}",
+  "signature": "<base64 ECDSA signature from sign_firmware.py>",
+  "sha256": "{hash_value}",
   "force_update": false,
   "description": "OTA update with new features",
   "release_notes": "Added Over-The-Air update capability"
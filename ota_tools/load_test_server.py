@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Firmware Server Load Test
+
+Starts firmware_server.py in-process and simulates a fleet of devices
+downloading an update the way the ESP32 does: wait start_delay_ms from the
+rollout plan, download in 512-byte reads at a throttled rate, and back off
+on 503 using Retry-After plus jitter.
+
+Example (thundering herd vs staged rollout):
+  python3 load_test_server.py --clients 200 --jitter 0
+  python3 load_test_server.py --clients 200 --batch-percent 25 --batch-interval 3 --jitter 2
+"""
+
+import argparse
+import os
+import random
+import resource
+import shutil
+import socket
+import sys
+import tempfile
+import threading
+import time
+import urllib.error
+import urllib.request
+
+import firmware_server
+from send_ota_update import plan_rollout
+
+
+class SmallWindowServer(firmware_server.ThreadingFirmwareServer):
+    """Clamp the send buffer so a slow client holds its download slot the way
+    an ESP32 (~5.7 KB TCP window) does, instead of localhost buffering the
+    whole image at once"""
+
+    def get_request(self):
+        conn, addr = super().get_request()
+        conn.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 8192)
+        return conn, addr
+
+
+def simulated_device(url, start_delay, kbps, results, index):
+    """Download the firmware once, honouring the start delay and 503 backoff"""
+    time.sleep(start_delay)
+    started = time.time()
+    retries = 0
+    while True:
+        try:
+            with urllib.request.urlopen(url, timeout=60) as resp:
+                received = 0
+                chunk_time = 512 / (kbps * 1024)
+                while True:
+                    chunk = resp.read(512)
+                    if not chunk:
+                        break
+                    received += len(chunk)
+                    time.sleep(chunk_time)
+            results[index] = (time.time() - started, retries, received)
+            return
+        except urllib.error.HTTPError as e:
+            if e.code != 503:
+                results[index] = (time.time() - started, retries, -1)
+                return
+            retries += 1
+            retry_after = int(e.headers.get('Retry-After', firmware_server.RETRY_AFTER_SEC))
+            time.sleep(retry_after * random.uniform(0.5, 1.5))
+        except OSError:
+            results[index] = (time.time() - started, retries, -1)
+            return
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test the OTA firmware server")
+    parser.add_argument('--clients', type=int, default=200)
+    parser.add_argument('--max-concurrent', type=int, default=20)
+    parser.add_argument('--retry-after', type=int, default=1, help="Retry-After seconds sent on 503")
+    parser.add_argument('--firmware-kb', type=int, default=256)
+    parser.add_argument('--client-kbps', type=int, default=256, help="Per-device download rate")
+    parser.add_argument('--batch-percent', type=int, default=100)
+    parser.add_argument('--batch-interval', type=int, default=0)
+    parser.add_argument('--jitter', type=int, default=0)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix="ota_load_")
+    os.makedirs(os.path.join(workdir, "firmware"))
+    with open(os.path.join(workdir, "firmware", "load_test.bin"), "wb") as f:
+        f.write(os.urandom(args.firmware_kb * 1024))
+    cwd = os.getcwd()
+    os.chdir(workdir)
+
+    firmware_server.set_max_concurrent_downloads(args.max_concurrent)
+    firmware_server.RETRY_AFTER_SEC = args.retry_after
+    httpd = SmallWindowServer(("127.0.0.1", 0), firmware_server.FirmwareHandler)
+    port = httpd.server_address[1]
+    threading.Thread(target=httpd.serve_forever, daemon=True).start()
+    url = f"http://127.0.0.1:{port}/firmware/load_test.bin"
+
+    devices = [f"sensor_{i:06X}" for i in range(args.clients)]
+    plan = plan_rollout(devices, args.batch_percent, args.batch_interval, args.jitter, seed=1)
+    results = [None] * args.clients
+    rss_before = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+
+    print(f"Load test: {args.clients} clients, cap {args.max_concurrent}, "
+          f"{args.firmware_kb} KB image at {args.client_kbps} KB/s per client")
+    print(f"Rollout: {args.batch_percent}% batches every {args.batch_interval}s, jitter {args.jitter}s")
+
+    # Silence per-request server logging while the test runs
+    stdout = sys.stdout
+    sys.stdout = open(os.devnull, "w")
+    firmware_server.FirmwareHandler.log_message = lambda *a, **k: None
+    started = time.time()
+    threads = []
+    for i, (_, _, delay_ms) in enumerate(plan):
+        t = threading.Thread(target=simulated_device,
+                             args=(url, delay_ms / 1000.0, args.client_kbps, results, i))
+        t.start()
+        threads.append(t)
+    for t in threads:
+        t.join()
+    elapsed = time.time() - started
+    sys.stdout.close()
+    sys.stdout = stdout
+
+    httpd.shutdown()
+    os.chdir(cwd)
+    shutil.rmtree(workdir)
+
+    stats = firmware_server.download_stats
+    ok = [r for r in results if r and r[2] == args.firmware_kb * 1024]
+    durations = [r[0] for r in ok]
+    retries = [r[1] for r in results if r]
+    rss_after = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+
+    print("=" * 60)
+    print(f"Completed downloads: {len(ok)}/{args.clients} in {elapsed:.1f}s")
+    print(f"Peak concurrent downloads: {stats['peak_active']} (cap {args.max_concurrent})")
+    print(f"503 busy responses: {stats['rejected_busy']}  (max retries per client: {max(retries)})")
+    if durations:
+        print(f"Time to complete per client: p50 {percentile(durations, 50):.1f}s, "
+              f"p95 {percentile(durations, 95):.1f}s, max {max(durations):.1f}s")
+    print(f"Bytes sent: {stats['bytes_sent']:,}")
+    print(f"Server process max RSS growth: {(rss_after - rss_before) / 1024:.1f} MB")
+    sys.exit(0 if len(ok) == args.clients else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -11,6 +11,7 @@ import sys
 import time
 import hashlib
 import os
+import random
 
 # MQTT Configuration
 MQTT_SERVER = "192.168.1.48"
@@ -21,6 +22,9 @@ DEVICE_HOSTNAME = "sensor_8EA40C"  # Update with your device's hostname
 # JWT Configuration (same as your ESP32)
 JWT_SECRET = "JWTSecret"
 
+# ECDSA P-256 firmware signing key (matches OTA_PUBLIC_KEY on the ESP32)
+OTA_PRIVATE_KEY = "ota_private_key.pem"
+
 def generate_jwt_for_mqtt():
     """Generate JWT token for MQTT authentication"""
     try:
@@ -57,16 +61,57 @@ def calculate_file_hash(file_path):
     
     return sha256_hash.hexdigest()
 
-def send_ota_update(firmware_version, firmware_url, firmware_file=None, force_update=False):
+def plan_rollout(devices, batch_percent=100, batch_interval_sec=0, jitter_sec=0, seed=None):
+    """Split devices into staged batches with jittered start times.
+    
+    Each device gets a start_delay_ms = batch_index * batch_interval + random
+    jitter in [0, jitter_sec). Devices hold the update until the delay has
+    passed, so the whole fleet never hits the firmware server at once.
+    Returns a list of (hostname, batch_index, start_delay_ms).
+    """
+    rng = random.Random(seed)
+    order = list(devices)
+    rng.shuffle(order)
+    
+    batch_size = max(1, (len(order) * batch_percent + 99) // 100)
+    plan = []
+    for i, hostname in enumerate(order):
+        batch = i // batch_size
+        delay_ms = batch * batch_interval_sec * 1000
+        if jitter_sec > 0:
+            delay_ms += rng.randrange(jitter_sec * 1000)
+        plan.append((hostname, batch, delay_ms))
+    return plan
+
+def load_device_list(path):
+    """Read one device hostname per line (blank lines and # comments ignored)"""
+    with open(path) as f:
+        return [line.strip() for line in f if line.strip() and not line.startswith('#')]
+
+def sign_file(file_path, private_key_path):
+    """Sign firmware with the OTA ECDSA key (see sign_firmware.py)"""
+    from sign_firmware import sign_firmware
+    _, signature = sign_firmware(file_path, private_key_path)
+    return signature
+
+def send_ota_update(firmware_version, firmware_url, firmware_file=None, force_update=False,
+                    private_key=OTA_PRIVATE_KEY, rollout=None):
     """Send OTA update message to ESP32"""
     
-    # Calculate signature if firmware file is provided
+    # Sign the firmware if the file is provided
     signature = ""
+    firmware_hash = ""
     if firmware_file and os.path.exists(firmware_file):
-        signature = calculate_file_hash(firmware_file)
-        print(f"Calculated firmware hash: {signature}")
+        firmware_hash = calculate_file_hash(firmware_file)
+        print(f"Calculated firmware hash: {firmware_hash}")
+        if not os.path.exists(private_key):
+            print(f"Error: Signing key '{private_key}' not found")
+            print("Generate one with: python3 sign_firmware.py keygen")
+            return False
+        signature = sign_file(firmware_file, private_key)
+        print(f"Firmware signature: {signature}")
     else:
-        signature = input("Enter firmware SHA256 hash: ").strip()
+        signature = input("Enter firmware signature (base64, from sign_firmware.py): ").strip()
     
     if not signature:
         print("Error: Firmware signature is required")
@@ -77,6 +122,7 @@ def send_ota_update(firmware_version, firmware_url, firmware_file=None, force_up
         "version": firmware_version,
         "firmware_url": firmware_url,
         "signature": signature,
+        "sha256": firmware_hash,
         "force_update": force_update,
         "timestamp": int(time.time()),
         "description": f"Firmware update to version {firmware_version}",
@@ -131,21 +177,29 @@ def send_ota_update(firmware_version, firmware_url, firmware_file=None, force_up
             print(f"❌ MQTT connection failed with code: {connection_result}")
             return False
         
-        # Send update message
-        update_topic = f"{DEVICE_HOSTNAME}/firmware/update"
-        message_json = json.dumps(update_message)
+        # Send update message to every device in the rollout plan
+        if rollout is None:
+            rollout = [(DEVICE_HOSTNAME, 0, 0)]
         
-        print(f"📤 Sending update to topic: {update_topic}")
+        for hostname, batch, delay_ms in rollout:
+            update_topic = f"{hostname}/firmware/update"
+            device_message = dict(update_message)
+            if delay_ms > 0:
+                device_message["start_delay_ms"] = delay_ms
+                device_message["rollout_batch"] = batch
+            message_json = json.dumps(device_message)
+            
+            print(f"📤 Sending update to topic: {update_topic} (batch {batch}, start in {delay_ms / 1000:.1f}s)")
+            
+            result = client.publish(update_topic, message_json)
+            
+            if result.rc != mqtt.MQTT_ERR_SUCCESS:
+                print(f"❌ Failed to send update message: {result.rc}")
+                return False
         
-        result = client.publish(update_topic, message_json)
-        
-        if result.rc == mqtt.MQTT_ERR_SUCCESS:
-            print("✅ Update message queued successfully")
-            time.sleep(2)  # Wait for message to be sent
-            return True
-        else:
-            print(f"❌ Failed to send update message: {result.rc}")
-            return False
+        print("✅ Update message queued successfully")
+        time.sleep(2)  # Wait for message to be sent
+        return True
         
     except Exception as e:
         print(f"❌ Error: {e}")
@@ -161,10 +215,13 @@ def main():
     print("=" * 40)
     
     if len(sys.argv) < 3:
-        print("Usage: python3 send_ota_update.py <version> <firmware_url> [firmware_file] [--force]")
+        print("Usage: python3 send_ota_update.py <version> <firmware_url> [firmware_file] [--force] [--key private.pem]")
+        print("         [--devices devices.txt] [--batch-percent N] [--batch-interval SEC] [--jitter SEC]")
         print("\nExamples:")
         print("  python3 send_ota_update.py 1.3.0 http://localhost:8080/firmware/esp32_v1.3.0.bin")
         print("  python3 send_ota_update.py 1.3.0 https://myserver.com/firmware.bin firmware.bin --force")
+        print("  python3 send_ota_update.py 1.3.0 http://fw:8080/firmware/fw.bin fw.bin --devices fleet.txt \\")
+        print("      --batch-percent 10 --batch-interval 600 --jitter 120")
         sys.exit(1)
     
     firmware_version = sys.argv[1]
@@ -172,10 +229,29 @@ def main():
     firmware_file = sys.argv[3] if len(sys.argv) > 3 and not sys.argv[3].startswith('--') else None
     force_update = '--force' in sys.argv
     
+    def option(name, default):
+        if name in sys.argv and sys.argv.index(name) + 1 < len(sys.argv):
+            return sys.argv[sys.argv.index(name) + 1]
+        return default
+    
+    private_key = option('--key', OTA_PRIVATE_KEY)
+    devices_file = option('--devices', None)
+    batch_percent = int(option('--batch-percent', 100))
+    batch_interval = int(option('--batch-interval', 0))
+    jitter = int(option('--jitter', 0))
+    
+    devices = load_device_list(devices_file) if devices_file else [DEVICE_HOSTNAME]
+    rollout = plan_rollout(devices, batch_percent, batch_interval, jitter)
+    
     print(f"Firmware Version: {firmware_version}")
     print(f"Firmware URL: {firmware_url}")
     print(f"Force Update: {force_update}")
-    print(f"Target Device: {DEVICE_HOSTNAME}")
+    if devices_file:
+        batches = max(batch for _, batch, _ in rollout) + 1
+        print(f"Target Devices: {len(devices)} in {batches} batch(es) "
+              f"({batch_percent}% every {batch_interval}s, jitter {jitter}s)")
+    else:
+        print(f"Target Device: {DEVICE_HOSTNAME}")
     
     if firmware_file:
         print(f"Local Firmware File: {firmware_file}")
@@ -187,7 +263,7 @@ def main():
         sys.exit(0)
     
     # Send the update
-    success = send_ota_update(firmware_version, firmware_url, firmware_file, force_update)
+    success = send_ota_update(firmware_version, firmware_url, firmware_file, force_update, private_key, rollout)
     
     if success:
         print("\n✅ OTA update message sent successfully!")
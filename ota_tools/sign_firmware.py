@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""
+Firmware Signing Tool for ESP32 OTA Updates
+
+Generates ECDSA P-256 key pairs and signs firmware images. The device
+verifies the base64 DER signature over the SHA256 of the image using the
+public key compiled into OTA_PUBLIC_KEY (see validateFirmwareSignature).
+
+Requires: pip install cryptography
+"""
+
+import base64
+import hashlib
+import os
+import sys
+
+try:
+    from cryptography.exceptions import InvalidSignature
+    from cryptography.hazmat.primitives import hashes, serialization
+    from cryptography.hazmat.primitives.asymmetric import ec
+    from cryptography.hazmat.primitives.asymmetric.utils import (
+        Prehashed, encode_dss_signature)
+except ImportError:
+    print("cryptography not installed. Install with: pip install cryptography")
+    sys.exit(1)
+
+DEFAULT_PRIVATE_KEY = "ota_private_key.pem"
+DEFAULT_PUBLIC_KEY = "ota_public_key.pem"
+
+# RFC 6979 A.2.5 (P-256, SHA-256, message "sample") - a known-good vector that
+# the device-side verification must accept
+RFC6979_PUBLIC_X = 0x60FED4BA255A9D31C961EB74C6356D68C049B8923B61FA6CE669622E60F29FB6
+RFC6979_PUBLIC_Y = 0x7903FE1008B8BC99A41AE9E95628BC64F2F1B20C2D7E9F5177A3C294D4462299
+RFC6979_R = 0xEFD48B2AACB6A8FD1140DD9CD45E81D69D2C877B56AAF991C34D0EA84EAF3716
+RFC6979_S = 0xF7CB1C942D657C41D436C7A1B6E29F65F3E900DBB9AFF4064DC4AB2F843ACDA8
+
+
+def calculate_sha256(file_path):
+    """Calculate SHA256 digest (raw bytes) of a file"""
+    sha256_hash = hashlib.sha256()
+    with open(file_path, "rb") as f:
+        for chunk in iter(lambda: f.read(4096), b""):
+            sha256_hash.update(chunk)
+    return sha256_hash.digest()
+
+
+def load_private_key(path):
+    with open(path, "rb") as f:
+        return serialization.load_pem_private_key(f.read(), password=None)
+
+
+def load_public_key(path):
+    with open(path, "rb") as f:
+        return serialization.load_pem_public_key(f.read())
+
+
+def sign_digest(private_key, digest):
+    """Sign a SHA256 digest, returning the base64 DER signature the device expects"""
+    der = private_key.sign(digest, ec.ECDSA(Prehashed(hashes.SHA256())))
+    return base64.b64encode(der).decode()
+
+
+def verify_digest(public_key, digest, signature_b64):
+    """Mirror of the device check: base64 DER ECDSA over the SHA256 digest"""
+    try:
+        der = base64.b64decode(signature_b64, validate=True)
+        public_key.verify(der, digest, ec.ECDSA(Prehashed(hashes.SHA256())))
+        return True
+    except (InvalidSignature, ValueError):
+        return False
+
+
+def sign_firmware(firmware_file, private_key_path=DEFAULT_PRIVATE_KEY):
+    """Return (sha256_hex, signature_b64) for a firmware image"""
+    digest = calculate_sha256(firmware_file)
+    signature = sign_digest(load_private_key(private_key_path), digest)
+    return digest.hex(), signature
+
+
+def public_key_as_c_string(public_key):
+    """Format a PEM public key as the OTA_PUBLIC_KEY C string literal"""
+    pem = public_key.public_bytes(
+        serialization.Encoding.PEM,
+        serialization.PublicFormat.SubjectPublicKeyInfo).decode()
+    lines = [f'"{line}\\n"' for line in pem.strip().splitlines()]
+    return "const char* OTA_PUBLIC_KEY = " + "\n                            ".join(lines) + ";"
+
+
+def cmd_keygen(private_key_path, public_key_path):
+    if os.path.exists(private_key_path):
+        print(f"Error: '{private_key_path}' already exists, refusing to overwrite")
+        return False
+
+    private_key = ec.generate_private_key(ec.SECP256R1())
+    with open(private_key_path, "wb") as f:
+        f.write(private_key.private_bytes(
+            serialization.Encoding.PEM,
+            serialization.PrivateFormat.PKCS8,
+            serialization.NoEncryption()))
+    os.chmod(private_key_path, 0o600)
+
+    public_key = private_key.public_key()
+    with open(public_key_path, "wb") as f:
+        f.write(public_key.public_bytes(
+            serialization.Encoding.PEM,
+            serialization.PublicFormat.SubjectPublicKeyInfo))
+
+    print(f"Private key saved to: {private_key_path} (keep this secret!)")
+    print(f"Public key saved to: {public_key_path}")
+    print("\nPaste this into src/main.cpp:")
+    print(public_key_as_c_string(public_key))
+    return True
+
+
+def cmd_sign(firmware_file, private_key_path):
+    if not os.path.exists(firmware_file):
+        print(f"Error: Firmware file '{firmware_file}' does not exist")
+        return False
+
+    sha256_hex, signature = sign_firmware(firmware_file, private_key_path)
+    print(f"SHA256 Hash: {sha256_hex}")
+    print(f"Signature (base64 DER): {signature}")
+
+    sig_file = firmware_file + ".sig"
+    with open(sig_file, "w") as f:
+        f.write(signature)
+    print(f"Signature saved to: {sig_file}")
+    return True
+
+
+def cmd_verify(firmware_file, signature_b64, public_key_path):
+    digest = calculate_sha256(firmware_file)
+    ok = verify_digest(load_public_key(public_key_path), digest, signature_b64)
+    print("✅ Signature valid" if ok else "❌ Signature INVALID")
+    return ok
+
+
+def cmd_selftest():
+    """Run the signature test vectors against the device verification scheme"""
+    results = []
+
+    # Known-answer vector from RFC 6979
+    rfc_key = ec.EllipticCurvePublicNumbers(
+        RFC6979_PUBLIC_X, RFC6979_PUBLIC_Y, ec.SECP256R1()).public_key()
+    rfc_sig = base64.b64encode(encode_dss_signature(RFC6979_R, RFC6979_S)).decode()
+    rfc_digest = hashlib.sha256(b"sample").digest()
+    results.append(("RFC 6979 P-256/SHA-256 'sample'",
+                    verify_digest(rfc_key, rfc_digest, rfc_sig)))
+    results.append(("RFC 6979 vector rejects other message",
+                    not verify_digest(rfc_key, hashlib.sha256(b"test").digest(), rfc_sig)))
+
+    # Round trip with a fresh key over a synthetic image
+    private_key = ec.generate_private_key(ec.SECP256R1())
+    public_key = private_key.public_key()
+    image = bytes(range(256)) * 4096
+    digest = hashlib.sha256(image).digest()
+    signature = sign_digest(private_key, digest)
+    results.append(("Round trip sign/verify", verify_digest(public_key, digest, signature)))
+
+    tampered = bytearray(image)
+    tampered[len(tampered) // 2] ^= 0x01
+    results.append(("Tampered image rejected",
+                    not verify_digest(public_key, hashlib.sha256(tampered).digest(), signature)))
+
+    other_key = ec.generate_private_key(ec.SECP256R1()).public_key()
+    results.append(("Wrong public key rejected", not verify_digest(other_key, digest, signature)))
+
+    der = bytearray(base64.b64decode(signature))
+    der[-1] ^= 0xFF
+    results.append(("Corrupted signature rejected",
+                    not verify_digest(public_key, digest, base64.b64encode(der).decode())))
+    results.append(("Non-base64 signature rejected",
+                    not verify_digest(public_key, digest, "not*base64!")))
+    results.append(("Legacy SHA256 hex signature rejected",
+                    not verify_digest(public_key, digest, digest.hex())))
+
+    for name, ok in results:
+        print(f"{'✅' if ok else '❌'} {name}")
+
+    passed = sum(1 for _, ok in results if ok)
+    print(f"\n{passed}/{len(results)} vectors passed")
+    return passed == len(results)
+
+
+def usage():
+    print("Usage:")
+    print("  python3 sign_firmware.py keygen [private.pem] [public.pem]")
+    print("  python3 sign_firmware.py sign <firmware.bin> [private.pem]")
+    print("  python3 sign_firmware.py verify <firmware.bin> <signature_b64> [public.pem]")
+    print("  python3 sign_firmware.py selftest")
+    sys.exit(1)
+
+
+def main():
+    if len(sys.argv) < 2:
+        usage()
+
+    command = sys.argv[1]
+    args = sys.argv[2:]
+
+    if command == "keygen":
+        ok = cmd_keygen(args[0] if len(args) > 0 else DEFAULT_PRIVATE_KEY,
+                        args[1] if len(args) > 1 else DEFAULT_PUBLIC_KEY)
+    elif command == "sign" and len(args) >= 1:
+        ok = cmd_sign(args[0], args[1] if len(args) > 1 else DEFAULT_PRIVATE_KEY)
+    elif command == "verify" and len(args) >= 2:
+        ok = cmd_verify(args[0], args[1], args[2] if len(args) > 2 else DEFAULT_PUBLIC_KEY)
+    elif command == "selftest":
+        ok = cmd_selftest()
+    else:
+        usage()
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,253 @@
+// Camera doorway detector: the 1/16 grid motion gate, brightness
+// normalization, illumination-change suppression and the column tracker that
+// turns motion into crossings. It reads the driver's RGB565 frame buffer and
+// leaves capture, events and uploads to the includer, which also defines
+// millis(), Serial and setCameraAutoExposure(). The host tests in test/native
+// replay synthetic frames through it against arduino_shim.h.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frame-diff parameters
+const int CAM_FRAME_WIDTH = 160;
+const int CAM_FRAME_HEIGHT = 120;
+const int CAM_DIFF_THRESHOLD = 30; // per-pixel threshold
+const int CAM_MOTION_MIN_PIXELS = 200; // min changed pixels to consider motion
+const int CAM_AMBIGUOUS_PIXELS = 800; // above this, consider ambiguous and send frame
+// Motion gate: every frame is first diffed on a 1/16 grid (every 4th pixel
+// in x and y) read straight from the frame buffer. The full 160x120
+// conversion, diff and tracking only run when enough grid cells changed,
+// or while a crossing is being tracked.
+const int CAM_GATE_STEP = 4;
+const int CAM_GATE_WIDTH = CAM_FRAME_WIDTH / CAM_GATE_STEP;
+const int CAM_GATE_HEIGHT = CAM_FRAME_HEIGHT / CAM_GATE_STEP;
+const int CAM_GATE_MIN_CELLS = 6; // CAM_MOTION_MIN_PIXELS scaled to the grid, halved so the gate errs towards opening
+// Illumination handling. Auto exposure/gain/white balance shift the whole
+// frame at once, which reads as motion everywhere. Once the frame mean has
+// settled, AEC/AGC/AWB are switched off (re-converged every
+// CAM_EXPOSURE_RELOCK_MS while the doorway is quiet, to follow daylight).
+// Diffs are taken after removing the change in global mean, and a frame
+// where most pixels still changed is dropped as a lighting change. The lock
+// is off until it has been checked against a real doorway's daylight swing.
+const bool CAM_EXPOSURE_LOCK = false;
+const int CAM_EXPOSURE_STABLE_DELTA = 2;   // grid mean change per frame that counts as settled
+const int CAM_EXPOSURE_STABLE_FRAMES = 10;
+const unsigned long CAM_EXPOSURE_RELOCK_MS = 1800000; // 30 minutes
+const bool CAM_NORMALIZE_BRIGHTNESS = true;
+const float CAM_GLOBAL_CHANGE_FRACTION = 0.5;
+
+// Detector state. prevFrame/currFrame are CAM_FRAME_WIDTH x CAM_FRAME_HEIGHT
+// grayscale buffers the includer allocates.
+uint8_t* prevFrame = NULL;
+uint8_t* currFrame = NULL;
+int prevMotionX = -1;
+uint8_t prevGrid[CAM_GATE_WIDTH * CAM_GATE_HEIGHT];
+uint8_t currGrid[CAM_GATE_WIDTH * CAM_GATE_HEIGHT];
+bool prevFrameStale = true; // prevFrame predates gated frames; take the next frame's motion from the grid
+unsigned long cameraFramesSeen = 0;
+unsigned long cameraFramesGated = 0;
+int prevGridMean = 0;
+int prevFrameMean = 0;           // grid mean when prevFrame was captured
+bool cameraExposureLocked = false;
+unsigned long cameraExposureLockedAt = 0;
+int cameraExposureStableFrames = 0;
+int cameraExposureLastMean = -1;
+unsigned long cameraFramesSuppressed = 0; // dropped as global illumination changes
+unsigned long cameraUploadsAvoided = 0;   // of those, frames the old code would have uploaded as ambiguous
+
+void setCameraAutoExposure(bool enabled);
+
+// What a frame amounted to; the includer publishes the events and uploads
+enum CameraFrameResult {
+  CAM_FRAME_GATED,      // quiet on the grid, full pass skipped
+  CAM_FRAME_SUPPRESSED, // lighting change, dropped
+  CAM_FRAME_QUIET,      // below CAM_MOTION_MIN_PIXELS, tracking reset
+  CAM_FRAME_MOTION,     // motion, no crossing (yet)
+  CAM_FRAME_AMBIGUOUS,  // tracked motion that didn't cross, over CAM_AMBIGUOUS_PIXELS
+  CAM_FRAME_ENTER,      // left -> right across the centre line
+  CAM_FRAME_EXIT        // right -> left
+};
+
+// Nearest-neighbour downsample of an RGB565 frame into w*h grayscale bytes
+void rgb565ToGray(const uint16_t* pixels, int srcWidth, int srcHeight, uint8_t* buf, int w, int h) {
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int sx = x * srcWidth / w;
+      int sy = y * srcHeight / h;
+      uint16_t pix = pixels[sy * srcWidth + sx];
+      // RGB565 -> approximate grayscale
+      uint8_t r = ((pix >> 11) & 0x1F) << 3;
+      uint8_t g = ((pix >> 5) & 0x3F) << 2;
+      uint8_t b = (pix & 0x1F) << 3;
+      buf[y * w + x] = (uint8_t)((0.3 * r) + (0.59 * g) + (0.11 * b));
+    }
+  }
+}
+
+// Called with every frame's grid mean: lock once it has stopped moving
+void updateCameraExposureLock(int gridMean) {
+  if (cameraExposureLocked) {
+    if (millis() - cameraExposureLockedAt >= CAM_EXPOSURE_RELOCK_MS && prevMotionX < 0) {
+      setCameraAutoExposure(true);
+    }
+    return;
+  }
+  if (cameraExposureLastMean >= 0 && abs(gridMean - cameraExposureLastMean) <= CAM_EXPOSURE_STABLE_DELTA) {
+    cameraExposureStableFrames++;
+  } else {
+    cameraExposureStableFrames = 0;
+  }
+  cameraExposureLastMean = gridMean;
+  if (cameraExposureStableFrames >= CAM_EXPOSURE_STABLE_FRAMES) {
+    setCameraAutoExposure(false);
+  }
+}
+
+// Most of the frame changed: a light switched or exposure jumped, not a
+// person. Drop the frame and re-prime prevFrame from the next one. A
+// crossing in progress keeps its prevMotionX, so it is still counted.
+// motionPixels/motionX are the frame's changed pixels and busiest column, so
+// only frames the old crossing check would have sent as ambiguous (tracking,
+// still on the same side of the centre line, over CAM_AMBIGUOUS_PIXELS) count
+// as avoided uploads; the rest would have been false crossings.
+void suppressIlluminationChange(int motionPixels, int motionX) {
+  cameraFramesSuppressed++;
+  int centerX = CAM_FRAME_WIDTH / 2;
+  bool crossed = (prevMotionX < centerX && motionX >= centerX) ||
+                 (prevMotionX > centerX && motionX <= centerX);
+  if (prevMotionX >= 0 && !crossed && motionPixels > CAM_AMBIGUOUS_PIXELS) {
+    cameraUploadsAvoided++;
+  }
+  prevFrameStale = true;
+}
+
+
+// Run one RGB565 frame (at least CAM_FRAME_WIDTH x CAM_FRAME_HEIGHT) through
+// the gate and the tracker. *motionPixels gets the frame's changed pixels.
+CameraFrameResult detectCameraMotion(const uint16_t* pixels, int srcWidth, int srcHeight, int* motionPixels) {
+  cameraFramesSeen++;
+  *motionPixels = 0;
+  
+  // Stage one: the 1/16 grid. The nearest-neighbour sampling picks the same
+  // pixels as every CAM_GATE_STEP-th one of the full frame.
+  rgb565ToGray(pixels, srcWidth, srcHeight, currGrid, CAM_GATE_WIDTH, CAM_GATE_HEIGHT);
+  const int gridCells = CAM_GATE_WIDTH * CAM_GATE_HEIGHT;
+  uint32_t gridSum = 0;
+  for (int i = 0; i < gridCells; i++) {
+    gridSum += currGrid[i];
+  }
+  int gridMean = gridSum / gridCells;
+  if (CAM_EXPOSURE_LOCK) {
+    updateCameraExposureLock(gridMean);
+  }
+  // Remove the change in global brightness before comparing pixels
+  int offset = CAM_NORMALIZE_BRIGHTNESS ? gridMean - prevGridMean : 0;
+  int changedCells = 0;
+  int gridColumns[CAM_GATE_WIDTH] = {0};
+  for (int i = 0; i < gridCells; i++) {
+    if (abs((int)currGrid[i] - (int)prevGrid[i] - offset) > CAM_DIFF_THRESHOLD) {
+      changedCells++;
+      gridColumns[i % CAM_GATE_WIDTH]++;
+    }
+  }
+  memcpy(prevGrid, currGrid, sizeof(prevGrid));
+  prevGridMean = gridMean;
+  // Scaled up to full-frame pixels and columns where the grid stands in for
+  // the full diff
+  int busiest = 0;
+  for (int x = 1; x < CAM_GATE_WIDTH; x++) {
+    if (gridColumns[x] > gridColumns[busiest]) {
+      busiest = x;
+    }
+  }
+  int gridMotionPixels = changedCells * CAM_GATE_STEP * CAM_GATE_STEP;
+  int gridMotionX = busiest * CAM_GATE_STEP + CAM_GATE_STEP / 2;
+  if (changedCells > gridCells * CAM_GLOBAL_CHANGE_FRACTION) {
+    *motionPixels = gridMotionPixels;
+    suppressIlluminationChange(gridMotionPixels, gridMotionX);
+    return CAM_FRAME_SUPPRESSED;
+  }
+  if (changedCells < CAM_GATE_MIN_CELLS && prevMotionX < 0) {
+    cameraFramesGated++;
+    prevFrameStale = true;
+    return CAM_FRAME_GATED;
+  }
+  
+  // Stage two: full resolution into currFrame
+  rgb565ToGray(pixels, srcWidth, srcHeight, currFrame, CAM_FRAME_WIDTH, CAM_FRAME_HEIGHT);
+  int width = CAM_FRAME_WIDTH;
+  int height = CAM_FRAME_HEIGHT;
+  int centerX = width / 2;
+  int maxColIndex = -1;
+  int totalMotionPixels = 0;
+  
+  if (prevFrameStale) {
+    // The last full frame is from before the quiet spell, so diffing against
+    // it would count every lighting change since. This frame's motion comes
+    // from the grid diff against the previous frame instead, so the frame
+    // that opens the gate still starts a track (a slow walker may only open
+    // it every other frame). The first frame after boot has no previous
+    // grid either and only primes both.
+    if (cameraFramesSeen > 1) {
+      totalMotionPixels = gridMotionPixels;
+      maxColIndex = gridMotionX;
+    }
+    prevFrameStale = false;
+  } else {
+    offset = CAM_NORMALIZE_BRIGHTNESS ? gridMean - prevFrameMean : 0;
+    // Compute per-column motion energy by summing difference across rows
+    int maxColSum = 0;
+    for (int x = 0; x < width; x++) {
+      int colSum = 0;
+      for (int y = 0; y < height; y++) {
+        int idx = y * width + x;
+        int diff = abs((int)currFrame[idx] - (int)prevFrame[idx] - offset);
+        if (diff > CAM_DIFF_THRESHOLD) {
+          colSum++;
+          totalMotionPixels++;
+        }
+      }
+      if (colSum > maxColSum) {
+        maxColSum = colSum;
+        maxColIndex = x;
+      }
+    }
+  }
+  *motionPixels = totalMotionPixels;
+
+  // Shift current to prev for next iteration
+  memcpy(prevFrame, currFrame, width * height);
+  prevFrameMean = gridMean;
+
+  if (totalMotionPixels > width * height * CAM_GLOBAL_CHANGE_FRACTION) {
+    suppressIlluminationChange(totalMotionPixels, maxColIndex);
+    return CAM_FRAME_SUPPRESSED;
+  }
+
+  // If insufficient motion, ignore
+  if (totalMotionPixels < CAM_MOTION_MIN_PIXELS) {
+    prevMotionX = -1;
+    return CAM_FRAME_QUIET;
+  }
+
+  Serial.print("Camera motion pixels: "); Serial.print(totalMotionPixels);
+  Serial.print(" | maxColIndex: "); Serial.print(maxColIndex);
+  Serial.print(" | prevMotionX: "); Serial.println(prevMotionX);
+
+  // Determine crossing based on previous motion X
+  CameraFrameResult result = CAM_FRAME_MOTION;
+  if (prevMotionX >= 0) {
+    if (prevMotionX < centerX && maxColIndex >= centerX) {
+      result = CAM_FRAME_ENTER;
+    } else if (prevMotionX > centerX && maxColIndex <= centerX) {
+      result = CAM_FRAME_EXIT;
+    } else if (totalMotionPixels > CAM_AMBIGUOUS_PIXELS) {
+      // No clear crossing but a lot of motion: let the backend look
+      result = CAM_FRAME_AMBIGUOUS;
+    }
+  }
+  prevMotionX = maxColIndex;
+  return result;
+}
@@ -0,0 +1,160 @@
+// HS256 token signing and caching for the MQTT and HTTP credentials.
+//
+// Included mid-file by main.cpp, after the configuration it reads:
+// JWT_SECRET, DEVICE_ID, JWT_LIFETIME_SEC, JWT_REFRESH_MARGIN_SEC,
+// FIRMWARE_VERSION, BUILD_TIMESTAMP, deviceHostname, timeSynced,
+// getCurrentUnixTime(), WiFi.macAddress() and the jwtExpiresAt /
+// jwtGeneratedCount / jwtCacheHits / jwtLastGenerateMicros counters, plus
+// mbedtls' SHA-256 (mbedtls/sha256.h). The host test in test/native maps
+// SHA-256 onto OpenSSL.
+#pragma once
+
+// HS256 signing state. The key is padded and absorbed into the HMAC inner
+// (key ^ 0x36) and outer (key ^ 0x5c) SHA-256 contexts once at boot; each
+// token only clones them instead of rehashing the pads.
+mbedtls_sha256_context jwtHmacInner;
+mbedtls_sha256_context jwtHmacOuter;
+bool jwtKeyReady = false;
+
+// Cached token, written into a fixed buffer (no heap churn per token)
+const size_t JWT_PAYLOAD_MAX_LEN = 320;
+char jwtToken[512] = "";
+char jwtMacAddress[18] = "";
+
+// base64url({"alg":"HS256","typ":"JWT"})
+const char JWT_HEADER_B64[] = "eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9";
+
+void initJWTSigningKey() {
+  uint8_t key[64];
+  memset(key, 0, sizeof(key));
+  size_t keyLen = strlen(JWT_SECRET);
+  if (keyLen > sizeof(key)) {
+    // HMAC: keys longer than the block size are hashed first
+    mbedtls_sha256((const unsigned char*)JWT_SECRET, keyLen, key, 0);
+  } else {
+    memcpy(key, JWT_SECRET, keyLen);
+  }
+  
+  uint8_t pad[64];
+  for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+  mbedtls_sha256_init(&jwtHmacInner);
+  mbedtls_sha256_starts(&jwtHmacInner, 0);
+  mbedtls_sha256_update(&jwtHmacInner, pad, sizeof(pad));
+  
+  for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+  mbedtls_sha256_init(&jwtHmacOuter);
+  mbedtls_sha256_starts(&jwtHmacOuter, 0);
+  mbedtls_sha256_update(&jwtHmacOuter, pad, sizeof(pad));
+  
+  // Claims that never change during a boot
+  strlcpy(jwtMacAddress, WiFi.macAddress().c_str(), sizeof(jwtMacAddress));
+  jwtKeyReady = true;
+}
+
+void hmacSha256(const uint8_t* data, size_t len, uint8_t out[32]) {
+  mbedtls_sha256_context ctx;
+  uint8_t innerHash[32];
+  
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_clone(&ctx, &jwtHmacInner);
+  mbedtls_sha256_update(&ctx, data, len);
+  mbedtls_sha256_finish(&ctx, innerHash);
+  
+  mbedtls_sha256_clone(&ctx, &jwtHmacOuter);
+  mbedtls_sha256_update(&ctx, innerHash, sizeof(innerHash));
+  mbedtls_sha256_finish(&ctx, out);
+  mbedtls_sha256_free(&ctx);
+}
+
+// Unpadded base64url encode into out (NUL terminated). Returns chars written.
+size_t base64UrlEncode(const uint8_t* data, size_t len, char* out) {
+  static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  size_t o = 0;
+  size_t i = 0;
+  for (; i + 2 < len; i += 3) {
+    uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out[o++] = alphabet[(v >> 18) & 0x3F];
+    out[o++] = alphabet[(v >> 12) & 0x3F];
+    out[o++] = alphabet[(v >> 6) & 0x3F];
+    out[o++] = alphabet[v & 0x3F];
+  }
+  if (i < len) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < len) v |= data[i + 1] << 8;
+    out[o++] = alphabet[(v >> 18) & 0x3F];
+    out[o++] = alphabet[(v >> 12) & 0x3F];
+    if (i + 1 < len) out[o++] = alphabet[(v >> 6) & 0x3F];
+  }
+  out[o] = '\0';
+  return o;
+}
+
+const char* generateJWT() {
+  Serial.println("=== Generating JWT ===");
+  
+  if (!timeSynced) {
+    Serial.println("WARNING: Time not synchronized - JWT may be invalid!");
+  }
+  if (!jwtKeyReady) {
+    initJWTSigningKey();
+  }
+  
+  unsigned long startMicros = micros();
+  
+  // Get current Unix timestamp
+  unsigned long currentTime = getCurrentUnixTime();
+  unsigned long expirationTime = currentTime + JWT_LIFETIME_SEC;
+  
+  char payload[JWT_PAYLOAD_MAX_LEN];
+  int payloadLen = snprintf(payload, sizeof(payload),
+    "{\"iss\":\"esp32-sensor\",\"sub\":\"%s\",\"aud\":\"emqx\",\"exp\":%lu,\"iat\":%lu,"
+    "\"device_id\":\"%s\",\"mac_address\":\"%s\",\"firmware_version\":\"%s\","
+    "\"build_timestamp\":\"%s\"}",
+    deviceHostname.c_str(), expirationTime, currentTime, DEVICE_ID, jwtMacAddress,
+    FIRMWARE_VERSION, BUILD_TIMESTAMP);
+  if (payloadLen <= 0 || payloadLen >= (int)sizeof(payload)) {
+    Serial.println("JWT payload too large");
+    return jwtToken;
+  }
+  
+  // header.payload, then HMAC over it and append .signature
+  char* p = jwtToken;
+  memcpy(p, JWT_HEADER_B64, sizeof(JWT_HEADER_B64) - 1);
+  p += sizeof(JWT_HEADER_B64) - 1;
+  *p++ = '.';
+  p += base64UrlEncode((const uint8_t*)payload, payloadLen, p);
+  
+  uint8_t signature[32];
+  hmacSha256((const uint8_t*)jwtToken, p - jwtToken, signature);
+  *p++ = '.';
+  base64UrlEncode(signature, sizeof(signature), p);
+  
+  jwtExpiresAt = expirationTime;
+  jwtGeneratedCount++;
+  jwtLastGenerateMicros = micros() - startMicros;
+  
+  Serial.print("Current Unix time: ");
+  Serial.println(currentTime);
+  Serial.print("Expiration time: ");
+  Serial.println(expirationTime);
+  Serial.print("JWT Payload: ");
+  Serial.println(payload);
+  Serial.print("JWT generated in ");
+  Serial.print(jwtLastGenerateMicros);
+  Serial.print(" us: ");
+  Serial.println(jwtToken);
+  
+  return jwtToken;
+}
+
+// Returns the cached token, regenerating it only when it is missing or
+// within JWT_REFRESH_MARGIN_SEC of expiry
+const char* getJWT() {
+  unsigned long now = getCurrentUnixTime();
+  if (jwtToken[0] == '\0' || now + JWT_REFRESH_MARGIN_SEC >= jwtExpiresAt) {
+    return generateJWT();
+  }
+  jwtCacheHits++;
+  return jwtToken;
+}
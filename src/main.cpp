@@ -4,14 +4,33 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <ArduinoJson.h>
-#include <ArduinoJWT.h>
 #include <time.h>
+#include <esp_sntp.h>
 #include <HTTPClient.h>
 #include <Update.h>
 #include <esp_ota_ops.h>
 #include <mbedtls/md.h>
 #include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ecdsa.h>
+#include <mbedtls/base64.h>
 #include <FastLED.h>
+#include <Preferences.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_freertos_hooks.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#include <driver/adc.h>
+#include <driver/rmt.h>
+#include "scheduler.h"
+#include "sensor_registry.h"
+#include "window_stats.h"
+#include "mqtt_outbox.h"
+#include "mq7_filter.h"
+#include "mq7_ppm_table.h"
+#include "report_policy.h"
+#include "camera_gate.h"
 
 #ifdef ESP32
 #include "esp_camera.h"
@@ -36,6 +55,8 @@ const int MQTT_PORT = 1883;
 // JWT Configuration
 const char* JWT_SECRET = "JWTSecret";
 const char* DEVICE_ID = "esp32s3_sensor_01";
+const unsigned long JWT_LIFETIME_SEC = 3600;      // Token validity (exp - iat)
+const unsigned long JWT_REFRESH_MARGIN_SEC = 300; // Reuse cached token until this close to expiry
 
 // NTP Configuration
 const char* NTP_SERVER = "pool.ntp.org";
@@ -57,8 +78,11 @@ enum AttachmentType {
   ATTACHMENT_TRAFFIC
 };
 
-// Select the attachment type used on the board here:
+// Attachment used when NVS holds none. Stored in NVS ("sensors"/"attachment",
+// one of the names below) and changed over MQTT on <host>/config/attachment;
+// it is read once at boot, alongside the sensor list.
 const AttachmentType ATTACHMENT = ATTACHMENT_BUILTIN; // change as needed
+const char* const ATTACHMENT_NAMES[] = {"neopixel", "builtin", "rgb", "traffic"};
 
 // Pins for RGB / Traffic light attachments (examples: D7,D8,D9)
 const int RGB_R_PIN = D7;
@@ -69,21 +93,53 @@ const int TRAFFIC_RED_PIN = D7;
 const int TRAFFIC_YELLOW_PIN = D8;
 const int TRAFFIC_GREEN_PIN = D9;
 
-// Sensor configuration
-enum SensorType {
-  SENSOR_DHT_TEMP,        // Temperature and Humidity (DHT22 or similar)
-  SENSOR_MQ7_GAS,         // MQ7 Gas Sensor (CO detector)
-  SENSOR_SENSE,           // Overhead doorway sense (two-beam direction sensor)
-  SENSOR_SENSE_CAMERA     // Camera-based overhead doorway sensor (OV5640/OV2640)
-};
-
-// Select the sensor type used on the board here:
+// Sensor used when NVS holds no sensor list. Several sensors can run side by
+// side: the list is stored in NVS ("sensors"/"enabled", comma-separated
+// driver names such as "mq7,sense_camera") and can be changed over MQTT on
+// <host>/config/sensors; it is read once at boot.
 const SensorType SENSOR = SENSOR_SENSE_CAMERA; // change as needed
 
 // Pin definitions for sensors
 const int DHT_PIN = D0;           // GPIO1 (D0 on XIAO) - DHT temperature/humidity sensor
+
+// Probe on DHT_PIN for SENSOR_DHT_TEMP: a DHT22 (temperature + humidity) or
+// one or more DS18B20s on a OneWire bus (temperature only)
+enum TempProbe {
+  TEMP_PROBE_DHT22,
+  TEMP_PROBE_DS18B20
+};
+const TempProbe TEMP_PROBE = TEMP_PROBE_DHT22;
 const int MQ7_ANALOG_PIN = A1;    // GPIO3 (A1 on XIAO) - MQ7 analog output
 const int MQ7_DIGITAL_PIN = D2;   // GPIO26 (D2 on XIAO) - MQ7 digital output (threshold)
+const int MQ7_HEATER_PIN = D5;    // GPIO6 (D5 on XIAO) - PWM to the heater MOSFET gate
+
+// MQ7 heater cycle from the datasheet: 60 s at 5 V burns off adsorbed gas,
+// then 90 s at 1.4 V during which the sensor responds to CO. Only the end of
+// the 1.4 V phase gives a valid reading, so reports are published then
+// instead of on TEMP_READ_INTERVAL. Leave false when the heater is wired
+// straight to 5 V.
+const bool MQ7_HEATER_CYCLE = false;
+const unsigned long MQ7_HEAT_PHASE_MS = 60000;
+const unsigned long MQ7_MEASURE_PHASE_MS = 90000;
+const unsigned long MQ7_VALID_WINDOW_MS = 10000; // tail of the 1.4 V phase that counts
+const uint8_t MQ7_HEATER_LEDC_CHANNEL = 2;
+const uint32_t MQ7_HEATER_PWM_HZ = 20000;
+const uint8_t MQ7_HEATER_DUTY_HIGH = 255;               // 5 V
+// The heater is resistive, so PWM has to match power: duty = (1.4 / 5)^2
+const uint8_t MQ7_HEATER_DUTY_LOW = 255 * (1.4 / 5.0) * (1.4 / 5.0); // 1.4 V RMS-equivalent
+
+// Clean-air auto-calibration: R0 follows the highest Rs seen over the last
+// 24 hours (CO only ever lowers Rs), assuming the room airs out at least
+// once a day. The result is kept in NVS so it survives reboots.
+const bool MQ7_AUTO_CALIBRATION = true;
+const float MQ7_CLEAN_AIR_PPM = 1.0;       // background CO assumed at the Rs peak
+const int MQ7_BASELINE_BUCKETS = 24;
+const unsigned long MQ7_BASELINE_BUCKET_MS = 3600000; // 1 hour
+const int MQ7_BASELINE_MIN_BUCKETS = 6;    // hours of history before R0 is trusted
+const float MQ7_R0_UPDATE_THRESHOLD = 0.02; // rebuild/persist only on a 2% change
+const float MQ7_R0_MIN_KOHM = 0.1;         // range an MQ7 can physically report;
+const float MQ7_R0_MAX_KOHM = 1000.0;      // Rs samples are clamped to it too
+const int MQ7_BASELINE_MIN_ADC_CODE = 16;  // ~13 mV: open or shorted sensor, not clean air
 
 // Pins for SENSOR_SENSE (two sensors to determine direction)
 // Place these above the doorway, offset so that an approaching person trips
@@ -92,6 +148,11 @@ const int SENSE_A_PIN = D3; // Sensor A (e.g., closer to entry side)
 const int SENSE_B_PIN = D4; // Sensor B (e.g., closer to exit side)
 const unsigned long SENSE_TIMEOUT_MS = 1000; // Time window (ms) to consider sequential triggers
 const bool SENSE_ACTIVE_LOW = true; // If sensors use pull-ups and go LOW when triggered
+const uint32_t SENSE_DEBOUNCE_US = 3000; // a beam level must hold this long to count
+const uint32_t SENSE_MIN_GAP_US = 2000;  // A/B breaking closer together than this has no direction
+const float SENSE_BEAM_SPACING_MM = 150.0; // distance between beam A and beam B
+const unsigned long SENSE_DWELL_TIMEOUT_MS = 5000; // stop waiting for the beams to clear
+const float SENSE_WAKE_CONFIDENCE = 0.8; // speed from the clears only: the wake edge's time is late
 
 // Camera settings (OV5640/OV2640 via ESP32-CAM connector)
 // NOTE: These are typical ESP32-CAM pin mappings — adjust to your wiring.
@@ -119,12 +180,20 @@ const int CAM_PIN_D5 = 12; // DVP_Y7 (GPIO12)
 const int CAM_PIN_D6 = 11; // DVP_Y8 (GPIO11)
 const int CAM_PIN_D7 = 48; // DVP_Y9 (GPIO48)
 
-// Frame-diff parameters
-const int CAM_FRAME_WIDTH = 160;
-const int CAM_FRAME_HEIGHT = 120;
-const int CAM_DIFF_THRESHOLD = 30; // per-pixel threshold
-const int CAM_MOTION_MIN_PIXELS = 200; // min changed pixels to consider motion
-const int CAM_AMBIGUOUS_PIXELS = 800; // above this, consider ambiguous and send frame
+// Frame-diff, motion gate and illumination parameters: camera_gate.h
+const int CAM_BENCH_FRAMES = 10;    // frames timed at boot (DMA bytes/frame and fps)
+// Ambiguous-event thumbnails: the 160x120 grayscale frame the diff already
+// holds is compressed on the CPU and published at once, with no sensor
+// reconfiguration. The VGA JPEG capture (camera deinit + reinit, frames lost
+// while it runs) can stay enabled alongside it or be switched off.
+enum CameraThumbnailFormat {
+  THUMBNAIL_NONE,
+  THUMBNAIL_JPEG  // baseline grayscale JPEG via fmt2jpg (esp32-camera software encoder)
+};
+const CameraThumbnailFormat CAMERA_THUMBNAIL_FORMAT = THUMBNAIL_JPEG;
+const int CAMERA_THUMBNAIL_JPEG_QUALITY = 80;  // fmt2jpg scale: 1-100, higher is better
+const unsigned long CAMERA_THUMBNAIL_MIN_INTERVAL_MS = 1000; // one per walker, not one per frame
+const bool CAMERA_AMBIGUOUS_FULL_RES = true;   // also run the VGA JPEG capture
 
 // Where ambiguous/full frames are published (MQTT topic base). The actual
 // topic used is `deviceHostname + "/" + CAMERA_FRAME_TOPIC_BASE`.
@@ -149,22 +218,50 @@ const char CAMERA_NTFY_TOKEN[] = "";
 
 // JPEG capture tuning constants are defined in the ESP32 camera section
 
-// Camera runtime state
+// Camera runtime state (detector state in camera_gate.h)
 bool cameraAvailable = false;
-uint8_t* prevFrame = NULL;
-uint8_t* currFrame = NULL;
-int prevMotionX = -1;
+size_t cameraFrameBytes = 0;     // DMA bytes per frame, from the last boot benchmark
+float cameraCaptureFps = 0.0;    // frames/s the driver delivered in that benchmark
+size_t cameraLastUploadBytes = 0; // size of the last ambiguous JPEG upload, 0 until one is sent
+unsigned long cameraThumbnailsPublished = 0;
+unsigned long cameraLastThumbnailAt = 0;
+size_t cameraThumbnailBytes = 0;          // last thumbnail published
+unsigned long cameraThumbnailEncodeUs = 0;
 
 // Timing
 const unsigned long TEMP_READ_INTERVAL = 30000; // 30 seconds
-const unsigned long JWT_REFRESH_INTERVAL = 1800000; // 30 minutes (refresh JWT before 1hr expiry)
+// Temperature probe sampling inside each report window. The DHT22 needs 2 s
+// between reads; battery nodes sample once per report instead.
+const unsigned long TEMP_SAMPLE_INTERVAL = 5000;
+
+// Deadband reporting and gas level hysteresis: see report_policy.h
+
+// Power saving for battery-backed nodes (SENSOR_DHT_TEMP, SENSOR_MQ7_GAS and
+// SENSOR_SENSE). The radio sleeps between DTIM beacons, the CPU drops into
+// automatic light sleep between scheduler deadlines, and doorway beams wake
+// it through GPIO. Camera nodes always stay awake.
+const bool LOW_POWER_MODE = false;
+const unsigned long LOW_POWER_MQTT_KEEPALIVE_SEC = 120; // 4x the sample interval, so pings rarely wake the radio
+const unsigned long LOW_POWER_TASK_INTERVAL = 1000;     // display, MQTT and connection polling
+// Rough XIAO ESP32-S3 supply current for the duty-cycle estimate
+const float CURRENT_AWAKE_MA = 45.0;
+const float CURRENT_MODEM_SLEEP_MA = 20.0; // CPU idle, radio asleep between DTIMs
+const float CURRENT_LIGHT_SLEEP_MA = 2.0;  // light sleep, averaged over DTIM wakeups
+const unsigned long JWT_ROTATE_MARGIN_SEC = 120; // Swap the MQTT session onto a fresh token this close to expiry
+const unsigned long JWT_ROTATE_CHECK_INTERVAL = 1000; // How often the scheduler checks token expiry
 const unsigned long OTA_CHECK_INTERVAL = 300000; // 5 minutes (check for updates)
 
 // OTA Configuration
 const char* OTA_SERVER_URL = "https://your-firmware-server.com"; // Update this
+// ECDSA P-256 public key used to verify firmware signatures. Generate the key
+// pair with `python3 ota_tools/sign_firmware.py keygen` and paste the printed
+// public key here. The matching private key must never leave the build host.
 const char* OTA_PUBLIC_KEY = "-----BEGIN PUBLIC KEY-----\n"
-                            "MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEA...\n"  // Update with your public key
+                            "MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAE...\n"  // Update with your public key
                             "-----END PUBLIC KEY-----\n";
+// Signature verification must finish within this budget so the validating
+// phase doesn't stall the device (SHA and bignum run on the S3 accelerators)
+const unsigned long OTA_VERIFY_BUDGET_MS = 100;
 
 // Objects
 // Temperature sensor objects (initialized only if selected)
@@ -176,6 +273,40 @@ const char* OTA_PUBLIC_KEY = "-----BEGIN PUBLIC KEY-----\n"
 OneWire oneWire(DHT_PIN);  // Note: using DHT_PIN instead of TEMP_SENSOR_PIN
 DallasTemperature sensors(&oneWire);  // For DHT_TEMP mode (if using OneWire)
 
+// DS18B20 bus state. Conversions are started without waiting and collected
+// by a one-shot scheduler task once the conversion time has passed, so the
+// loop keeps running for the 750 ms a 12-bit conversion takes. ROM codes are
+// enumerated once at init and every sensor is read by address.
+const uint8_t DS18B20_RESOLUTION = 12;
+const int DS18B20_MAX_SENSORS = 4;
+DeviceAddress ds18b20Addresses[DS18B20_MAX_SENSORS];
+float ds18b20Temps[DS18B20_MAX_SENSORS];
+int ds18b20Count = 0;
+bool ds18b20ReadingReady = false;
+int ds18b20TaskId = -1;
+
+// DHT22 via RMT: the start pulse is timed by the scheduler and the reply is
+// captured by the RMT receiver at 1 us resolution, so nothing bit-bangs
+// with interrupts off (which would disturb Wi-Fi and the camera DMA).
+const rmt_channel_t DHT22_RMT_CHANNEL = RMT_CHANNEL_4; // first RX-capable channel on the S3
+const unsigned long DHT22_START_LOW_MS = 2;   // host start signal, datasheet: at least 1 ms
+const unsigned long DHT22_CAPTURE_MS = 10;    // reply is ~5 ms
+const uint16_t DHT22_IDLE_THRESHOLD_US = 200; // line high this long ends the capture
+const uint16_t DHT22_BIT_THRESHOLD_US = 48;   // high time: ~26 us = 0, ~70 us = 1
+const int DHT22_MAX_PULSES = 96;
+enum DHT22Phase {
+  DHT22_IDLE,
+  DHT22_START_SIGNAL,
+  DHT22_CAPTURING
+};
+DHT22Phase dht22Phase = DHT22_IDLE;
+RingbufHandle_t dht22Ringbuf = NULL;
+int dht22TaskId = -1;
+float dht22Temperature = 0.0;
+float dht22Humidity = 0.0;
+bool dht22ReadingReady = false;
+unsigned long dht22Errors = 0;
+
 WiFiClient wifiClient;
 PubSubClient mqttClient(wifiClient);
 
@@ -185,16 +316,70 @@ CRGB currentColor = CRGB::Black;
 uint8_t brightness = 50; // Default brightness (0-255)
 
 // Variables
-unsigned long lastTempRead = 0;
-unsigned long lastMQTTAttempt = 0;
-unsigned long lastLEDUpdate = 0;
-unsigned long lastJWTRefresh = 0;
-unsigned long lastOTACheck = 0;
 String deviceHostname;
 String mqttUsername;
-String mqttPassword;
+String mqttClientId;
+unsigned long mqttSessionExpiresAt = 0; // exp of the JWT the current session authenticated with
+unsigned long mqttLastRotationGapMs = 0;
+unsigned long mqttRotationCount = 0;
 bool timeSynced = false;
 bool wifiConnected = false;
+
+// Set from the WiFi/SNTP event task, consumed by checkConnections() in loop()
+volatile bool wifiGotIPEvent = false;
+volatile bool wifiDisconnectedEvent = false;
+volatile bool timeSyncEvent = false;
+unsigned long wifiConnectedAt = 0;
+bool mqttConnectNow = true; // skip the backoff for the next MQTT attempt
+
+// MQTT reconnect scheduling. Retries use capped exponential backoff with full
+// jitter (delay drawn uniformly from [0, min(cap, base * 2^n)]) from a PRNG
+// seeded by the MAC, so a fleet that lost the broker together doesn't come
+// back in lockstep. Repeated auth rejections open a circuit breaker instead
+// of hammering the broker's JWT check every few seconds.
+const unsigned long MQTT_BACKOFF_BASE_MS = 2000;
+const unsigned long MQTT_BACKOFF_MAX_MS = 120000;
+const int MQTT_AUTH_BREAKER_THRESHOLD = 3;               // consecutive auth failures
+const unsigned long MQTT_AUTH_BREAKER_OPEN_MS = 300000;  // then wait 5 minutes
+unsigned long mqttNextAttemptAt = 0;
+int mqttFailureCount = 0;
+int mqttAuthFailureCount = 0;
+unsigned long mqttLastBackoffMs = 0;
+unsigned long mqttAuthBreakerTrips = 0;
+uint32_t mqttJitterState = 1;
+const unsigned long MQTT_TIME_SYNC_WAIT_MS = 20000; // connect anyway if NTP hasn't synced by then
+
+// Last successful association, persisted in NVS so boots and reconnects can
+// try a directed connect (known BSSID/channel, no scan) before a full scan
+struct WiFiCache {
+  bool valid;
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+WiFiCache wifiCache;
+bool wifiFastConnectActive = false;
+unsigned long wifiConnectStartedAt = 0;
+const unsigned long WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;
+// Reuse the cached DHCP lease as a static IP to skip DHCP. Only safe where
+// leases are long-lived or reserved for the device.
+const bool WIFI_REUSE_DHCP_LEASE = false;
+
+// Connect/reconnect duration histogram (upper bounds in ms, last bucket is overflow)
+const unsigned long WIFI_CONNECT_HIST_BOUNDS[] = {250, 500, 1000, 2000, 5000};
+const int WIFI_CONNECT_HIST_BUCKETS = 6;
+unsigned long wifiConnectHist[WIFI_CONNECT_HIST_BUCKETS] = {0};
+unsigned long wifiLastConnectMs = 0;
+bool wifiLastConnectFast = false;
+
+// Boot latency milestones (ms since boot), reported in the status payload
+unsigned long bootWiFiMs = 0;
+unsigned long bootTimeSyncMs = 0;
+unsigned long bootMQTTMs = 0;
+unsigned long bootFirstPublishMs = 0;
 bool mqttConnected = false;
 bool mqttConnecting = false;
 bool otaInProgress = false;
@@ -224,6 +409,70 @@ enum OTAStatus {
 
 OTAStatus currentOTAStatus = OTA_IDLE;
 
+// SHA-256 of the firmware image, computed while it is streamed to flash
+uint8_t otaFirmwareDigest[32];
+unsigned long otaLastVerifyMs = 0;
+
+// Update deferred by the rollout scheduler (start_delay_ms) or by the
+// firmware server answering 503 + Retry-After
+bool otaPending = false;
+String otaPendingUrl;
+String otaPendingVersion;
+String otaPendingSignature;
+int otaBusyRetries = 0;
+unsigned long otaRetryAfterMs = 0; // set by downloadFirmware on HTTP 503
+const int OTA_MAX_BUSY_RETRIES = 10;
+const unsigned long OTA_DEFAULT_RETRY_AFTER_MS = 15000;
+
+// Active OTA session, advanced a slice at a time by serviceOTAUpdate()
+HTTPClient otaHttp;
+WiFiClientSecure otaSecureClient;
+mbedtls_sha256_context otaSha256Ctx;
+String otaActiveUrl;
+String otaActiveVersion;
+String otaActiveSignature;
+bool otaHttpOpen = false;
+size_t otaContentLength = 0;
+size_t otaWritten = 0;
+float otaProgress = 0.0;
+unsigned long otaLastDataAt = 0;
+unsigned long otaLastProgressPublish = 0;
+const unsigned long OTA_SLICE_MS = 20; // max time spent downloading per loop()
+const unsigned long OTA_PROGRESS_PUBLISH_INTERVAL = 5000;
+const unsigned long OTA_STALL_TIMEOUT_MS = 30000;
+// openFirmwareDownload() still blocks loop() for the TCP connect, the TLS
+// handshake and the response headers; each is bounded by this
+const unsigned long OTA_CONNECT_TIMEOUT_MS = 3000;
+
+// Longest single loop() pass (excluding the idle sleep), to track stalls
+unsigned long loopMaxStallMs = 0;
+
+// Deadline scheduler task periods (scheduler.h)
+const unsigned long DISPLAY_UPDATE_INTERVAL = 100;
+const unsigned long SENSE_UPDATE_INTERVAL = 100;
+const unsigned long CONNECTION_CHECK_INTERVAL = 100;
+const unsigned long MQTT_LOOP_INTERVAL = 100;
+const unsigned long OTA_SERVICE_INTERVAL = 1; // keep downloading at full speed
+TaskHandle_t loopTaskHandle = NULL;
+int connectionTaskId = -1;
+int otaStartTaskId = -1;
+int otaServiceTaskId = -1;
+
+// Power management state and duty-cycle instrumentation (see initPowerManagement)
+bool lowPowerActive = false;
+bool lightSleepEnabled = false;
+int senseTaskId = -1;
+volatile bool senseEdgeEvent = false; // set by the sense ISRs, consumed by loop()
+unsigned long powerLastReportAt = 0;
+unsigned long powerLastSleepMs = 0;
+
+// exp claim of the cached token, and JWT generation instrumentation
+// (see generateJWT / getJWT)
+unsigned long jwtExpiresAt = 0;
+unsigned long jwtGeneratedCount = 0;
+unsigned long jwtCacheHits = 0;
+unsigned long jwtLastGenerateMicros = 0;
+
 // LED Status
 enum LEDStatus {
   LED_OFF,
@@ -243,16 +492,35 @@ LEDStatus currentLEDStatus = LED_OFF;
 
 // Function declarations
 void connectToWiFi();
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+void loadWiFiCache();
+void saveWiFiCache();
+void startWiFiFullScan();
+void startWiFiDirectedConnect();
+void recordWiFiConnectDuration(unsigned long durationMs);
 void syncTime();
+void onTimeSync(struct timeval* tv);
 void connectToMQTT();
+void seedMQTTJitter(const String& macAddress);
+uint32_t mqttJitterRandom();
+void scheduleMQTTReconnect(bool authFailure);
+void subscribeMQTTTopics();
+void rotateMQTTSession();
+bool mqttPublishOrQueue(const char* topic, const char* payload);
+void flushMQTTOutbox();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-void readAndPublishTemperature();
 void publishStatus(const char* status);
-String generateJWT();
+void initJWTSigningKey();
+const char* generateJWT();
+const char* getJWT();
 unsigned long getCurrentUnixTime();
 void setLEDStatus(LEDStatus status);
 void updateLEDStatus();
 void checkConnections();
+void wakeLoop();
+void initScheduler();
+void initPowerManagement();
+void printCurrentTime();
 
 // Neopixel Function declarations
 void initializeNeopixels();
@@ -279,13 +547,38 @@ void attachmentFlash(CRGB color, uint32_t duration = 100);
 void attachmentTemperatureFlash();
 void updateAttachments();
 
-// Gas level thresholds (for MQ7)
-enum GasLevel {
-  GAS_LOW,        // < 5 ppm - Green (safe)
-  GAS_MEDIUM,     // 5-15 ppm - Yellow (caution)
-  GAS_HIGH,       // 15-35 ppm - Orange (warning)
-  GAS_CRITICAL    // > 35 ppm - Red (danger)
+// MQ7 continuous sampling (filter in mq7_filter.h)
+const unsigned long MQ7_ADC_POLL_INTERVAL = 100; // drain the DMA buffer
+const uint32_t MQ7_DMA_BUFFER_BYTES = 1024;
+// Report windows (window_stats.h), cleared once a report is published
+WindowStats gasWindow;
+WindowStats tempWindow;
+WindowStats humidityWindow;
+int tempSampleRuns = 0;          // sample task runs since the last report
+bool tempReportPending = false;  // publish with the next successful read
+void onTemperatureSample();
+bool mq7ContinuousActive = false;
+float gasFilteredPpm = 0.0;
+GasLevel gasAlertLevel = GAS_LOW; // highest level already alerted on
+unsigned long gasRawSamples = 0;
+unsigned long gasDmaOverruns = 0;
+unsigned long gasFilterMicros = 0; // CPU time spent filtering, for the status payload
+enum MQ7HeaterPhase {
+  MQ7_PHASE_HEAT,    // 5 V purge, readings invalid
+  MQ7_PHASE_MEASURE  // 1.4 V, valid during the last MQ7_VALID_WINDOW_MS
 };
+MQ7HeaterPhase mq7HeaterPhase = MQ7_PHASE_MEASURE;
+unsigned long mq7PhaseStartedAt = 0;
+int mq7HeaterTaskId = -1;
+esp_pm_lock_handle_t mq7HeaterPmLock = NULL;
+struct MQ7Baseline {
+  float rsMax[MQ7_BASELINE_BUCKETS]; // highest Rs per hour, 0 = no samples
+  int current;
+  int filled;
+  unsigned long bucketStartedAt;
+};
+MQ7Baseline mq7Baseline;
+bool mq7R0FromNVS = false;
 
 // Sensor-agnostic wrapper functions
 void initializeSensor();
@@ -297,39 +590,197 @@ struct SensorReadings {
   bool digitalThreshold;  // For MQ7 digital output
   GasLevel gasCategoryLevel;  // Categorized gas level
 };
-SensorReadings readSensor();
+SensorReadings readSensor(SensorType type);
+void readAndPublishSensor(SensorType type);
 void publishSensorData();
+
+void loadSensorConfig();
+void handleSensorConfigMessage(const String& message);
+AttachmentType attachmentType = ATTACHMENT;
+int parseAttachmentName(const String& name);
+void handleAttachmentConfigMessage(const String& message);
+void initTemperatureProbe();
+void initMQ7Sensor();
+void initSenseBeams();
+void initSenseCamera();
+void sampleTemperatureProbe();
+void sampleGas();
+bool serializeTemperature(JsonDocument& doc);
+bool serializeGas(JsonDocument& doc);
+void resetTemperatureWindow();
+void resetGasWindow();
+// DS18B20 asynchronous conversion
+void initTemperatureSensors();
+void startTemperatureConversion();
+void taskCollectTemperatures();
+// DHT22 over RMT
+bool initDHT22();
+void startDHT22Read();
+void taskDHT22();
+bool decodeDHT22(const rmt_item32_t* items, size_t count, float* temperature, float* humidity);
+// MQ7 sampling pipeline
+bool initGasADC();
+// MQ7 heater cycle and R0 calibration
+void initMQ7Heater();
+void taskMQ7Heater();
+bool mq7ReadingValid();
+void updateMQ7Baseline(float rs);
+float loadMQ7R0();
+void saveMQ7R0(float r0);
+void taskSampleGas();
+void onGasFiltered();
+void publishGasAlert(GasLevel level, float ppm);
 // SENSOR_SENSE function declarations
 void updateSenseSensor();
-void publishTrafficEvent(const char* event, int inCount, int outCount);
+void IRAM_ATTR onSenseEdgeA();
+void IRAM_ATTR onSenseEdgeB();
+void IRAM_ATTR onSenseLevelA();
+void IRAM_ATTR onSenseLevelB();
+void IRAM_ATTR onSenseTick();
+bool senseWakeupArmed();
+void resetSenseDecoder();
+void settleSenseBeams(uint32_t nowUs);
+void onSenseBeamChange(int beam, bool active, uint32_t timeUs, bool approximate);
+void expireSenseState(uint32_t nowUs);
+void finishSenseCrossing(int index, uint32_t nowUs);
+void publishTrafficWindow();
+struct TrafficCrossing;
+void publishTrafficEvent(const char* event, int inCount, int outCount, const TrafficCrossing* crossing = NULL);
+void recordTrafficCrossing(const TrafficCrossing& crossing);
 // Camera-based sense declarations
 bool initializeCameraModule();
 bool captureGrayscaleFrame(uint8_t* buf, int w, int h); // fills buf with w*h bytes (0-255)
+void setCameraAutoExposure(bool enabled);
+void benchmarkCameraCapture(const char* label);
+void benchmarkThumbnailEncoder();
+void publishCameraThumbnail(int motionPixels);
 void processCameraFrame();
 
 // Global variable to track current gas level
 GasLevel currentGasLevel = GAS_LOW;
 
 // ===== SENSOR_SENSE (doorway traffic) globals =====
-enum SenseState {
-  SENSE_IDLE,
-  SENSE_A_TRIGGERED,
-  SENSE_B_TRIGGERED
-};
-
 volatile int senseInCount = 0;
 volatile int senseOutCount = 0;
-SenseState senseState = SENSE_IDLE;
-unsigned long senseLastTriggerTime = 0;
+
+// Beam edges captured by the GPIO ISRs with a microsecond timestamp. One
+// producer (both ISRs run on the loop core and don't nest) and one consumer
+// (updateSenseSensor), so the ring needs no lock. Each side publishes its
+// index with a release store and reads the other's with an acquire load, so
+// an entry is complete before the consumer can see it and is read before the
+// producer may reuse its slot.
+struct SenseEdge {
+  uint32_t timeUs;
+  uint8_t beam;   // 0 = A, 1 = B
+  uint8_t active; // beam broken after this edge
+  uint8_t approximate; // may have woken the chip: stamped late by the wake-up latency
+};
+const uint32_t SENSE_EDGE_RING_SIZE = 64; // power of two
+SenseEdge senseEdgeRing[SENSE_EDGE_RING_SIZE];
+volatile uint32_t senseEdgeHead = 0;
+volatile uint32_t senseEdgeTail = 0;
+volatile uint32_t senseEdgeDropped = 0;
+
+// In light sleep the edge that wakes the chip is only timestamped once the
+// ISR runs after wake-up. Light sleep is held off while anything is in the
+// doorway, so every later edge of the crossing is exact.
+esp_pm_lock_handle_t senseAwakePmLock = NULL;
+volatile bool senseAwakeHeld = false;
+// Wake detection: the tick hook runs every FreeRTOS tick while the loop core
+// is awake and never in light sleep (tickless idle stops the tick), so a
+// tick gap is a sleep. An edge is flagged when the chip's last wake was a
+// GPIO wake and it lands before the first tick after it, or within one
+// tick period of that tick (the tick and GPIO interrupts pend together).
+const uint32_t SENSE_TICK_GAP_US = 2 * portTICK_PERIOD_MS * 1000;
+volatile uint32_t senseLastTickUs = 0;
+volatile uint32_t senseWakeTickUs = 0; // first tick after the last sleep
+
+// Debounced beam state. A burst of edges settles once the beam has been quiet
+// for SENSE_DEBOUNCE_US and is timestamped with the burst's first edge.
+struct SenseBeam {
+  bool stable;
+  bool pending;
+  bool pendingLevel;
+  uint32_t pendingSince;
+  bool pendingApprox; // first edge of the burst carried a wake-up timestamp
+  uint32_t lastEdgeUs;
+};
+SenseBeam senseBeams[2];
+
+// One beam break (rise = beam blocked, fall = beam clear again)
+struct SenseBreak {
+  uint32_t rise;
+  uint32_t fall;
+  bool cleared;
+  bool approxRise; // rise is the edge that woke the chip
+};
+
+// Beam breaks still waiting for the other beam: A first = entering, B first =
+// exiting. Queued per beam so people following each other closely (the next
+// one breaking A while the previous still blocks B) are all counted.
+const int SENSE_PENDING_MAX = 4;
+SenseBreak sensePending[2][SENSE_PENDING_MAX];
+int sensePendingCount[2] = {0, 0};
+unsigned long senseRejectedCount = 0; // pairs dropped by the minimum-gap filter
+
+// Crossings whose direction is known, held until both beams clear so speed,
+// dwell and confidence can be measured
+struct SenseCrossing {
+  uint8_t firstBeam; // 0 = A (entering), 1 = B (exiting)
+  SenseBreak first;
+  SenseBreak second;
+  bool overlapped;   // someone else was in the doorway at the same time
+};
+const int SENSE_CROSSINGS_MAX = 4;
+SenseCrossing senseCrossings[SENSE_CROSSINGS_MAX];
+int senseCrossingCount = 0;
+
+// Measurements for one completed crossing
+struct TrafficCrossing {
+  bool entering;
+  float speed;          // m/s
+  unsigned long dwellMs; // first beam blocked until both clear
+  float confidence;     // 0..1
+};
+
+// Per-minute traffic histograms in fixed memory. Up to
+// TRAFFIC_RAW_EVENTS_PER_WINDOW crossings a minute are published as raw
+// events; past that they are only counted here and the window is published
+// as one summary message.
+const unsigned long TRAFFIC_WINDOW_MS = 60000;
+const int TRAFFIC_RAW_EVENTS_PER_WINDOW = 10;
+const int TRAFFIC_SPEED_BUCKETS = 5;      // upper bounds below, last bucket is overflow
+const float TRAFFIC_SPEED_BOUNDS[] = {0.5, 1.0, 1.5, 2.0};
+const int TRAFFIC_DWELL_BUCKETS = 5;
+const unsigned long TRAFFIC_DWELL_BOUNDS_MS[] = {250, 500, 1000, 2000};
+const int TRAFFIC_CONFIDENCE_BUCKETS = 3;
+const float TRAFFIC_CONFIDENCE_BOUNDS[] = {0.5, 0.8};
+struct TrafficWindow {
+  unsigned long startedAt; // unix time
+  uint16_t enter;
+  uint16_t exit;
+  uint16_t rawPublished;
+  uint16_t suppressed;
+  uint16_t speed[TRAFFIC_SPEED_BUCKETS];
+  uint16_t dwell[TRAFFIC_DWELL_BUCKETS];
+  uint16_t confidence[TRAFFIC_CONFIDENCE_BUCKETS];
+  float speedSum;
+};
+TrafficWindow trafficWindow;
 
 // OTA Function declarations
 void handleFirmwareUpdateMessage(JsonDocument& updateMsg);
 bool isNewerVersion(const String& newVersion, const String& currentVersion);
 void performOTAUpdate(const String& firmwareUrl, const String& version, const String& signature);
-bool downloadFirmware(const String& url, size_t& downloadedSize);
+void scheduleOTAUpdate(const String& firmwareUrl, const String& version, const String& signature,
+                       unsigned long delayMs);
+void serviceOTAUpdate();
+void abortOTAUpdate(const String& reason);
+bool openFirmwareDownload();
+int readFirmwareSlice();
 bool validateFirmwareSignature(const String& signature, size_t firmwareSize);
 void publishOTAStatus(OTAStatus status, const String& message = "");
-String calculateFirmwareSHA256();
+String digestToHex(const uint8_t* digest, size_t len);
 void checkForFirmwareUpdates();
 
 void setup() {
@@ -340,7 +791,6 @@ void setup() {
   digitalWrite(LED_PIN, LOW);
 
   Serial.begin(115200);
-  delay(1000);
   
   Serial.println("=== Seeed XIAO-ESP32-S3 MQTT Sensor with JWT ===");
   Serial.print("Firmware Version: ");
@@ -349,6 +799,27 @@ void setup() {
   Serial.println(BUILD_TIMESTAMP);
   Serial.println("Board: Seeed Studio XIAO-ESP32-S3");
   
+  // Generate device hostname from MAC
+  String macAddress = WiFi.macAddress();
+  macAddress.replace(":", "");
+  deviceHostname = "sensor_" + macAddress.substring(6); // Use last 6 chars
+  Serial.print("Device hostname: ");
+  Serial.println(deviceHostname);
+  
+  // Generate MQTT credentials using MAC address as username
+  mqttUsername = macAddress; // Use full MAC address as username
+  seedMQTTJitter(macAddress);
+  
+  // Which sensor drivers and attachment run on this board (NVS, falls back
+  // to SENSOR and ATTACHMENT)
+  loadSensorConfig();
+  
+  // Start WiFi and SNTP first; both complete in the background (see
+  // onWiFiEvent/onTimeSync) while the rest of the hardware initializes
+  connectToWiFi();
+  syncTime();
+  initPowerManagement();
+  
   // Initialize hardware
   pinMode(LIGHT_PIN, OUTPUT);
   pinMode(LED_PIN, OUTPUT);
@@ -370,47 +841,31 @@ void setup() {
   // Initialize Neopixels
   initializeAttachments();
   
-  // Initialize sensor (DHT or MQ7)
+  // Initialize the enabled sensor drivers
   initializeSensor();
   
-  // Generate device hostname from MAC
-  String macAddress = WiFi.macAddress();
-  macAddress.replace(":", "");
-  deviceHostname = "sensor_" + macAddress.substring(6); // Use last 6 chars
-  Serial.print("Device hostname: ");
-  Serial.println(deviceHostname);
-  
-  // Generate MQTT credentials using MAC address as username
-  mqttUsername = macAddress; // Use full MAC address as username
-  
-  // Connect to WiFi first
-  connectToWiFi();
-  
-  // Give WiFi stack time to fully initialize
-  if (wifiConnected) {
-    Serial.println("Waiting for network stack to stabilize...");
-    delay(2000);
-  }
-  
-  // Sync time with NTP
-  syncTime();
+  // JWT signing key; the token itself is regenerated once NTP has synced
+  initJWTSigningKey();
+  generateJWT();
   
-  // Generate JWT password after time sync
-  mqttPassword = generateJWT();
-  lastJWTRefresh = millis(); // Initialize JWT refresh timer
+  // Stable client ID (with version info for tracking) so the broker can keep a
+  // persistent session across reconnects and token rotations
+  mqttClientId = deviceHostname + "_v" + FIRMWARE_VERSION;
   
   Serial.print("MQTT Username (MAC): ");
   Serial.println(mqttUsername);
   Serial.print("MQTT Password (JWT): ");
-  Serial.println(mqttPassword);
+  Serial.println(getJWT());
   
-  Serial.println("Setup complete! MQTT connection will be attempted in the main loop.");
+  initScheduler();
+  
+  Serial.println("Setup complete! MQTT will connect as soon as WiFi and time are up.");
 }
 
 // ===== Attachment wrapper implementations =====
 
 void initializeAttachments() {
-  switch (ATTACHMENT) {
+  switch (attachmentType) {
     case ATTACHMENT_NEOPIXEL:
       Serial.println("=== Initializing Neopixel Attachment ===");
       initializeNeopixels();
@@ -461,7 +916,7 @@ static unsigned long _attach_lastSpin = 0;
 static uint8_t _attach_spinPos = 0;
 
 void attachmentSetColor(CRGB color, uint8_t brightness) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     setNeopixelColor(color, brightness);
     return;
   }
@@ -469,19 +924,19 @@ void attachmentSetColor(CRGB color, uint8_t brightness) {
   // For non-Neopixel attachments, map color to digital outputs
   bool isOn = !(color == CRGB::Black);
 
-  if (ATTACHMENT == ATTACHMENT_BUILTIN) {
+  if (attachmentType == ATTACHMENT_BUILTIN) {
     digitalWrite(LED_PIN, isOn ? HIGH : LOW);
     return;
   }
 
-  if (ATTACHMENT == ATTACHMENT_RGB) {
+  if (attachmentType == ATTACHMENT_RGB) {
     digitalWrite(RGB_R_PIN, color.r > 0 ? HIGH : LOW);
     digitalWrite(RGB_G_PIN, color.g > 0 ? HIGH : LOW);
     digitalWrite(RGB_B_PIN, color.b > 0 ? HIGH : LOW);
     return;
   }
 
-  if (ATTACHMENT == ATTACHMENT_TRAFFIC) {
+  if (attachmentType == ATTACHMENT_TRAFFIC) {
     // Map primary colors to traffic LEDs
     if (color == CRGB::Red) {
       digitalWrite(TRAFFIC_RED_PIN, HIGH);
@@ -510,7 +965,7 @@ void attachmentSetColor(CRGB color, uint8_t brightness) {
 }
 
 void attachmentSetProgress(float progress, CRGB color) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     setNeopixelProgress(progress, color);
     return;
   }
@@ -524,7 +979,7 @@ void attachmentSetProgress(float progress, CRGB color) {
 }
 
 void attachmentBlink(CRGB color, uint32_t interval) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelBlink(color, interval);
     return;
   }
@@ -542,7 +997,7 @@ void attachmentBlink(CRGB color, uint32_t interval) {
 }
 
 void attachmentPulse(CRGB color, uint32_t speed) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelPulse(color, speed);
     return;
   }
@@ -552,7 +1007,7 @@ void attachmentPulse(CRGB color, uint32_t speed) {
 }
 
 void attachmentSpinning(CRGB color, uint32_t speed) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelSpinning(color, speed);
     return;
   }
@@ -562,11 +1017,11 @@ void attachmentSpinning(CRGB color, uint32_t speed) {
   if (now - _attach_lastSpin > speed) {
     _attach_spinPos = (_attach_spinPos + 1) % 3;
     _attach_lastSpin = now;
-    if (ATTACHMENT == ATTACHMENT_RGB) {
+    if (attachmentType == ATTACHMENT_RGB) {
       digitalWrite(RGB_R_PIN, _attach_spinPos == 0 ? HIGH : LOW);
       digitalWrite(RGB_G_PIN, _attach_spinPos == 1 ? HIGH : LOW);
       digitalWrite(RGB_B_PIN, _attach_spinPos == 2 ? HIGH : LOW);
-    } else if (ATTACHMENT == ATTACHMENT_TRAFFIC) {
+    } else if (attachmentType == ATTACHMENT_TRAFFIC) {
       digitalWrite(TRAFFIC_RED_PIN, _attach_spinPos == 0 ? HIGH : LOW);
       digitalWrite(TRAFFIC_YELLOW_PIN, _attach_spinPos == 1 ? HIGH : LOW);
       digitalWrite(TRAFFIC_GREEN_PIN, _attach_spinPos == 2 ? HIGH : LOW);
@@ -578,7 +1033,7 @@ void attachmentSpinning(CRGB color, uint32_t speed) {
 }
 
 void attachmentBreathe(CRGB color, uint32_t speed) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelBreathe(color, speed);
     return;
   }
@@ -589,7 +1044,7 @@ void attachmentBreathe(CRGB color, uint32_t speed) {
 }
 
 void attachmentFlash(CRGB color, uint32_t duration) {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelFlash(color, duration);
     return;
   }
@@ -600,7 +1055,7 @@ void attachmentFlash(CRGB color, uint32_t duration) {
 }
 
 void attachmentTemperatureFlash() {
-  if (ATTACHMENT == ATTACHMENT_NEOPIXEL) {
+  if (attachmentType == ATTACHMENT_NEOPIXEL) {
     neopixelTemperatureFlash();
     return;
   }
@@ -609,50 +1064,162 @@ void attachmentTemperatureFlash() {
 }
 
 void loop() {
-  // Update LED status
-  updateLEDStatus();
+  // WiFi/SNTP callbacks only set flags and wake us; handle them right away
+  if (wifiGotIPEvent || wifiDisconnectedEvent || timeSyncEvent) {
+    armScheduledTask(connectionTaskId, 0);
+  }
+  if (senseEdgeEvent) {
+    senseEdgeEvent = false;
+    armScheduledTask(senseTaskId, 0);
+  }
   
-  // Update Neopixels
-  updateAttachments();
-  // Update doorway sense sensor (if enabled)
-  updateSenseSensor();
+  unsigned long loopStart = millis();
+  unsigned long sleepMs = runDueTasks();
   
-  // Check and maintain connections
-  checkConnections();
+  unsigned long loopDuration = millis() - loopStart;
+  if (loopDuration > loopMaxStallMs) {
+    loopMaxStallMs = loopDuration;
+  }
   
-  // Handle MQTT messages
+  // Sleep until the next deadline; wakeLoop() cuts it short
+  if (sleepMs > 0) {
+    unsigned long sleepStart = millis();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs));
+    schedSleepTotalMs += millis() - sleepStart;
+  }
+}
+
+// ===== TASK SCHEDULER =====
+
+// Safe to call from other tasks (WiFi/SNTP event callbacks)
+void wakeLoop() {
+  if (loopTaskHandle != NULL) {
+    xTaskNotifyGive(loopTaskHandle);
+  }
+}
+
+void taskUpdateDisplay() {
+  updateLEDStatus();
+  updateAttachments();
+}
+
+void taskMQTTLoop() {
   if (mqttConnected) {
     mqttClient.loop();
   }
-  
-  // Read temperature periodically
-  if (mqttConnected && millis() - lastTempRead > TEMP_READ_INTERVAL) {
-    readAndPublishTemperature(); // LED flash handled in publish function
-    lastTempRead = millis();
+}
+
+// Reconnect MQTT onto a fresh token only when the session's token is
+// actually near expiry. getJWT() pre-builds the replacement token
+// JWT_REFRESH_MARGIN_SEC ahead so rotateMQTTSession() only costs a reconnect.
+void taskCheckJWTExpiry() {
+  if (!timeSynced || !mqttConnected) {
+    return;
+  }
+  unsigned long now = getCurrentUnixTime();
+  if (now + JWT_REFRESH_MARGIN_SEC >= mqttSessionExpiresAt) {
+    getJWT();
+  }
+  if (now + JWT_ROTATE_MARGIN_SEC >= mqttSessionExpiresAt) {
+    rotateMQTTSession();
+  }
+}
+
+void taskCheckForFirmwareUpdates() {
+  if (!otaInProgress && mqttConnected) {
+    checkForFirmwareUpdates();
+  }
+}
+
+// One-shot, armed by scheduleOTAUpdate() (staged rollout / server busy)
+void taskStartPendingOTA() {
+  if (!otaPending || otaInProgress) {
+    return;
+  }
+  if (!wifiConnected) {
+    armScheduledTask(otaStartTaskId, 1000);
+    return;
+  }
+  otaPending = false;
+  Serial.println("Starting scheduled OTA update...");
+  performOTAUpdate(otaPendingUrl, otaPendingVersion, otaPendingSignature);
+}
+
+// Advance an in-flight OTA update by one bounded slice; armed by
+// performOTAUpdate() and disarmed once the session ends
+void taskServiceOTA() {
+  serviceOTAUpdate();
+  if (!otaInProgress) {
+    disarmScheduledTask(otaServiceTaskId);
   }
+}
+
+void initScheduler() {
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
   
-  // Refresh JWT periodically (every 30 minutes)
-  if (timeSynced && millis() - lastJWTRefresh > JWT_REFRESH_INTERVAL) {
-    Serial.println("Refreshing JWT token...");
-    mqttPassword = generateJWT();
-    lastJWTRefresh = millis();
-    
-    // If currently connected, disconnect and reconnect with new token
-    if (mqttConnected) {
-      Serial.println("Reconnecting with fresh JWT token");
-      mqttClient.disconnect();
-      mqttConnected = false;
-      mqttConnecting = false;
-    }
+  // In low-power mode poll slowly and rely on events/edges to wake us
+  unsigned long pollInterval = lowPowerActive ? LOW_POWER_TASK_INTERVAL : 0;
+  
+  addScheduledTask("display", taskUpdateDisplay, pollInterval ? pollInterval : DISPLAY_UPDATE_INTERVAL, 0, true);
+  
+  // Poll and sample tasks for every enabled sensor driver
+  senseTaskId = addSensorDriverTasks(pollInterval);
+  
+  // One-shot helpers the drivers arm themselves
+  if (sensorActive(SENSOR_DHT_TEMP) && TEMP_PROBE == TEMP_PROBE_DHT22) {
+    dht22TaskId = addScheduledTask("dht22", taskDHT22, 0, 0, false);
+  } else if (sensorActive(SENSOR_DHT_TEMP)) {
+    ds18b20TaskId = addScheduledTask("ds18b20", taskCollectTemperatures, 0, 0, false);
+  }
+  if (sensorActive(SENSOR_MQ7_GAS) && MQ7_HEATER_CYCLE) {
+    // Drives the phases and publishes at the end of each valid window
+    mq7HeaterTaskId = addScheduledTask("mq7_heater", taskMQ7Heater, 0, MQ7_HEAT_PHASE_MS, true);
+  }
+  connectionTaskId = addScheduledTask("connections", checkConnections,
+                                      pollInterval ? pollInterval : CONNECTION_CHECK_INTERVAL, 0, true);
+  addScheduledTask("mqtt", taskMQTTLoop, pollInterval ? pollInterval : MQTT_LOOP_INTERVAL, 0, true);
+  addScheduledTask("jwt", taskCheckJWTExpiry, JWT_ROTATE_CHECK_INTERVAL, JWT_ROTATE_CHECK_INTERVAL, true);
+  addScheduledTask("ota_check", taskCheckForFirmwareUpdates, OTA_CHECK_INTERVAL, OTA_CHECK_INTERVAL, true);
+  otaStartTaskId = addScheduledTask("ota_start", taskStartPendingOTA, 0, 0, otaPending);
+  otaServiceTaskId = addScheduledTask("ota_service", taskServiceOTA, OTA_SERVICE_INTERVAL, 0, otaInProgress);
+}
+
+// ===== POWER MANAGEMENT =====
+
+void initPowerManagement() {
+  lowPowerActive = LOW_POWER_MODE && !sensorActive(SENSOR_SENSE_CAMERA);
+  if (!lowPowerActive) {
+    return;
   }
   
-  // Check for firmware updates periodically (every 5 minutes)
-  if (!otaInProgress && mqttConnected && millis() - lastOTACheck > OTA_CHECK_INTERVAL) {
-    lastOTACheck = millis();
-    checkForFirmwareUpdates();
+  Serial.println("=== Low Power Mode ===");
+  
+  // Modem sleep: the radio only wakes for DTIM beacons (listen interval
+  // defaults to 3 beacons with WIFI_PS_MAX_MODEM)
+  WiFi.setSleep(WIFI_PS_MAX_MODEM);
+  
+  // Frequency scaling plus automatic light sleep whenever every task is
+  // blocked. Light sleep needs tickless idle in the SDK config; without it we
+  // still get DFS and modem sleep.
+  esp_pm_config_esp32s3_t pmConfig = {};
+  pmConfig.max_freq_mhz = 160;
+  pmConfig.min_freq_mhz = 40;
+  pmConfig.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&pmConfig);
+  if (err == ESP_OK) {
+    lightSleepEnabled = true;
+  } else {
+    pmConfig.light_sleep_enable = false;
+    err = esp_pm_configure(&pmConfig);
+    Serial.print("Automatic light sleep unavailable, using DFS only: ");
+    Serial.println(err == ESP_OK ? "ok" : esp_err_to_name(err));
   }
   
-  delay(100);
+  // The doorway beams arm their own GPIO wakeup in initSenseBeams(), which
+  // runs later and owns the pins' interrupt type
+  
+  Serial.print("Modem sleep on, light sleep ");
+  Serial.println(lightSleepEnabled ? "on" : "off");
 }
 
 void connectToWiFi() {
@@ -664,91 +1231,162 @@ void connectToWiFi() {
   
   setLEDStatus(LED_WIFI_CONNECTING);
   
+  // Non-blocking: association, DHCP and reconnects are reported through
+  // onWiFiEvent and handled by checkConnections(). The core's auto-reconnect
+  // stays off: it would race our directed/full-scan attempts with a plain
+  // begin() of its own.
+  WiFi.onEvent(onWiFiEvent);
   WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  wifiConnectStartedAt = millis();
+  
+  loadWiFiCache();
+  if (wifiCache.valid) {
+    startWiFiDirectedConnect();
+  } else {
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  }
+}
+
+// Associate straight to the cached BSSID/channel, skipping the scan
+void startWiFiDirectedConnect() {
+  Serial.print("Directed connect to cached BSSID on channel ");
+  Serial.println(wifiCache.channel);
+  if (WIFI_REUSE_DHCP_LEASE) {
+    WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+  }
+  wifiFastConnectActive = true;
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD, wifiCache.channel, wifiCache.bssid);
+}
+
+// Drop the cached association and connect with a full scan + DHCP
+void startWiFiFullScan() {
+  Serial.println("Directed WiFi connect failed - falling back to full scan");
+  wifiFastConnectActive = false;
+  wifiCache.valid = false;
+  WiFi.disconnect();
+  if (WIFI_REUSE_DHCP_LEASE) {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+}
+
+void loadWiFiCache() {
+  Preferences prefs;
+  memset(&wifiCache, 0, sizeof(wifiCache));
+  if (prefs.begin("wifi", true)) {
+    if (prefs.getBytes("cache", &wifiCache, sizeof(wifiCache)) != sizeof(wifiCache)) {
+      memset(&wifiCache, 0, sizeof(wifiCache));
+    }
+    prefs.end();
+  }
+}
+
+// Persist the current association; only writes flash when it changed
+void saveWiFiCache() {
+  WiFiCache current;
+  memset(&current, 0, sizeof(current));
+  current.valid = true;
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+  current.channel = WiFi.channel();
+  current.ip = (uint32_t)WiFi.localIP();
+  current.gateway = (uint32_t)WiFi.gatewayIP();
+  current.subnet = (uint32_t)WiFi.subnetMask();
+  current.dns = (uint32_t)WiFi.dnsIP();
   
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  if (memcmp(&current, &wifiCache, sizeof(current)) == 0) {
+    return;
   }
+  wifiCache = current;
   
-  if (WiFi.status() == WL_CONNECTED) {
-    wifiConnected = true;
-    Serial.println();
-    Serial.print("WiFi connected! IP: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("MAC: ");
-    Serial.println(WiFi.macAddress());
-    Serial.print("Gateway: ");
-    Serial.println(WiFi.gatewayIP());
-    Serial.print("DNS: ");
-    Serial.println(WiFi.dnsIP());
-  } else {
-    wifiConnected = false;
-    Serial.println();
-    Serial.println("WiFi connection failed!");
-    Serial.print("Status: ");
-    Serial.println(WiFi.status());
+  Preferences prefs;
+  if (prefs.begin("wifi", false)) {
+    prefs.putBytes("cache", &wifiCache, sizeof(wifiCache));
+    prefs.end();
+    Serial.println("Saved WiFi association cache to NVS");
+  }
+}
+
+void recordWiFiConnectDuration(unsigned long durationMs) {
+  wifiLastConnectMs = durationMs;
+  int bucket = 0;
+  while (bucket < WIFI_CONNECT_HIST_BUCKETS - 1 && durationMs > WIFI_CONNECT_HIST_BOUNDS[bucket]) {
+    bucket++;
+  }
+  wifiConnectHist[bucket]++;
+  Serial.print("WiFi connected in ");
+  Serial.print(durationMs);
+  Serial.println(wifiLastConnectFast ? " ms (directed)" : " ms (full scan)");
+}
+
+// Runs in the WiFi event task - only set flags here
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      wifiGotIPEvent = true;
+      wakeLoop();
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      // ASSOC_LEAVE is the station leaving on request: the disconnect that
+      // begin() and startWiFiFullScan() issue themselves. Treating it as a
+      // failed attempt would abandon the directed connect it belongs to.
+      if (info.wifi_sta_disconnected.reason == WIFI_REASON_ASSOC_LEAVE) {
+        break;
+      }
+      wifiDisconnectedEvent = true;
+      wakeLoop();
+      break;
+    default:
+      break;
   }
 }
 
 void syncTime() {
   Serial.println("=== Time Synchronization ===");
   
-  // Configure time with NTP
+  // Configure time with NTP; SNTP runs in the background and calls onTimeSync
+  sntp_set_time_sync_notification_cb(onTimeSync);
   configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
   
   Serial.print("Waiting for time sync from ");
   Serial.print(NTP_SERVER);
   Serial.println("...");
-  
-  int attempts = 0;
-  while (!timeSynced && attempts < 20) {
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      timeSynced = true;
-      Serial.println("Time synchronized!");
-      
-      // Print current time
-      Serial.print("Current time: ");
-      Serial.print(timeinfo.tm_year + 1900);
-      Serial.print("-");
-      Serial.print(timeinfo.tm_mon + 1);
-      Serial.print("-");
-      Serial.print(timeinfo.tm_mday);
-      Serial.print(" ");
-      Serial.print(timeinfo.tm_hour);
-      Serial.print(":");
-      Serial.print(timeinfo.tm_min);
-      Serial.print(":");
-      Serial.println(timeinfo.tm_sec);
-      
-      // Print Unix timestamp
-      unsigned long unixTime = getCurrentUnixTime();
-      Serial.print("Unix timestamp: ");
-      Serial.println(unixTime);
-    } else {
-      Serial.print(".");
-      delay(1000);
-      attempts++;
-    }
+}
+
+// Runs in the SNTP task - only set a flag here
+void onTimeSync(struct timeval* tv) {
+  timeSyncEvent = true;
+  wakeLoop();
+}
+
+void printCurrentTime() {
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo, 0)) {
+    return;
   }
+  Serial.print("Current time: ");
+  Serial.print(timeinfo.tm_year + 1900);
+  Serial.print("-");
+  Serial.print(timeinfo.tm_mon + 1);
+  Serial.print("-");
+  Serial.print(timeinfo.tm_mday);
+  Serial.print(" ");
+  Serial.print(timeinfo.tm_hour);
+  Serial.print(":");
+  Serial.print(timeinfo.tm_min);
+  Serial.print(":");
+  Serial.println(timeinfo.tm_sec);
   
-  if (!timeSynced) {
-    Serial.println();
-    Serial.println("Time synchronization failed!");
-    Serial.println("JWT tokens may be invalid due to incorrect timestamps");
-  }
+  // Print Unix timestamp
+  Serial.print("Unix timestamp: ");
+  Serial.println(getCurrentUnixTime());
 }
 
 unsigned long getCurrentUnixTime() {
-  struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
-    return mktime(&timeinfo);
-  }
-  return 0;
+  // time() never blocks, unlike getLocalTime() which waits up to 5 s for SNTP
+  time_t now = time(nullptr);
+  return now > 1600000000 ? (unsigned long)now : 0;
 }
 
 void connectToMQTT() {
@@ -764,7 +1402,7 @@ void connectToMQTT() {
   Serial.print("Username (MAC): ");
   Serial.println(mqttUsername);
   Serial.print("Password (JWT): ");
-  Serial.println(mqttPassword);
+  Serial.println(getJWT());
   
   setLEDStatus(LED_MQTT_CONNECTING);
   mqttConnecting = true;
@@ -773,39 +1411,33 @@ void connectToMQTT() {
   mqttClient.setCallback(mqttCallback);
   
   // Set MQTT connection options for better reliability
-  mqttClient.setKeepAlive(60);    // 60 second keepalive
-  mqttClient.setSocketTimeout(30); // 30 second socket timeout
-  mqttClient.setBufferSize(1024); // Increase buffer size for large JWT tokens
+  mqttClient.setKeepAlive(lowPowerActive ? LOW_POWER_MQTT_KEEPALIVE_SEC : 60); // 60 second keepalive (longer on battery)
+  mqttClient.setSocketTimeout(5); // 5 second socket timeout (bounds the CONNACK wait)
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE); // Large JWT tokens and summary reports
   
-  // Create a unique client ID with version info to avoid conflicts and enable version tracking
-  String clientId = deviceHostname + "_v" + FIRMWARE_VERSION + "_" + String(millis() % 10000);
   Serial.print("Client ID: ");
-  Serial.println(clientId);
+  Serial.println(mqttClientId);
   
-  if (mqttClient.connect(clientId.c_str(), mqttUsername.c_str(), mqttPassword.c_str())) {
+  // Persistent session (cleanSession = false) so the broker keeps our
+  // subscriptions and queues QoS 1 messages while we are away
+  const char* token = getJWT();
+  if (mqttClient.connect(mqttClientId.c_str(), mqttUsername.c_str(), token, 0, 0, false, 0, false)) {
     Serial.println("MQTT connected!");
     mqttConnected = true;
     mqttConnecting = false;
+    mqttSessionExpiresAt = jwtExpiresAt;
+    mqttFailureCount = 0;
+    mqttAuthFailureCount = 0;
+    if (bootMQTTMs == 0) {
+      bootMQTTMs = millis();
+    }
     setLEDStatus(LED_MQTT_CONNECTED);
     
-    // Subscribe to light control topic
-    String lightTopic = deviceHostname + "/light/control";
-    mqttClient.subscribe(lightTopic.c_str());
-    Serial.print("Subscribed to: ");
-    Serial.println(lightTopic);
-    // Subscribe to camera test topic (one-shot capture request)
-    String cameraTestTopic = deviceHostname + "/camera/test";
-    mqttClient.subscribe(cameraTestTopic.c_str());
-    Serial.print("Subscribed to camera test topic: "); Serial.println(cameraTestTopic);
-    
-    // Subscribe to firmware update topic
-    String firmwareUpdateTopic = deviceHostname + "/firmware/update";
-    mqttClient.subscribe(firmwareUpdateTopic.c_str());
-    Serial.print("Subscribed to firmware updates: ");
-    Serial.println(firmwareUpdateTopic);
+    subscribeMQTTTopics();
     
     // Publish device status
     publishStatus("online");
+    flushMQTTOutbox();
   } else {
     Serial.print("MQTT connection failed! State: ");
     Serial.println(mqttClient.state());
@@ -833,12 +1465,159 @@ void connectToMQTT() {
     mqttConnecting = false;
     
     // If authentication failed, regenerate JWT
-    if (mqttClient.state() == 4 || mqttClient.state() == 5) {
+    bool authFailure = mqttClient.state() == 4 || mqttClient.state() == 5;
+    if (authFailure) {
       Serial.println("Authentication failed - regenerating JWT token");
-      mqttPassword = generateJWT();
       Serial.print("New JWT token: ");
-      Serial.println(mqttPassword);
+      Serial.println(generateJWT());
+    }
+    scheduleMQTTReconnect(authFailure);
+  }
+}
+
+// xorshift32 seeded from the MAC: deterministic per device, different
+// across the fleet
+void seedMQTTJitter(const String& macAddress) {
+  mqttJitterState = 2166136261u; // FNV-1a over the MAC
+  for (size_t i = 0; i < macAddress.length(); i++) {
+    mqttJitterState = (mqttJitterState ^ (uint8_t)macAddress[i]) * 16777619u;
+  }
+  if (mqttJitterState == 0) {
+    mqttJitterState = 1;
+  }
+}
+
+uint32_t mqttJitterRandom() {
+  mqttJitterState ^= mqttJitterState << 13;
+  mqttJitterState ^= mqttJitterState >> 17;
+  mqttJitterState ^= mqttJitterState << 5;
+  return mqttJitterState;
+}
+
+// Pick the time of the next MQTT attempt after a failure or lost session
+void scheduleMQTTReconnect(bool authFailure) {
+  unsigned long now = millis();
+  
+  if (authFailure) {
+    mqttAuthFailureCount++;
+    if (mqttAuthFailureCount >= MQTT_AUTH_BREAKER_THRESHOLD) {
+      // Breaker open: one probe after the hold-off, reopened if it fails too
+      mqttLastBackoffMs = MQTT_AUTH_BREAKER_OPEN_MS + mqttJitterRandom() % MQTT_BACKOFF_MAX_MS;
+      mqttNextAttemptAt = now + mqttLastBackoffMs;
+      mqttAuthBreakerTrips++;
+      Serial.print("MQTT auth circuit breaker open after ");
+      Serial.print(mqttAuthFailureCount);
+      Serial.print(" rejections - next attempt in ");
+      Serial.print(mqttLastBackoffMs / 1000);
+      Serial.println(" s");
+      return;
+    }
+  } else {
+    mqttAuthFailureCount = 0;
+  }
+  
+  unsigned long window = MQTT_BACKOFF_MAX_MS;
+  if (mqttFailureCount < 16) {
+    window = min(MQTT_BACKOFF_MAX_MS, MQTT_BACKOFF_BASE_MS << mqttFailureCount);
+  }
+  mqttFailureCount++;
+  mqttLastBackoffMs = mqttJitterRandom() % (window + 1);
+  mqttNextAttemptAt = now + mqttLastBackoffMs;
+  
+  Serial.print("Next MQTT attempt in ");
+  Serial.print(mqttLastBackoffMs);
+  Serial.print(" ms (attempt ");
+  Serial.print(mqttFailureCount + 1);
+  Serial.println(")");
+}
+
+void subscribeMQTTTopics() {
+  // QoS 1 so messages sent during a reconnect are queued by the broker.
+  // Resubscribing is idempotent if the persistent session already has them.
+  // Subscribe to light control topic
+  String lightTopic = deviceHostname + "/light/control";
+  mqttClient.subscribe(lightTopic.c_str(), 1);
+  Serial.print("Subscribed to: ");
+  Serial.println(lightTopic);
+  // Subscribe to camera test topic (one-shot capture request)
+  String cameraTestTopic = deviceHostname + "/camera/test";
+  mqttClient.subscribe(cameraTestTopic.c_str(), 1);
+  Serial.print("Subscribed to camera test topic: "); Serial.println(cameraTestTopic);
+  
+  // Subscribe to firmware update topic
+  String firmwareUpdateTopic = deviceHostname + "/firmware/update";
+  mqttClient.subscribe(firmwareUpdateTopic.c_str(), 1);
+  Serial.print("Subscribed to firmware updates: ");
+  Serial.println(firmwareUpdateTopic);
+  
+  // Subscribe to sensor driver configuration
+  String sensorConfigTopic = deviceHostname + "/config/sensors";
+  mqttClient.subscribe(sensorConfigTopic.c_str(), 1);
+  String attachmentConfigTopic = deviceHostname + "/config/attachment";
+  mqttClient.subscribe(attachmentConfigTopic.c_str(), 1);
+}
+
+// Reconnect near expiry onto a fresh token. PubSubClient holds one socket,
+// so this is break-then-make: disconnect, then one TCP + CONNECT round trip
+// with the pre-built token and stable client ID, skipping the 10 s reconnect
+// backoff. loop() blocks for that gap (the CONNACK wait is bounded by the
+// 5 s socket timeout); mqtt_rotation_gap_ms reports the last one. The
+// persistent session keeps our subscriptions and holds QoS 1 commands
+// meanwhile. If the connect fails, publishes queue in the outbox until the
+// regular reconnect path gets through, oldest dropped beyond
+// MQTT_OUTBOX_SIZE (mqtt_outbox.h).
+void rotateMQTTSession() {
+  const char* token = getJWT();
+  if (jwtExpiresAt <= mqttSessionExpiresAt) {
+    token = generateJWT();
+  }
+  
+  Serial.println("Reconnecting MQTT onto fresh JWT token");
+  unsigned long swapStart = millis();
+  mqttClient.disconnect();
+  bool ok = mqttClient.connect(mqttClientId.c_str(), mqttUsername.c_str(), token, 0, 0, false, 0, false);
+  mqttLastRotationGapMs = millis() - swapStart;
+  
+  Serial.print("MQTT reconnect onto fresh token ");
+  Serial.print(ok ? "completed" : "failed");
+  Serial.print(" in ");
+  Serial.print(mqttLastRotationGapMs);
+  Serial.println(" ms");
+  
+  if (!ok) {
+    // Fall back to the regular reconnect path immediately
+    mqttConnected = false;
+    mqttConnecting = false;
+    mqttConnectNow = true;
+    setLEDStatus(LED_MQTT_CONNECTING);
+    return;
+  }
+  
+  mqttRotationCount++;
+  mqttSessionExpiresAt = jwtExpiresAt;
+  subscribeMQTTTopics();
+  flushMQTTOutbox();
+}
+
+bool mqttPublishOrQueue(const char* topic, const char* payload) {
+  if (mqttClient.connected() && mqttClient.publish(topic, payload)) {
+    return true;
+  }
+  
+  if (mqttOutboxPush(topic, payload)) {
+    Serial.print("MQTT not connected - queued message for ");
+    Serial.println(topic);
+  }
+  return false;
+}
+
+void flushMQTTOutbox() {
+  const MQTTOutboxMessage* msg;
+  while ((msg = mqttOutboxFront()) != NULL && mqttClient.connected()) {
+    if (!mqttClient.publish(msg->topic, msg->payload)) {
+      break;
     }
+    mqttOutboxPop();
   }
 }
 
@@ -974,6 +1753,8 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
           if (r2 != ESP_OK) {
             Serial.print("Failed to restore RGB565 camera mode after test: "); Serial.println(r2);
             cameraAvailable = false;
+          } else {
+            cameraExposureLocked = false; // fresh sensor state: converge and lock again
           }
         } else {
           Serial.print("Failed to init camera in JPEG mode for test: "); Serial.println(r);
@@ -986,6 +1767,16 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
     return; // handled camera test
   }
 
+  // Handle sensor driver configuration
+  if (String(topic) == deviceHostname + "/config/sensors") {
+    handleSensorConfigMessage(message);
+    return;
+  }
+  if (String(topic) == deviceHostname + "/config/attachment") {
+    handleAttachmentConfigMessage(message);
+    return;
+  }
+
   // Handle firmware update messages
   if (String(topic) == firmwareUpdateTopic) {
     Serial.println("Received firmware update message");
@@ -1001,70 +1792,26 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   }
 }
 
-void readAndPublishTemperature() {
-  Serial.println("=== Reading Sensor Data ===");
-  
-  // Read sensor data (DHT or MQ7)
-  SensorReadings reading = readSensor();
-  
-  if (reading.success) {
-    // Create JSON payload with available readings
-    JsonDocument doc;
-    doc["device_id"] = DEVICE_ID;
-    doc["timestamp"] = getCurrentUnixTime();
-    
-    if (SENSOR == SENSOR_DHT_TEMP) {
-      Serial.print("Temperature: ");
-      Serial.print(reading.temperature);
-      Serial.println("°C");
-      Serial.print("Humidity: ");
-      Serial.print(reading.humidity);
-      Serial.println("%");
-      doc["temperature"] = reading.temperature;
-      doc["humidity"] = reading.humidity;
-      doc["unit"] = "celsius";
-    } else if (SENSOR == SENSOR_MQ7_GAS) {
-      Serial.print("Gas Level (ppm): ");
-      Serial.println(reading.gasLevel);
-      doc["sensor_type"] = "MQ7";
-      doc["gas_type"] = "CO";
-      doc["ppm"] = reading.gasLevel;
-      doc["unit"] = "ppm";
-    }
-    
-    String jsonString;
-    serializeJson(doc, jsonString);
-    
-    // Flash white for outgoing message
-    setLEDStatus(LED_MQTT_SENDING);
-    lastMQTTSend = millis();
-    
-    // Publish to MQTT with sensor-specific topic
-    String sensorTopic;
-    if (SENSOR == SENSOR_DHT_TEMP) {
-      sensorTopic = deviceHostname + "/sensors/temperature";
-    } else if (SENSOR == SENSOR_MQ7_GAS) {
-      sensorTopic = deviceHostname + "/sensors/airquality";
-    }
-    
-    mqttClient.publish(sensorTopic.c_str(), jsonString.c_str());
-    Serial.print("Published to: ");
-    Serial.println(sensorTopic);
-  } else {
-    Serial.println("Sensor read error!");
+void readAndPublishSensor(SensorType type) {
+  SensorDriver* driver = findSensorDriver(type);
+  if (driver == NULL || driver->serialize == NULL) {
+    return;
   }
-}
-
-void publishStatus(const char* status) {
+  Serial.print("=== Reading Sensor Data: ");
+  Serial.print(driver->name);
+  Serial.println(" ===");
+  
   JsonDocument doc;
   doc["device_id"] = DEVICE_ID;
-  doc["status"] = status;
   doc["timestamp"] = getCurrentUnixTime();
-  doc["ip_address"] = WiFi.localIP().toString();
-  doc["mac_address"] = WiFi.macAddress();
-  doc["firmware_version"] = FIRMWARE_VERSION;
-  doc["build_timestamp"] = BUILD_TIMESTAMP;
-  doc["free_heap"] = ESP.getFreeHeap();
+  if (!driver->serialize(doc)) {
+    Serial.println("Sensor read error!");
+    return;
+  }
+  if (!reportDue(driver - sensorDrivers, doc)) {
+    Serial.println("Within deadband, not publishing");
+    return;
+  }
   
   String jsonString;
   serializeJson(doc, jsonString);
@@ -1073,55 +1820,216 @@ void publishStatus(const char* status) {
   setLEDStatus(LED_MQTT_SENDING);
   lastMQTTSend = millis();
   
-  String statusTopic = deviceHostname + "/status";
-  mqttClient.publish(statusTopic.c_str(), jsonString.c_str());
-  Serial.print("Status published: ");
-  Serial.println(status);
+  // Publish to MQTT with sensor-specific topic
+  String sensorTopic = deviceHostname + "/sensors/" + driver->topic;
+  if (mqttPublishOrQueue(sensorTopic.c_str(), jsonString.c_str())) {
+    // Deadbands and the heartbeat count from what the backend actually got
+    reportPublished(driver - sensorDrivers, doc);
+    Serial.print("Published to: ");
+    Serial.println(sensorTopic);
+  }
+  
+  // A suppressed report keeps its window, so the next one covers both; a
+  // queued one carries it
+  if (driver->published != NULL) {
+    driver->published();
+  }
 }
 
-String generateJWT() {
-  Serial.println("=== Generating JWT ===");
-  
-  if (!timeSynced) {
-    Serial.println("WARNING: Time not synchronized - JWT may be invalid!");
+bool serializeTemperature(JsonDocument& doc) {
+  SensorReadings reading = readSensor(SENSOR_DHT_TEMP);
+  if (!reading.success) {
+    return false;
+  }
+  Serial.print("Temperature: ");
+  Serial.print(reading.temperature);
+  Serial.println("°C");
+  Serial.print("Humidity: ");
+  Serial.print(reading.humidity);
+  Serial.println("%");
+  doc["temperature"] = reading.temperature;
+  doc["humidity"] = reading.humidity;
+  doc["unit"] = "celsius";
+  if (tempWindow.count > 0) {
+    // Every read since the last report, not just this one
+    serializeWindowStats(doc, "temperature", tempWindow);
+    if (humidityWindow.count > 0) {
+      serializeWindowStats(doc, "humidity", humidityWindow);
+    }
+    doc["samples"] = tempWindow.count;
+  }
+  if (ds18b20Count > 1) {
+    JsonArray probes = doc["sensors"].to<JsonArray>();
+    for (int i = 0; i < ds18b20Count; i++) {
+      if (ds18b20Temps[i] == DEVICE_DISCONNECTED_C) {
+        continue;
+      }
+      char rom[17];
+      for (int b = 0; b < 8; b++) {
+        sprintf(rom + b * 2, "%02X", ds18b20Addresses[i][b]);
+      }
+      JsonObject probe = probes.add<JsonObject>();
+      probe["rom"] = rom;
+      probe["temperature"] = ds18b20Temps[i];
+    }
+  }
+  return true;
+}
+
+bool serializeGas(JsonDocument& doc) {
+  SensorReadings reading = readSensor(SENSOR_MQ7_GAS);
+  if (!reading.success) {
+    return false;
+  }
+  Serial.print("Gas Level (ppm): ");
+  Serial.println(reading.gasLevel);
+  doc["sensor_type"] = "MQ7";
+  doc["gas_type"] = "CO";
+  doc["ppm"] = reading.gasLevel;
+  doc["unit"] = "ppm";
+  doc["level"] = gasLevelName(reading.gasCategoryLevel);
+  doc["r0_kohm"] = mq7R0;
+  doc["r0_source"] = mq7R0FromNVS ? "auto" : "default";
+  if (gasWindow.count > 0) {
+    // Filtered stream since the last report, so spikes between reports show up
+    serializeWindowStats(doc, "ppm", gasWindow);
+    doc["samples"] = gasWindow.count;
+  }
+  return true;
+}
+
+void resetTemperatureWindow() {
+  windowStatsReset(tempWindow);
+  windowStatsReset(humidityWindow);
+}
+
+void resetGasWindow() {
+  windowStatsReset(gasWindow);
+}
+
+void publishStatus(const char* status) {
+  JsonDocument doc;
+  doc["device_id"] = DEVICE_ID;
+  doc["status"] = status;
+  doc["timestamp"] = getCurrentUnixTime();
+  doc["ip_address"] = WiFi.localIP().toString();
+  doc["mac_address"] = WiFi.macAddress();
+  doc["firmware_version"] = FIRMWARE_VERSION;
+  doc["build_timestamp"] = BUILD_TIMESTAMP;
+  doc["free_heap"] = ESP.getFreeHeap();
+  doc["max_loop_stall_ms"] = loopMaxStallMs;
+  JsonObject sched = doc["scheduler"].to<JsonObject>();
+  sched["late_max_ms"] = schedLateMaxMs;
+  sched["late_avg_ms"] = schedRunCount ? (float)schedLateTotalMs / schedRunCount : 0.0;
+  sched["idle_pct"] = millis() ? 100.0 * schedSleepTotalMs / millis() : 0.0;
+  sched["stall_max_ms"] = schedStallMaxUs / 1000.0;
+  sched["stall_task"] = schedStallTask;
+  doc["attachment"] = ATTACHMENT_NAMES[attachmentType];
+  JsonArray drivers = doc["sensors"].to<JsonArray>();
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    if (!sensorActive(sensorDrivers[i].type)) {
+      continue;
+    }
+    SensorDriverStats& stats = sensorDriverStats[i];
+    JsonObject driver = drivers.add<JsonObject>();
+    driver["name"] = sensorDrivers[i].name;
+    driver["runs"] = stats.runs;
+    driver["late_max_ms"] = stats.lateMaxMs;
+    driver["run_max_ms"] = stats.runMaxUs / 1000.0;
+    driver["run_avg_us"] = stats.runs ? stats.runTotalUs / stats.runs : 0;
+  }
+  if (sensorActive(SENSOR_DHT_TEMP) && TEMP_PROBE == TEMP_PROBE_DHT22) {
+    doc["dht22_errors"] = dht22Errors;
   }
   
-  ArduinoJWT jwt(JWT_SECRET);
-  
-  // Get current Unix timestamp
-  unsigned long currentTime = getCurrentUnixTime();
-  unsigned long expirationTime = currentTime + 3600; // 1 hour from now
-  
-  Serial.print("Current Unix time: ");
-  Serial.println(currentTime);
-  Serial.print("Expiration time: ");
-  Serial.println(expirationTime);
+  // Duty cycle since the last status report (loop() awake vs blocked) and
+  // the current draw it implies
+  unsigned long nowMs = millis();
+  unsigned long windowMs = nowMs - powerLastReportAt;
+  unsigned long sleptMs = schedSleepTotalMs - powerLastSleepMs;
+  float duty = windowMs ? 1.0 - (float)min(sleptMs, windowMs) / windowMs : 1.0;
+  float sleepCurrent = lightSleepEnabled ? CURRENT_LIGHT_SLEEP_MA :
+                       lowPowerActive ? CURRENT_MODEM_SLEEP_MA : CURRENT_AWAKE_MA;
+  powerLastReportAt = nowMs;
+  powerLastSleepMs = schedSleepTotalMs;
+  JsonObject power = doc["power"].to<JsonObject>();
+  power["low_power"] = lowPowerActive;
+  power["light_sleep"] = lightSleepEnabled;
+  power["duty_cycle_pct"] = duty * 100.0;
+  power["est_current_ma"] = duty * CURRENT_AWAKE_MA + (1.0 - duty) * sleepCurrent;
+  doc["jwt_generated"] = jwtGeneratedCount;
+  doc["jwt_cache_hits"] = jwtCacheHits;
+  doc["jwt_generate_us"] = jwtLastGenerateMicros;
+  doc["mqtt_rotations"] = mqttRotationCount;
+  doc["mqtt_rotation_gap_ms"] = mqttLastRotationGapMs;
+  doc["mqtt_outbox_dropped"] = mqttOutboxDropped;
+  doc["reports_published"] = reportsPublished;
+  doc["reports_suppressed"] = reportsSuppressed;
   
-  // Create JSON payload as String
-  JsonDocument payload;
-  payload["iss"] = "esp32-sensor";  // Fixed: Changed from "esp32-device" to match EMQX config
-  payload["sub"] = deviceHostname; // Use device hostname as subject
-  payload["aud"] = "emqx";
-  payload["exp"] = expirationTime;
-  payload["iat"] = currentTime;
-  payload["device_id"] = DEVICE_ID;
-  payload["mac_address"] = WiFi.macAddress();
-  payload["firmware_version"] = FIRMWARE_VERSION;
-  payload["build_timestamp"] = BUILD_TIMESTAMP;
+  if (sensorActive(SENSOR_SENSE)) {
+    doc["sense_edges_dropped"] = senseEdgeDropped;
+    doc["sense_rejected"] = senseRejectedCount;
+    if (lightSleepEnabled) {
+      doc["sense_wakeup_armed"] = senseWakeupArmed();
+    }
+  }
+  if (sensorActive(SENSOR_SENSE_CAMERA) && cameraAvailable) {
+    doc["camera_frames"] = cameraFramesSeen;
+    doc["camera_gated_fraction"] = cameraFramesSeen ? (float)cameraFramesGated / cameraFramesSeen : 0.0;
+    doc["camera_frame_bytes"] = cameraFrameBytes;
+    doc["camera_capture_fps"] = cameraCaptureFps;
+    doc["camera_exposure_locked"] = cameraExposureLocked;
+    doc["camera_frames_suppressed"] = cameraFramesSuppressed;
+    doc["camera_uploads_avoided"] = cameraUploadsAvoided;
+    if (cameraLastUploadBytes) {
+      // Only once a JPEG upload has been measured on this boot
+      doc["camera_upload_bytes_saved"] = cameraUploadsAvoided * cameraLastUploadBytes;
+    }
+    doc["camera_thumbnails"] = cameraThumbnailsPublished;
+    doc["camera_thumbnail_bytes"] = cameraThumbnailBytes;
+    doc["camera_thumbnail_encode_us"] = cameraThumbnailEncodeUs;
+  }
+  if (sensorActive(SENSOR_MQ7_GAS) && mq7ContinuousActive) {
+    JsonObject gas = doc["gas_sampling"].to<JsonObject>();
+    gas["samples"] = gasRawSamples;
+    gas["dma_overruns"] = gasDmaOverruns;
+    gas["filter_us_per_sample"] = gasRawSamples ? (float)gasFilterMicros / gasRawSamples : 0.0;
+  }
+  doc["mqtt_backoff_ms"] = mqttLastBackoffMs;
+  doc["mqtt_auth_breaker_trips"] = mqttAuthBreakerTrips;
+  doc["wifi_connect_ms"] = wifiLastConnectMs;
+  doc["wifi_connect_directed"] = wifiLastConnectFast;
+  JsonArray wifiHist = doc["wifi_connect_hist"].to<JsonArray>();
+  for (int i = 0; i < WIFI_CONNECT_HIST_BUCKETS; i++) {
+    wifiHist.add(wifiConnectHist[i]);
+  }
   
-  String payloadString;
-  serializeJson(payload, payloadString);
+  // Boot latency per release: time from boot to each connection milestone
+  if (bootFirstPublishMs == 0) {
+    bootFirstPublishMs = millis();
+  }
+  JsonObject boot = doc["boot_timing_ms"].to<JsonObject>();
+  boot["wifi"] = bootWiFiMs;
+  boot["time_sync"] = bootTimeSyncMs;
+  boot["mqtt"] = bootMQTTMs;
+  boot["first_publish"] = bootFirstPublishMs;
   
-  Serial.print("JWT Payload: ");
-  Serial.println(payloadString);
+  String jsonString;
+  serializeJson(doc, jsonString);
   
-  String jwtToken = jwt.encodeJWT(payloadString);
-  Serial.print("JWT generated: ");
-  Serial.println(jwtToken);
+  // Flash white for outgoing message
+  setLEDStatus(LED_MQTT_SENDING);
+  lastMQTTSend = millis();
   
-  return jwtToken;
+  String statusTopic = deviceHostname + "/status";
+  mqttClient.publish(statusTopic.c_str(), jsonString.c_str());
+  Serial.print("Status published: ");
+  Serial.println(status);
 }
 
+// HS256 signing, token cache: jwt_token.h
+#include "jwt_token.h"
+
 void setLEDStatus(LEDStatus status) {
   if (currentLEDStatus != status) {
     currentLEDStatus = status;
@@ -1206,26 +2114,106 @@ void updateLEDStatus() {
 }
 
 void checkConnections() {
-  // Check WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
+  // Consume WiFi/SNTP events raised by the callbacks
+  if (wifiDisconnectedEvent) {
+    wifiDisconnectedEvent = false;
     if (wifiConnected) {
       Serial.println("WiFi connection lost!");
       wifiConnected = false;
       mqttConnected = false;
       mqttConnecting = false;
       setLEDStatus(LED_WIFI_CONNECTING);
+      
+      // Reconnect ourselves (auto-reconnect is off): directed to the cached
+      // AP when there is one, so wifiLastConnectFast reflects what happened
+      wifiConnectStartedAt = millis();
+      if (wifiCache.valid) {
+        startWiFiDirectedConnect();
+      } else {
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+      }
+    } else if (wifiFastConnectActive) {
+      // Cached AP not found / rejected: scan for it instead
+      startWiFiFullScan();
+    } else {
+      // Full-scan attempt failed (AP down, out of range): try again
+      WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
     }
-    return; // Don't try MQTT if WiFi is down
-  } else if (!wifiConnected) {
-    Serial.println("WiFi reconnected!");
+  }
+  
+  if (wifiFastConnectActive && !wifiConnected && !wifiGotIPEvent &&
+      millis() - wifiConnectStartedAt > WIFI_FAST_CONNECT_TIMEOUT_MS) {
+    startWiFiFullScan();
+  }
+  
+  if (wifiGotIPEvent) {
+    wifiGotIPEvent = false;
     wifiConnected = true;
+    wifiConnectedAt = millis();
+    wifiLastConnectFast = wifiFastConnectActive;
+    wifiFastConnectActive = false;
+    recordWiFiConnectDuration(wifiConnectedAt - wifiConnectStartedAt);
+    saveWiFiCache();
+    bool firstConnect = bootWiFiMs == 0;
+    if (firstConnect) {
+      bootWiFiMs = wifiConnectedAt;
+    }
+    Serial.print("WiFi connected! IP: ");
+    Serial.println(WiFi.localIP());
+    Serial.print("MAC: ");
+    Serial.println(WiFi.macAddress());
+    Serial.print("Gateway: ");
+    Serial.println(WiFi.gatewayIP());
+    Serial.print("DNS: ");
+    Serial.println(WiFi.dnsIP());
+    
+    // At boot, connect MQTT the moment we have an address (and a valid
+    // clock). After an AP flap every node on that AP gets its address back
+    // at once, so the first attempt is jittered like any lost session.
+    if (firstConnect) {
+      mqttConnectNow = true;
+    } else if (!mqttConnected) {
+      mqttConnectNow = false;
+      mqttFailureCount = 0;
+      scheduleMQTTReconnect(false);
+    }
+    if (!mqttConnected) {
+      setLEDStatus(LED_MQTT_CONNECTING);
+    }
+  }
+  
+  if (timeSyncEvent) {
+    timeSyncEvent = false;
+    if (!timeSynced) {
+      timeSynced = true;
+      bootTimeSyncMs = millis();
+      Serial.println("Time synchronized!");
+      printCurrentTime();
+      
+      // The boot-time token was minted without a valid clock
+      generateJWT();
+      mqttConnectNow = true;
+    }
   }
   
-  // Check MQTT connection
-  if (!mqttConnected && !mqttConnecting && wifiConnected) {
+  if (!wifiConnected) {
+    return; // Don't try MQTT if WiFi is down
+  }
+  
+  // Check MQTT connection. JWTs need a synced clock, so hold off until NTP
+  // answers unless it is taking unreasonably long.
+  if (!mqttConnected && !mqttConnecting) {
     unsigned long now = millis();
-    if (now - lastMQTTAttempt > 10000) { // Try every 10 seconds (increased from 5)
-      lastMQTTAttempt = now;
+    bool clockReady = timeSynced || now - wifiConnectedAt > MQTT_TIME_SYNC_WAIT_MS;
+    // mqttConnectNow only cuts a plain backoff short; an open auth breaker holds
+    bool breakerOpen = mqttAuthFailureCount >= MQTT_AUTH_BREAKER_THRESHOLD;
+    bool due = (long)(now - mqttNextAttemptAt) >= 0;
+    if (clockReady && (due || (mqttConnectNow && !breakerOpen))) {
+      if (!timeSynced) {
+        Serial.println("Time synchronization failed!");
+        Serial.println("JWT tokens may be invalid due to incorrect timestamps");
+      }
+      mqttConnectNow = false;
       connectToMQTT();
     }
   }
@@ -1237,10 +2225,11 @@ void checkConnections() {
     Serial.println(mqttClient.state());
     mqttConnected = false;
     mqttConnecting = false;
+    // A dropped session usually means the broker went away for everyone:
+    // even the first retry is jittered
+    mqttFailureCount = 0;
+    scheduleMQTTReconnect(false);
     setLEDStatus(LED_MQTT_CONNECTING);
-    
-    // Add a small delay before reconnecting
-    delay(1000);
   }
 }
 
@@ -1272,6 +2261,14 @@ void handleFirmwareUpdateMessage(JsonDocument& updateMsg) {
     return;
   }
   
+  // Staged rollouts spread the fleet's downloads using a per-device start delay
+  unsigned long startDelayMs = updateMsg["start_delay_ms"] | 0UL;
+  otaBusyRetries = 0;
+  if (startDelayMs > 0) {
+    scheduleOTAUpdate(firmwareUrl, newVersion, signature, startDelayMs);
+    return;
+  }
+  
   Serial.println("Starting OTA update process...");
   publishOTAStatus(OTA_CHECKING, "Update available, starting download");
   
@@ -1279,6 +2276,20 @@ void handleFirmwareUpdateMessage(JsonDocument& updateMsg) {
   performOTAUpdate(firmwareUrl, newVersion, signature);
 }
 
+void scheduleOTAUpdate(const String& firmwareUrl, const String& version, const String& signature,
+                       unsigned long delayMs) {
+  otaPending = true;
+  armScheduledTask(otaStartTaskId, delayMs);
+  otaPendingUrl = firmwareUrl;
+  otaPendingVersion = version;
+  otaPendingSignature = signature;
+  
+  Serial.print("OTA update scheduled in ");
+  Serial.print(delayMs / 1000);
+  Serial.println(" s");
+  publishOTAStatus(OTA_CHECKING, "Update scheduled in " + String(delayMs / 1000) + " s");
+}
+
 bool isNewerVersion(const String& newVersion, const String& currentVersion) {
   // Simple semantic version comparison (e.g., "1.2.1" vs "1.2.0")
   // Split versions by dots and compare each part
@@ -1305,8 +2316,18 @@ bool isNewerVersion(const String& newVersion, const String& currentVersion) {
 }
 
 void performOTAUpdate(const String& firmwareUrl, const String& version, const String& signature) {
+  // Only set up the session here; serviceOTAUpdate() advances it from loop()
+  // in bounded slices so MQTT, sensing and the LEDs keep running
   otaInProgress = true;
   currentOTAStatus = OTA_DOWNLOADING;
+  otaActiveUrl = firmwareUrl;
+  otaActiveVersion = version;
+  otaActiveSignature = signature;
+  otaHttpOpen = false;
+  otaContentLength = 0;
+  otaWritten = 0;
+  otaProgress = 0.0;
+  otaRetryAfterMs = 0;
   
   Serial.println("=== Starting OTA Update ===");
   Serial.print("Downloading from: ");
@@ -1314,80 +2335,146 @@ void performOTAUpdate(const String& firmwareUrl, const String& version, const St
   
   publishOTAStatus(OTA_DOWNLOADING, "Downloading firmware...");
   setLEDStatus(LED_OTA_DOWNLOADING);
-  
-  size_t downloadedSize = 0;
-  if (!downloadFirmware(firmwareUrl, downloadedSize)) {
-    Serial.println("Firmware download failed");
-    publishOTAStatus(OTA_FAILED, "Download failed");
-    otaInProgress = false;
-    currentOTAStatus = OTA_IDLE;
+  armScheduledTask(otaServiceTaskId, 0);
+}
+
+void serviceOTAUpdate() {
+  if (!otaInProgress) {
     return;
   }
   
-  Serial.println("Firmware downloaded successfully");
-  publishOTAStatus(OTA_VALIDATING, "Validating firmware signature...");
-  setLEDStatus(LED_OTA_VALIDATING);
-  
-  // Validate firmware signature
-  if (!validateFirmwareSignature(signature, downloadedSize)) {
-    Serial.println("Firmware signature validation failed!");
-    publishOTAStatus(OTA_FAILED, "Signature validation failed");
+  switch (currentOTAStatus) {
+    case OTA_DOWNLOADING: {
+      if (!otaHttpOpen && !openFirmwareDownload()) {
+        // Server at its download cap: back off for Retry-After plus jitter
+        if (otaRetryAfterMs > 0 && otaBusyRetries < OTA_MAX_BUSY_RETRIES) {
+          otaBusyRetries++;
+          otaInProgress = false;
+          currentOTAStatus = OTA_IDLE;
+          Serial.println("Firmware server busy, retrying later");
+          setLEDStatus(mqttConnected ? LED_MQTT_CONNECTED : LED_MQTT_CONNECTING);
+          scheduleOTAUpdate(otaActiveUrl, otaActiveVersion, otaActiveSignature,
+                            otaRetryAfterMs + esp_random() % otaRetryAfterMs);
+          return;
+        }
+        abortOTAUpdate("Download failed");
+        return;
+      }
+      
+      int result = readFirmwareSlice();
+      if (result < 0) {
+        abortOTAUpdate("Download failed");
+        return;
+      }
+      if (result == 0) {
+        return; // More data to come
+      }
+      
+      Serial.println("Firmware downloaded successfully");
+      currentOTAStatus = OTA_VALIDATING;
+      publishOTAStatus(OTA_VALIDATING, "Validating firmware signature...");
+      setLEDStatus(LED_OTA_VALIDATING);
+      break;
+    }
+    
+    case OTA_VALIDATING:
+      // Validate firmware signature (bounded by OTA_VERIFY_BUDGET_MS)
+      if (!validateFirmwareSignature(otaActiveSignature, otaWritten)) {
+        Serial.println("Firmware signature validation failed!");
+        abortOTAUpdate("Signature validation failed");
+        return;
+      }
+      
+      Serial.println("Firmware signature validated successfully");
+      currentOTAStatus = OTA_INSTALLING;
+      publishOTAStatus(OTA_INSTALLING, "Signature verified in " + String(otaLastVerifyMs) + " ms, installing firmware...");
+      setLEDStatus(LED_OTA_INSTALLING);
+      break;
+    
+    case OTA_INSTALLING:
+      // Finalize the update
+      if (Update.end(true)) {
+        Serial.println("OTA Update successful! Rebooting...");
+        currentOTAStatus = OTA_SUCCESS;
+        publishOTAStatus(OTA_SUCCESS, "Update successful, rebooting...");
+        delay(1000);
+        ESP.restart();
+      } else {
+        Serial.print("OTA Update failed: ");
+        Serial.println(Update.errorString());
+        abortOTAUpdate("Installation failed: " + String(Update.errorString()));
+      }
+      break;
+    
+    default:
+      break;
+  }
+}
+
+void abortOTAUpdate(const String& reason) {
+  if (otaHttpOpen) {
+    otaHttp.end();
+    mbedtls_sha256_free(&otaSha256Ctx);
+    otaHttpOpen = false;
+  }
+  if (Update.isRunning()) {
     Update.abort();
-    otaInProgress = false;
-    currentOTAStatus = OTA_IDLE;
-    return;
   }
   
-  Serial.println("Firmware signature validated successfully");
-  publishOTAStatus(OTA_INSTALLING, "Installing firmware...");
-  setLEDStatus(LED_OTA_INSTALLING);
-  
-  // Finalize the update
-  if (Update.end(true)) {
-    Serial.println("OTA Update successful! Rebooting...");
-    publishOTAStatus(OTA_SUCCESS, "Update successful, rebooting...");
-    delay(1000);
-    ESP.restart();
-  } else {
-    Serial.print("OTA Update failed: ");
-    Serial.println(Update.errorString());
-    publishOTAStatus(OTA_FAILED, "Installation failed: " + String(Update.errorString()));
-    otaInProgress = false;
-    currentOTAStatus = OTA_IDLE;
-  }
+  Serial.print("OTA aborted: ");
+  Serial.println(reason);
+  publishOTAStatus(OTA_FAILED, reason);
+  otaInProgress = false;
+  currentOTAStatus = OTA_IDLE;
+  setLEDStatus(mqttConnected ? LED_MQTT_CONNECTED : LED_MQTT_CONNECTING);
 }
 
-bool downloadFirmware(const String& url, size_t& downloadedSize) {
-  HTTPClient http;
-  WiFiClientSecure client;
+bool openFirmwareDownload() {
+  const String& url = otaActiveUrl;
   
   // For HTTPS, configure client
   if (url.startsWith("https://")) {
-    client.setInsecure(); // For now, skip certificate validation (configure proper CA in production)
-    http.begin(client, url);
+    otaSecureClient.setInsecure(); // For now, skip certificate validation (configure proper CA in production)
+    otaSecureClient.setHandshakeTimeout(OTA_CONNECT_TIMEOUT_MS / 1000); // seconds, default 120
+    otaHttp.begin(otaSecureClient, url);
   } else {
-    http.begin(url);
+    otaHttp.begin(url);
   }
   
-  // Set timeout
-  http.setTimeout(30000); // 30 seconds
+  // Bound the blocking part of GET(); the body is read without blocking by
+  // readFirmwareSlice() and has its own OTA_STALL_TIMEOUT_MS
+  otaHttp.setConnectTimeout(OTA_CONNECT_TIMEOUT_MS);
+  otaHttp.setTimeout(OTA_CONNECT_TIMEOUT_MS); // waiting for the response headers
   
-  int httpCode = http.GET();
+  const char* headerKeys[] = {"Retry-After"};
+  otaHttp.collectHeaders(headerKeys, 1);
+  
+  int httpCode = otaHttp.GET();
+  
+  if (httpCode == HTTP_CODE_SERVICE_UNAVAILABLE) {
+    long retryAfterSec = otaHttp.header("Retry-After").toInt();
+    otaRetryAfterMs = retryAfterSec > 0 ? retryAfterSec * 1000UL : OTA_DEFAULT_RETRY_AFTER_MS;
+    Serial.print("Firmware server busy, Retry-After: ");
+    Serial.print(otaRetryAfterMs / 1000);
+    Serial.println(" s");
+    otaHttp.end();
+    return false;
+  }
   
   if (httpCode != HTTP_CODE_OK) {
     Serial.print("HTTP GET failed: ");
     Serial.println(httpCode);
-    http.end();
+    otaHttp.end();
     return false;
   }
   
-  int contentLength = http.getSize();
+  int contentLength = otaHttp.getSize();
   Serial.print("Firmware size: ");
   Serial.println(contentLength);
   
   if (contentLength <= 0) {
     Serial.println("Invalid content length");
-    http.end();
+    otaHttp.end();
     return false;
   }
   
@@ -1395,112 +2482,155 @@ bool downloadFirmware(const String& url, size_t& downloadedSize) {
   if (!Update.begin(contentLength)) {
     Serial.print("OTA begin failed: ");
     Serial.println(Update.errorString());
-    http.end();
+    otaHttp.end();
     return false;
   }
   
-  // Get stream for reading
-  WiFiClient* stream = http.getStreamPtr();
-  size_t written = 0;
-  uint8_t buffer[512];
+  // Hash the image as it streams in so validation doesn't need a second pass
+  // over the update partition
+  mbedtls_sha256_init(&otaSha256Ctx);
+  mbedtls_sha256_starts(&otaSha256Ctx, 0); // 0 = SHA256, not SHA224
+  
+  otaContentLength = contentLength;
+  otaWritten = 0;
+  otaLastDataAt = millis();
+  otaLastProgressPublish = millis();
+  otaHttpOpen = true;
   
   Serial.println("Starting firmware download...");
+  return true;
+}
+
+// Read and flash firmware for at most OTA_SLICE_MS. Returns 1 when the image
+// is complete, 0 when more data is expected and -1 on error.
+int readFirmwareSlice() {
+  WiFiClient* stream = otaHttp.getStreamPtr();
+  uint8_t buffer[512];
+  unsigned long sliceStart = millis();
   
-  while (http.connected() && (written < contentLength)) {
+  while (otaWritten < otaContentLength && millis() - sliceStart < OTA_SLICE_MS) {
     size_t available = stream->available();
-    if (available) {
-      size_t readBytes = stream->readBytes(buffer, min(available, sizeof(buffer)));
-      
-      if (readBytes > 0) {
-        size_t writtenBytes = Update.write(buffer, readBytes);
-        if (writtenBytes != readBytes) {
-          Serial.println("Write error during OTA update");
-          http.end();
-          return false;
-        }
-        written += writtenBytes;
-        
-        // Progress reporting
-        if (written % 10240 == 0) { // Every 10KB
-          int progress = (written * 100) / contentLength;
-          Serial.print("Progress: ");
-          Serial.print(progress);
-          Serial.println("%");
-          
-          // Update attachment progress bar (Neopixel or fallback)
-          attachmentSetProgress((float)progress / 100.0, CRGB::Orange);
-        }
+    if (!available) {
+      if (!otaHttp.connected()) {
+        Serial.println("Connection closed during OTA download");
+        return -1;
       }
+      if (millis() - otaLastDataAt > OTA_STALL_TIMEOUT_MS) {
+        Serial.println("OTA download stalled");
+        return -1;
+      }
+      return 0; // Nothing buffered yet, give the rest of loop() a turn
+    }
+    
+    size_t readBytes = stream->readBytes(buffer, min(available, sizeof(buffer)));
+    if (readBytes == 0) {
+      break;
     }
-    delay(1);
+    
+    size_t writtenBytes = Update.write(buffer, readBytes);
+    if (writtenBytes != readBytes) {
+      Serial.println("Write error during OTA update");
+      return -1;
+    }
+    mbedtls_sha256_update(&otaSha256Ctx, buffer, readBytes);
+    otaWritten += writtenBytes;
+    otaLastDataAt = millis();
+  }
+  
+  otaProgress = (float)otaWritten / (float)otaContentLength;
+  
+  // Progress reporting
+  if (millis() - otaLastProgressPublish > OTA_PROGRESS_PUBLISH_INTERVAL) {
+    otaLastProgressPublish = millis();
+    int progress = (int)(otaProgress * 100);
+    Serial.print("Progress: ");
+    Serial.print(progress);
+    Serial.println("%");
+    publishOTAStatus(OTA_DOWNLOADING, "Progress: " + String(progress) + "%");
+  }
+  
+  if (otaWritten < otaContentLength) {
+    return 0;
   }
   
-  http.end();
-  downloadedSize = written;
+  otaHttp.end();
+  otaHttpOpen = false;
+  mbedtls_sha256_finish(&otaSha256Ctx, otaFirmwareDigest);
+  mbedtls_sha256_free(&otaSha256Ctx);
   
   Serial.print("Download completed: ");
-  Serial.print(written);
+  Serial.print(otaWritten);
   Serial.println(" bytes");
-  
-  return (written == contentLength);
+  return 1;
 }
 
 bool validateFirmwareSignature(const String& signature, size_t firmwareSize) {
-  // For now, implement a simple SHA256 checksum validation
-  // In production, you should implement proper RSA/ECDSA signature verification
+  // Verify an ECDSA P-256 signature (base64, DER encoded) over the SHA-256 of
+  // the downloaded image using OTA_PUBLIC_KEY. Sign with ota_tools/sign_firmware.py.
+  Serial.print("Firmware SHA256: ");
+  Serial.println(digestToHex(otaFirmwareDigest, sizeof(otaFirmwareDigest)));
+  Serial.print("Firmware size: ");
+  Serial.println(firmwareSize);
   
-  Serial.println("Calculating firmware hash...");
-  String calculatedHash = calculateFirmwareSHA256();
+  uint8_t sig[MBEDTLS_ECDSA_MAX_LEN];
+  size_t sigLen = 0;
+  if (mbedtls_base64_decode(sig, sizeof(sig), &sigLen,
+                            (const unsigned char*)signature.c_str(), signature.length()) != 0 ||
+      sigLen == 0) {
+    Serial.println("Signature is not valid base64");
+    return false;
+  }
   
-  Serial.print("Calculated SHA256: ");
-  Serial.println(calculatedHash);
-  Serial.print("Expected signature: ");
-  Serial.println(signature);
+  unsigned long startMicros = micros();
   
-  // Simple hash comparison (in production, verify RSA signature)
-  return (calculatedHash == signature);
-}
-
-String calculateFirmwareSHA256() {
-  // Calculate SHA256 of the downloaded firmware in the OTA partition
-  const esp_partition_t* update_partition = esp_ota_get_next_update_partition(NULL);
-  if (!update_partition) {
-    Serial.println("Could not find update partition");
-    return "";
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  
+  // PEM parsing requires the length to include the NUL terminator
+  int ret = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)OTA_PUBLIC_KEY,
+                                        strlen(OTA_PUBLIC_KEY) + 1);
+  if (ret != 0) {
+    Serial.print("Failed to parse OTA public key: -0x");
+    Serial.println(-ret, HEX);
+    mbedtls_pk_free(&pk);
+    return false;
   }
   
-  mbedtls_sha256_context sha256_ctx;
-  mbedtls_sha256_init(&sha256_ctx);
-  mbedtls_sha256_starts(&sha256_ctx, 0); // 0 = SHA256, not SHA224
+  if (!mbedtls_pk_can_do(&pk, MBEDTLS_PK_ECDSA)) {
+    Serial.println("OTA public key is not an EC key");
+    mbedtls_pk_free(&pk);
+    return false;
+  }
   
-  uint8_t buffer[1024];
-  size_t bytes_read = 0;
-  size_t total_size = Update.size();
+  ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, otaFirmwareDigest, sizeof(otaFirmwareDigest),
+                          sig, sigLen);
+  mbedtls_pk_free(&pk);
   
-  for (size_t offset = 0; offset < total_size; offset += sizeof(buffer)) {
-    size_t bytes_to_read = min(sizeof(buffer), total_size - offset);
-    
-    if (esp_partition_read(update_partition, offset, buffer, bytes_to_read) == ESP_OK) {
-      mbedtls_sha256_update(&sha256_ctx, buffer, bytes_to_read);
-      bytes_read += bytes_to_read;
-    } else {
-      Serial.println("Failed to read partition for hash calculation");
-      mbedtls_sha256_free(&sha256_ctx);
-      return "";
-    }
+  otaLastVerifyMs = (micros() - startMicros) / 1000;
+  Serial.print("Signature verification took ");
+  Serial.print(otaLastVerifyMs);
+  Serial.println(" ms");
+  if (otaLastVerifyMs > OTA_VERIFY_BUDGET_MS) {
+    Serial.print("WARNING: signature verification exceeded budget of ");
+    Serial.print(OTA_VERIFY_BUDGET_MS);
+    Serial.println(" ms");
   }
   
-  uint8_t hash[32];
-  mbedtls_sha256_finish(&sha256_ctx, hash);
-  mbedtls_sha256_free(&sha256_ctx);
+  if (ret != 0) {
+    Serial.print("ECDSA verification failed: -0x");
+    Serial.println(-ret, HEX);
+    return false;
+  }
   
-  // Convert hash to hex string
+  return true;
+}
+
+String digestToHex(const uint8_t* digest, size_t len) {
   String hashString = "";
-  for (int i = 0; i < 32; i++) {
-    if (hash[i] < 16) hashString += "0";
-    hashString += String(hash[i], HEX);
+  for (size_t i = 0; i < len; i++) {
+    if (digest[i] < 16) hashString += "0";
+    hashString += String(digest[i], HEX);
   }
-  
   return hashString;
 }
 
@@ -1524,6 +2654,7 @@ void publishOTAStatus(OTAStatus status, const String& message) {
   doc["ota_status"] = statusText;
   doc["message"] = message;
   doc["free_heap"] = ESP.getFreeHeap();
+  doc["max_loop_stall_ms"] = loopMaxStallMs;
   
   String jsonString;
   serializeJson(doc, jsonString);
@@ -1558,114 +2689,172 @@ void checkForFirmwareUpdates() {
 
 // ===== SENSOR FUNCTIONS =====
 
-// MQ7 Calibration parameters
-const float MQ7_RL = 10.0;        // Load resistance in kOhms
-const float MQ7_RO = 10.0;        // R0 calibration (can be adjusted)
-const float MQ7_VCC = 3.3;        // Supply voltage
-const float MQ7_ADC_MAX = 4095.0; // ESP32 ADC resolution
-
-// MQ7 Gas Response Curve Parameters for CO (ppm)
-// Sensitivity: Rs/R0 = a * (ppm)^b
-const float CO_CURVE_A = 116.6;   // Curve coefficient
-const float CO_CURVE_B = -2.769;  // Curve exponent
-
-// NOTE: To calibrate MQ7 R0 value:
-// 1. Expose sensor to clean air only
-// 2. Measure the ADC value and voltage
-// 3. Calculate Rs using: Rs = RL * (VCC / Vout - 1)
-// 4. In clean air, Rs/R0 should be approximately 0.9-1.0
-// 5. Adjust MQ7_RO until Rs/R0 ≈ 0.9 when in clean air
-// 6. Then use the sensor for measurement
+// NOTE: MQ7_RO (mq7_ppm_table.h) is only the starting point. With MQ7_AUTO_CALIBRATION the
+// device derives R0 from the clean-air Rs peak (see updateMQ7Baseline) and
+// stores it in NVS under "mq7"/"r0". To calibrate by hand instead:
+// 1. Disable MQ7_AUTO_CALIBRATION and expose the sensor to clean air only
+// 2. Note the Rs printed by readSensor() (Rs = RL * (VCC / Vout - 1))
+// 3. Set MQ7_RO so that the curve gives the clean-air background level,
+//    i.e. R0 = Rs / (MQ7_CLEAN_AIR_PPM / CO_CURVE_A)^(1 / CO_CURVE_B)
 
 void initializeSensor() {
-  switch (SENSOR) {
-    case SENSOR_DHT_TEMP:
-      sensors.begin();
-      Serial.println("DHT Temperature/Humidity sensor initialized on pin D0");
-      break;
-      
-    case SENSOR_MQ7_GAS:
-      pinMode(MQ7_ANALOG_PIN, INPUT);
-      pinMode(MQ7_DIGITAL_PIN, INPUT);
-      Serial.println("=== MQ7 Gas Sensor Initialization ===");
-      Serial.print("Analog input pin: ");
-      Serial.println(MQ7_ANALOG_PIN);
-      Serial.print("Digital input pin (threshold): ");
-      Serial.println(MQ7_DIGITAL_PIN);
-      Serial.println("MQ7 Sensor Parameters:");
-      Serial.print("  Load Resistance (RL): ");
-      Serial.print(MQ7_RL);
-      Serial.println(" kΩ");
-      Serial.print("  Calibration R0: ");
-      Serial.print(MQ7_RO);
-      Serial.println(" kΩ");
-      Serial.println("Note: MQ7 requires warm-up time for accurate readings");
-      Serial.println("Sensor will stabilize after 30-60 seconds of operation");
-      break;
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    if (sensorActive(sensorDrivers[i].type)) {
+      sensorDrivers[i].init();
+    }
+  }
+}
 
-    case SENSOR_SENSE: {
-      // Configure two digital inputs for the overhead doorway sense
-      if (SENSE_ACTIVE_LOW) {
-        pinMode(SENSE_A_PIN, INPUT_PULLUP);
-        pinMode(SENSE_B_PIN, INPUT_PULLUP);
-      } else {
-        pinMode(SENSE_A_PIN, INPUT);
-        pinMode(SENSE_B_PIN, INPUT);
-      }
-      senseState = SENSE_IDLE;
-      senseInCount = 0;
-      senseOutCount = 0;
-      Serial.println("=== SENSOR_SENSE (doorway) initialized ===");
-      Serial.print("Sense A pin: "); Serial.println(SENSE_A_PIN);
-      Serial.print("Sense B pin: "); Serial.println(SENSE_B_PIN);
-      Serial.print("Sense active low: "); Serial.println(SENSE_ACTIVE_LOW ? "Yes" : "No");
-      break;
+void initTemperatureProbe() {
+  if (lowPowerActive) {
+    // Every extra read is a wakeup; report point readings
+    findSensorDriver(SENSOR_DHT_TEMP)->samplePeriod = TEMP_READ_INTERVAL;
+  }
+  windowStatsReset(tempWindow);
+  windowStatsReset(humidityWindow);
+  if (TEMP_PROBE == TEMP_PROBE_DHT22) {
+    initDHT22();
+  } else {
+    initTemperatureSensors();
+  }
+}
+
+void initMQ7Sensor() {
+  pinMode(MQ7_ANALOG_PIN, INPUT);
+  pinMode(MQ7_DIGITAL_PIN, INPUT);
+  Serial.println("=== MQ7 Gas Sensor Initialization ===");
+  buildMQ7PpmTable(MQ7_AUTO_CALIBRATION ? loadMQ7R0() : MQ7_RO);
+  if (MQ7_HEATER_CYCLE) {
+    // The heater task publishes at the end of each measurement phase
+    initMQ7Heater();
+    findSensorDriver(SENSOR_MQ7_GAS)->samplePeriod = 0;
+  }
+  // The DMA driver holds a PM lock that blocks light sleep, so battery
+  // nodes sample on demand instead
+  mq7ContinuousActive = !lowPowerActive && initGasADC();
+  if (!mq7ContinuousActive) {
+    findSensorDriver(SENSOR_MQ7_GAS)->pollPeriod = 0;
+  }
+  Serial.print("Sampling: ");
+  Serial.println(mq7ContinuousActive ? "continuous (ADC DMA, 1 kHz)" : "on demand");
+  Serial.print("Analog input pin: ");
+  Serial.println(MQ7_ANALOG_PIN);
+  Serial.print("Digital input pin (threshold): ");
+  Serial.println(MQ7_DIGITAL_PIN);
+  Serial.println("MQ7 Sensor Parameters:");
+  Serial.print("  Load Resistance (RL): ");
+  Serial.print(MQ7_RL);
+  Serial.println(" kΩ");
+  Serial.print("  Calibration R0: ");
+  Serial.print(mq7R0);
+  Serial.println(" kΩ");
+  Serial.println("Note: MQ7 requires warm-up time for accurate readings");
+  Serial.println("Sensor will stabilize after 30-60 seconds of operation");
+}
+
+void initSenseBeams() {
+  // Configure two digital inputs for the overhead doorway sense
+  if (SENSE_ACTIVE_LOW) {
+    pinMode(SENSE_A_PIN, INPUT_PULLUP);
+    pinMode(SENSE_B_PIN, INPUT_PULLUP);
+  } else {
+    pinMode(SENSE_A_PIN, INPUT);
+    pinMode(SENSE_B_PIN, INPUT);
+  }
+  senseInCount = 0;
+  senseOutCount = 0;
+  resetSenseDecoder();
+  if (lowPowerActive) {
+    // Light-sleep GPIO wakeup only works with level interrupts, and a pin has
+    // one interrupt type for both. Each beam gets a level interrupt for the
+    // level it is not at; the ISR flips it on every edge, so it acts like
+    // CHANGE and wakes the chip on a break and on a clear.
+    attachInterrupt(digitalPinToInterrupt(SENSE_A_PIN), onSenseLevelA, ONLOW);
+    attachInterrupt(digitalPinToInterrupt(SENSE_B_PIN), onSenseLevelB, ONLOW);
+    gpio_wakeup_enable((gpio_num_t)SENSE_A_PIN, digitalRead(SENSE_A_PIN) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_wakeup_enable((gpio_num_t)SENSE_B_PIN, digitalRead(SENSE_B_PIN) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+    if (lightSleepEnabled) {
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "sense", &senseAwakePmLock);
+      senseLastTickUs = micros();
+      esp_register_freertos_tick_hook_for_cpu(onSenseTick, xPortGetCoreID());
     }
+    Serial.print("Sense beams wake from light sleep: ");
+    Serial.println(senseWakeupArmed() ? "Yes" : "NO - check GPIO config");
+  } else {
+    attachInterrupt(digitalPinToInterrupt(SENSE_A_PIN), onSenseEdgeA, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(SENSE_B_PIN), onSenseEdgeB, CHANGE);
+  }
+  Serial.println("=== SENSOR_SENSE (doorway) initialized ===");
+  Serial.print("Sense A pin: "); Serial.println(SENSE_A_PIN);
+  Serial.print("Sense B pin: "); Serial.println(SENSE_B_PIN);
+  Serial.print("Sense active low: "); Serial.println(SENSE_ACTIVE_LOW ? "Yes" : "No");
+}
+
+void initSenseCamera() {
+  // Try to initialize camera module (pins may need adjustment)
+  Serial.println("=== SENSOR_SENSE_CAMERA initialization ===");
+  cameraAvailable = initializeCameraModule();
+  if (cameraAvailable) {
+    benchmarkCameraCapture("QQVGA"); // once per boot
     
-    case SENSOR_SENSE_CAMERA: {
-      // Try to initialize camera module (pins may need adjustment)
-      Serial.println("=== SENSOR_SENSE_CAMERA initialization ===");
-      cameraAvailable = initializeCameraModule();
-      if (cameraAvailable) {
-        // Allocate frame buffers for grayscale frames
-        prevFrame = (uint8_t*)malloc(CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
-        currFrame = (uint8_t*)malloc(CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
-        Serial.print("Attempted allocation of camera buffers. prev=");
-        Serial.print((uintptr_t)prevFrame, HEX);
-        Serial.print(" curr=");
-        Serial.println((uintptr_t)currFrame, HEX);
-        if (!prevFrame || !currFrame) {
-          Serial.println("Failed to allocate camera frame buffers - cleaning up");
-          if (prevFrame) { free(prevFrame); prevFrame = NULL; }
-          if (currFrame) { free(currFrame); currFrame = NULL; }
-          // Deinit camera to avoid driver using memory when we can't allocate buffers
-          // esp_camera_deinit() may not be available in all SDK versions — skip if undefined
-          // (no-op)
-          cameraAvailable = false;
-        } else {
-          memset(prevFrame, 0, CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
-          memset(currFrame, 0, CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
-          Serial.println("Camera frame buffers allocated and cleared");
-        }
-      } else {
-        Serial.println("Camera initialization failed — cameraAvailable=false");
-      }
-      break;
+    // Allocate frame buffers for grayscale frames
+    prevFrame = (uint8_t*)malloc(CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
+    currFrame = (uint8_t*)malloc(CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
+    Serial.print("Attempted allocation of camera buffers. prev=");
+    Serial.print((uintptr_t)prevFrame, HEX);
+    Serial.print(" curr=");
+    Serial.println((uintptr_t)currFrame, HEX);
+    if (!prevFrame || !currFrame) {
+      Serial.println("Failed to allocate camera frame buffers - cleaning up");
+      if (prevFrame) { free(prevFrame); prevFrame = NULL; }
+      if (currFrame) { free(currFrame); currFrame = NULL; }
+      // Deinit camera to avoid driver using memory when we can't allocate buffers
+      // esp_camera_deinit() may not be available in all SDK versions — skip if undefined
+      // (no-op)
+      cameraAvailable = false;
+    } else {
+      memset(prevFrame, 0, CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
+      memset(currFrame, 0, CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT);
+      memset(prevGrid, 0, sizeof(prevGrid));
+      prevFrameStale = true;
+      Serial.println("Camera frame buffers allocated and cleared");
+      benchmarkThumbnailEncoder();
     }
+  } else {
+    Serial.println("Camera initialization failed — cameraAvailable=false");
   }
 }
 
-SensorReadings readSensor() {
+SensorReadings readSensor(SensorType type) {
   SensorReadings reading = {0.0, 0.0, 0.0, false};
   
-  switch (SENSOR) {
+  switch (type) {
     case SENSOR_DHT_TEMP: {
-      sensors.requestTemperatures();
-      float temp = sensors.getTempCByIndex(0);
+      if (TEMP_PROBE == TEMP_PROBE_DHT22) {
+        // Last frame decoded by taskDHT22
+        reading.success = dht22ReadingReady;
+        reading.temperature = dht22Temperature;
+        reading.humidity = dht22Humidity;
+        if (!reading.success) {
+          Serial.println("Temperature sensor error!");
+        }
+        break;
+      }
+      
+      // Values collected by taskCollectTemperatures; the first sensor that
+      // answered is the headline temperature
+      float temp = DEVICE_DISCONNECTED_C;
+      for (int i = 0; ds18b20ReadingReady && i < ds18b20Count; i++) {
+        if (ds18b20Temps[i] != DEVICE_DISCONNECTED_C) {
+          temp = ds18b20Temps[i];
+          break;
+        }
+      }
       
       if (temp != DEVICE_DISCONNECTED_C) {
         reading.temperature = temp;
-        reading.humidity = 0.0;  // Placeholder - would need DHT library for actual humidity
+        reading.humidity = 0.0;  // DS18B20 has no humidity
         reading.success = true;
       } else {
         Serial.println("Temperature sensor error!");
@@ -1673,126 +2862,972 @@ SensorReadings readSensor() {
       }
       break;
     }
-    
-    case SENSOR_MQ7_GAS: {
-      // Read MQ7 analog value
-      int rawValue = analogRead(MQ7_ANALOG_PIN);
-      bool digitalThreshold = digitalRead(MQ7_DIGITAL_PIN);
-      
-      // Convert ADC value to voltage
-      float voltage = (rawValue / MQ7_ADC_MAX) * MQ7_VCC;
-      
-      // Calculate Rs (sensor resistance) from voltage divider
-      // Vout = VCC * RL / (RS + RL)
-      // RS = RL * (VCC / Vout - 1)
-      float rs = MQ7_RL * (MQ7_VCC / voltage - 1.0);
-      
-      // Calculate Rs/R0 ratio
-      float ratio = rs / MQ7_RO;
-      
-      // Convert ratio to ppm using MQ7 response curve
-      // ppm = (Rs/R0 / a) ^ (1/b)
-      float ppm = 0.0;
-      if (ratio > 0) {
-        ppm = CO_CURVE_A * pow(ratio, CO_CURVE_B);
-        if (ppm < 0) ppm = 0;  // Ensure non-negative
+    
+    case SENSOR_MQ7_GAS: {
+      if (!mq7ReadingValid()) {
+        Serial.println("MQ7 - heater not in the measurement window, skipping reading");
+        break;
+      }
+      
+      // Continuous mode: report the filtered stream. Otherwise take a short
+      // burst through the median so one noisy sample can't skew the report.
+      int rawValue;
+      if (mq7ContinuousActive) {
+        if (!gasFilter.primed) {
+          Serial.println("MQ7 - filter not settled yet, skipping reading");
+          break;
+        }
+        rawValue = gasFilteredCode; // analogRead() can't share ADC1 with the DMA driver
+      } else {
+        uint16_t burst[MQ7_MEDIAN_TAPS];
+        for (int i = 0; i < MQ7_MEDIAN_TAPS; i++) {
+          burst[i] = analogRead(MQ7_ANALOG_PIN);
+          for (int j = i; j > 0 && burst[j] < burst[j - 1]; j--) {
+            uint16_t t = burst[j]; burst[j] = burst[j - 1]; burst[j - 1] = t;
+          }
+        }
+        rawValue = burst[MQ7_MEDIAN_TAPS / 2];
+      }
+      bool digitalThreshold = digitalRead(MQ7_DIGITAL_PIN);
+      
+      // Convert ADC value to voltage
+      float voltage = (rawValue / MQ7_ADC_MAX) * MQ7_VCC;
+      
+      // Calculate Rs (sensor resistance) from voltage divider
+      // Vout = VCC * RL / (RS + RL)
+      // RS = RL * (VCC / Vout - 1)
+      float rs = MQ7_RL * (MQ7_VCC / voltage - 1.0);
+      
+      // Calculate Rs/R0 ratio
+      float ratio = rs / mq7R0;
+      
+      // Convert to ppm using the MQ7 response curve, precomputed per ADC code
+      float ppm = mq7CodeToPpm(rawValue);
+      
+      reading.gasLevel = ppm;
+      reading.digitalThreshold = digitalThreshold;
+      reading.success = true;
+      
+      if (MQ7_AUTO_CALIBRATION && rawValue >= MQ7_BASELINE_MIN_ADC_CODE) {
+        updateMQ7Baseline(rs);
+      }
+      
+      // Categorize gas level based on ppm thresholds
+      reading.gasCategoryLevel = applyGasHysteresis(currentGasLevel, ppm);
+      
+      // Update global gas level for LED status
+      currentGasLevel = reading.gasCategoryLevel;
+      
+      // Debug output
+      Serial.print("MQ7 - ADC Raw: ");
+      Serial.print(rawValue);
+      Serial.print(" | Voltage: ");
+      Serial.print(voltage, 2);
+      Serial.print("V | Rs: ");
+      Serial.print(rs, 1);
+      Serial.print("kΩ | Ratio: ");
+      Serial.print(ratio, 3);
+      Serial.print(" | CO Level: ");
+      Serial.print(ppm, 1);
+      Serial.print(" ppm (");
+      Serial.print(gasLevelName(reading.gasCategoryLevel));
+      Serial.print(") | Digital Threshold: ");
+      Serial.println(digitalThreshold ? "HIGH" : "LOW");
+      break;
+    }
+  }
+  
+  return reading;
+}
+
+void publishSensorData() {
+  // Publish a reading from every enabled driver that has one
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    if (sensorActive(sensorDrivers[i].type) && sensorDrivers[i].serialize != NULL) {
+      readAndPublishSensor(sensorDrivers[i].type);
+    }
+  }
+}
+
+// Sample tasks: results are published once the probe has answered
+// (taskCollectTemperatures / taskDHT22)
+void sampleTemperatureProbe() {
+  // Every TEMP_READ_INTERVAL worth of samples, the next good read publishes
+  // the window
+  unsigned long period = findSensorDriver(SENSOR_DHT_TEMP)->samplePeriod;
+  if (++tempSampleRuns >= (int)max(1UL, TEMP_READ_INTERVAL / period)) {
+    tempSampleRuns = 0;
+    tempReportPending = true;
+  }
+  if (TEMP_PROBE == TEMP_PROBE_DHT22) {
+    startDHT22Read();
+  } else {
+    startTemperatureConversion();
+  }
+}
+
+void sampleGas() {
+  if (mqttConnected) {
+    readAndPublishSensor(SENSOR_MQ7_GAS); // LED flash handled in publish function
+  }
+}
+
+// ===== SENSOR DRIVER REGISTRY =====
+
+SensorDriver sensorDrivers[] = {
+  // type, name, topic, init, poll, pollPeriod, sample, samplePeriod, serialize, published
+  {SENSOR_DHT_TEMP, "temperature", "temperature", initTemperatureProbe,
+   NULL, 0, sampleTemperatureProbe, TEMP_SAMPLE_INTERVAL, serializeTemperature, resetTemperatureWindow},
+  {SENSOR_MQ7_GAS, "mq7", "airquality", initMQ7Sensor,
+   taskSampleGas, MQ7_ADC_POLL_INTERVAL, sampleGas, TEMP_READ_INTERVAL, serializeGas, resetGasWindow},
+  {SENSOR_SENSE, "sense", NULL, initSenseBeams,
+   updateSenseSensor, SENSE_UPDATE_INTERVAL, publishTrafficWindow, TRAFFIC_WINDOW_MS, NULL, NULL},
+  {SENSOR_SENSE_CAMERA, "sense_camera", NULL, initSenseCamera,
+   updateSenseSensor, SENSE_UPDATE_INTERVAL, NULL, 0, NULL, NULL},
+};
+const int SENSOR_DRIVER_COUNT = sizeof(sensorDrivers) / sizeof(sensorDrivers[0]);
+
+void loadSensorConfig() {
+  Preferences prefs;
+  String list;
+  if (prefs.begin("sensors", true)) {
+    list = prefs.getString("enabled", "");
+    prefs.end();
+  }
+  enabledSensors = parseSensorList(list);
+  if (enabledSensors == 0) {
+    enabledSensors = 1UL << SENSOR;
+  }
+  Serial.print("Sensor drivers: ");
+  Serial.println(sensorListString(enabledSensors));
+  
+  String attachment;
+  if (prefs.begin("sensors", true)) {
+    attachment = prefs.getString("attachment", "");
+    prefs.end();
+  }
+  int type = parseAttachmentName(attachment);
+  attachmentType = type < 0 ? ATTACHMENT : (AttachmentType)type;
+  // The Neopixel data line shares D0 with the temperature probe
+  if (attachmentType == ATTACHMENT_NEOPIXEL && sensorActive(SENSOR_DHT_TEMP)) {
+    Serial.println("neopixel shares D0 with the temperature sensor - using builtin");
+    attachmentType = ATTACHMENT_BUILTIN;
+  }
+  Serial.print("Attachment: ");
+  Serial.println(ATTACHMENT_NAMES[attachmentType]);
+}
+
+// "traffic" -> ATTACHMENT_TRAFFIC, -1 when empty or unknown
+int parseAttachmentName(const String& name) {
+  String trimmed = name;
+  trimmed.trim();
+  if (trimmed.length() == 0) {
+    return -1;
+  }
+  for (int i = 0; i < (int)(sizeof(ATTACHMENT_NAMES) / sizeof(ATTACHMENT_NAMES[0])); i++) {
+    if (trimmed == ATTACHMENT_NAMES[i]) {
+      return i;
+    }
+  }
+  Serial.print("Unknown attachment: ");
+  Serial.println(trimmed);
+  return -1;
+}
+
+// <host>/config/sensors: store a new driver list, applied on the next boot
+void handleSensorConfigMessage(const String& message) {
+  uint32_t mask = parseSensorList(message);
+  JsonDocument doc;
+  doc["device_id"] = DEVICE_ID;
+  doc["requested"] = message;
+  if (mask == 0) {
+    doc["result"] = "rejected";
+  } else {
+    Preferences prefs;
+    bool saved = prefs.begin("sensors", false);
+    if (saved) {
+      saved = prefs.putString("enabled", sensorListString(mask)) > 0;
+      prefs.end();
+    }
+    doc["result"] = saved ? "saved" : "nvs_error";
+    doc["enabled_next_boot"] = sensorListString(mask);
+  }
+  doc["enabled_now"] = sensorListString(enabledSensors);
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  String statusTopic = deviceHostname + "/config/sensors/status";
+  mqttPublishOrQueue(statusTopic.c_str(), jsonString.c_str());
+}
+
+// <host>/config/attachment: store a new attachment, applied on the next boot
+void handleAttachmentConfigMessage(const String& message) {
+  int type = parseAttachmentName(message);
+  JsonDocument doc;
+  doc["device_id"] = DEVICE_ID;
+  doc["requested"] = message;
+  if (type < 0) {
+    doc["result"] = "rejected";
+  } else {
+    Preferences prefs;
+    bool saved = prefs.begin("sensors", false);
+    if (saved) {
+      saved = prefs.putString("attachment", ATTACHMENT_NAMES[type]) > 0;
+      prefs.end();
+    }
+    doc["result"] = saved ? "saved" : "nvs_error";
+    doc["attachment_next_boot"] = ATTACHMENT_NAMES[type];
+  }
+  doc["attachment_now"] = ATTACHMENT_NAMES[attachmentType];
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  String statusTopic = deviceHostname + "/config/attachment/status";
+  mqttPublishOrQueue(statusTopic.c_str(), jsonString.c_str());
+}
+
+// ===== DS18B20 asynchronous conversion =====
+
+void initTemperatureSensors() {
+  sensors.begin();
+  sensors.setWaitForConversion(false);
+  
+  ds18b20Count = 0;
+  int found = sensors.getDeviceCount();
+  for (int i = 0; i < found && ds18b20Count < DS18B20_MAX_SENSORS; i++) {
+    if (sensors.getAddress(ds18b20Addresses[ds18b20Count], i)) {
+      sensors.setResolution(ds18b20Addresses[ds18b20Count], DS18B20_RESOLUTION);
+      ds18b20Temps[ds18b20Count] = DEVICE_DISCONNECTED_C;
+      ds18b20Count++;
+    }
+  }
+  
+  Serial.print("DS18B20 sensors on pin D0: ");
+  Serial.print(ds18b20Count);
+  if (found > DS18B20_MAX_SENSORS) {
+    Serial.print(" (");
+    Serial.print(found - DS18B20_MAX_SENSORS);
+    Serial.print(" ignored)");
+  }
+  Serial.print(", conversion ");
+  Serial.print(sensors.millisToWaitForConversion(DS18B20_RESOLUTION));
+  Serial.println(" ms");
+}
+
+// Broadcast a conversion to every sensor and come back when it's done
+void startTemperatureConversion() {
+  if (ds18b20Count == 0) {
+    // Nothing found at boot - retry the enumeration (probe plugged in late)
+    initTemperatureSensors();
+    if (ds18b20Count == 0) {
+      Serial.println("Temperature sensor error!");
+      return;
+    }
+  }
+  sensors.requestTemperatures(); // returns immediately with setWaitForConversion(false)
+  armScheduledTask(ds18b20TaskId, sensors.millisToWaitForConversion(DS18B20_RESOLUTION));
+}
+
+void taskCollectTemperatures() {
+  for (int i = 0; i < ds18b20Count; i++) {
+    ds18b20Temps[i] = sensors.getTempC(ds18b20Addresses[i]);
+  }
+  ds18b20ReadingReady = true;
+  onTemperatureSample();
+}
+
+// A probe answered: fold it into the report window, and publish if a report
+// is due
+void onTemperatureSample() {
+  SensorReadings reading = readSensor(SENSOR_DHT_TEMP);
+  if (!reading.success) {
+    return;
+  }
+  windowStatsAdd(tempWindow, reading.temperature);
+  if (TEMP_PROBE == TEMP_PROBE_DHT22) {
+    windowStatsAdd(humidityWindow, reading.humidity);
+  }
+  if (tempReportPending && mqttConnected) {
+    tempReportPending = false;
+    readAndPublishSensor(SENSOR_DHT_TEMP);
+  }
+}
+
+// ===== DHT22 over RMT =====
+
+bool initDHT22() {
+  rmt_config_t config = RMT_DEFAULT_CONFIG_RX((gpio_num_t)DHT_PIN, DHT22_RMT_CHANNEL);
+  config.clk_div = 80; // 1 us ticks from the 80 MHz APB clock
+  config.rx_config.idle_threshold = DHT22_IDLE_THRESHOLD_US;
+  config.rx_config.filter_en = true;
+  config.rx_config.filter_ticks_thresh = 200; // drop glitches under 2.5 us (APB ticks)
+  if (rmt_config(&config) != ESP_OK ||
+      rmt_driver_install(DHT22_RMT_CHANNEL, 1024, 0) != ESP_OK ||
+      rmt_get_ringbuf_handle(DHT22_RMT_CHANNEL, &dht22Ringbuf) != ESP_OK) {
+    Serial.println("DHT22: RMT receiver setup failed");
+    dht22Ringbuf = NULL;
+    return false;
+  }
+  
+  // Open drain with the pull-up: the host only ever pulls the line low
+  gpio_set_pull_mode((gpio_num_t)DHT_PIN, GPIO_PULLUP_ONLY);
+  gpio_set_direction((gpio_num_t)DHT_PIN, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_level((gpio_num_t)DHT_PIN, 1);
+  Serial.println("DHT22 temperature/humidity sensor initialized on pin D0 (RMT capture)");
+  return true;
+}
+
+// Start signal: hold the line low, taskDHT22 releases it and starts the capture
+void startDHT22Read() {
+  if (dht22Ringbuf == NULL || dht22Phase != DHT22_IDLE) {
+    return;
+  }
+  gpio_set_level((gpio_num_t)DHT_PIN, 0);
+  dht22Phase = DHT22_START_SIGNAL;
+  armScheduledTask(dht22TaskId, DHT22_START_LOW_MS);
+}
+
+void taskDHT22() {
+  if (dht22Phase == DHT22_START_SIGNAL) {
+    // Drop anything left over from the last frame, then release the line;
+    // the sensor replies 20-40 us later
+    size_t size = 0;
+    void* stale;
+    while ((stale = xRingbufferReceive(dht22Ringbuf, &size, 0)) != NULL) {
+      vRingbufferReturnItem(dht22Ringbuf, stale);
+    }
+    rmt_rx_start(DHT22_RMT_CHANNEL, true);
+    gpio_set_level((gpio_num_t)DHT_PIN, 1);
+    dht22Phase = DHT22_CAPTURING;
+    armScheduledTask(dht22TaskId, DHT22_CAPTURE_MS);
+    return;
+  }
+  
+  rmt_rx_stop(DHT22_RMT_CHANNEL);
+  dht22Phase = DHT22_IDLE;
+  size_t size = 0;
+  rmt_item32_t* items = (rmt_item32_t*)xRingbufferReceive(dht22Ringbuf, &size, 0);
+  float temperature, humidity;
+  bool ok = items != NULL &&
+            decodeDHT22(items, size / sizeof(rmt_item32_t), &temperature, &humidity);
+  if (items != NULL) {
+    vRingbufferReturnItem(dht22Ringbuf, items);
+  }
+  
+  if (!ok) {
+    dht22Errors++;
+    Serial.print("DHT22: no valid frame (errors: ");
+    Serial.print(dht22Errors);
+    Serial.println(")");
+    return;
+  }
+  dht22Temperature = temperature;
+  dht22Humidity = humidity;
+  dht22ReadingReady = true;
+  onTemperatureSample();
+}
+
+// Decode the captured reply: an 80 us low / 80 us high response, then 40
+// bits of ~50 us low followed by a high whose length is the bit value.
+// Mirrored in test_dht22_decoder.py - keep the two in sync.
+bool decodeDHT22(const rmt_item32_t* items, size_t count, float* temperature, float* humidity) {
+  // Flatten the item pairs into alternating low/high pulses
+  uint16_t durations[DHT22_MAX_PULSES];
+  uint8_t levels[DHT22_MAX_PULSES];
+  int pulses = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint16_t d[2] = {(uint16_t)items[i].duration0, (uint16_t)items[i].duration1};
+    uint8_t l[2] = {(uint8_t)items[i].level0, (uint8_t)items[i].level1};
+    for (int h = 0; h < 2; h++) {
+      if (d[h] == 0) {
+        continue; // end marker
+      }
+      if (pulses > 0 && levels[pulses - 1] == l[h]) {
+        durations[pulses - 1] += d[h];
+      } else if (pulses < DHT22_MAX_PULSES) {
+        durations[pulses] = d[h];
+        levels[pulses] = l[h];
+        pulses++;
+      }
+    }
+  }
+  
+  // Find the response (low then high, both ~80 us)
+  int p = 0;
+  while (p + 1 < pulses && !(levels[p] == 0 && durations[p] >= 60 && durations[p] <= 110 &&
+                             durations[p + 1] >= 60 && durations[p + 1] <= 110)) {
+    p++;
+  }
+  p += 2;
+  if (p + 80 > pulses) {
+    return false;
+  }
+  
+  uint8_t data[5] = {0, 0, 0, 0, 0};
+  for (int bit = 0; bit < 40; bit++, p += 2) {
+    uint16_t low = durations[p];
+    uint16_t high = durations[p + 1];
+    if (low < 30 || low > 80 || high < 10 || high > 95) {
+      return false;
+    }
+    data[bit / 8] = (data[bit / 8] << 1) | (high > DHT22_BIT_THRESHOLD_US ? 1 : 0);
+  }
+  if ((uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) {
+    return false;
+  }
+  
+  *humidity = ((data[0] << 8) | data[1]) / 10.0;
+  float temp = (((data[2] & 0x7F) << 8) | data[3]) / 10.0;
+  *temperature = (data[2] & 0x80) ? -temp : temp;
+  return *humidity <= 100.0;
+}
+
+// ===== MQ7 continuous sampling =====
+
+bool initGasADC() {
+  int8_t channel = digitalPinToAnalogChannel(MQ7_ANALOG_PIN);
+  if (channel < 0 || channel >= SOC_ADC_CHANNEL_NUM(0)) {
+    Serial.println("MQ7 pin is not on ADC1 - continuous sampling unavailable");
+    return false;
+  }
+  
+  adc_digi_init_config_t initConfig = {};
+  initConfig.max_store_buf_size = MQ7_DMA_BUFFER_BYTES;
+  initConfig.conv_num_each_intr = 64 * SOC_ADC_DIGI_RESULT_BYTES;
+  initConfig.adc1_chan_mask = BIT(channel);
+  initConfig.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&initConfig) != ESP_OK) {
+    Serial.println("ADC continuous driver init failed");
+    return false;
+  }
+  
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = channel;
+  pattern.unit = 0; // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  
+  adc_digi_configuration_t digiConfig = {};
+  digiConfig.conv_limit_en = false;
+  digiConfig.conv_limit_num = 250;
+  digiConfig.pattern_num = 1;
+  digiConfig.adc_pattern = &pattern;
+  digiConfig.sample_freq_hz = MQ7_SAMPLE_RATE_HZ;
+  digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  digiConfig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+  if (adc_digi_controller_configure(&digiConfig) != ESP_OK || adc_digi_start() != ESP_OK) {
+    Serial.println("ADC continuous driver start failed");
+    adc_digi_deinitialize();
+    return false;
+  }
+  
+  memset(&gasFilter, 0, sizeof(gasFilter));
+  windowStatsReset(gasWindow);
+  return true;
+}
+
+// Scheduler task: drain the DMA buffer through the filter
+void taskSampleGas() {
+  static uint8_t buffer[256];
+  uint32_t bytesRead = 0;
+  
+  while (true) {
+    esp_err_t err = adc_digi_read_bytes(buffer, sizeof(buffer), &bytesRead, 0);
+    if (err == ESP_ERR_INVALID_STATE) {
+      gasDmaOverruns++; // driver pool filled up; the data returned is still valid
+    } else if (err != ESP_OK) {
+      break;
+    }
+    if (bytesRead == 0) {
+      break;
+    }
+    
+    unsigned long start = micros();
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= bytesRead; i += SOC_ADC_DIGI_RESULT_BYTES) {
+      adc_digi_output_data_t* sample = (adc_digi_output_data_t*)&buffer[i];
+      gasRawSamples++;
+      if (gasFilterPush(sample->type2.data)) {
+        onGasFiltered();
+      }
+    }
+    gasFilterMicros += micros() - start;
+  }
+}
+
+// Every filtered value (100 Hz): window stats, LED level and threshold alerts
+void onGasFiltered() {
+  if (!mq7ReadingValid()) {
+    // Heater purge phase: restart the IIR so it doesn't carry these values
+    // into the next measurement window
+    gasFilter.primed = false;
+    return;
+  }
+  
+  float ppm = mq7CodeToPpm(gasFilteredCode);
+  gasFilteredPpm = ppm;
+  
+  windowStatsAdd(gasWindow, ppm);
+  
+  GasLevel level = applyGasHysteresis(currentGasLevel, ppm);
+  currentGasLevel = level;
+  
+  // Alert once per escalation into HIGH/CRITICAL; re-armed when it drops back
+  if (level >= GAS_HIGH && level > gasAlertLevel) {
+    publishGasAlert(level, ppm);
+  }
+  if (level < GAS_HIGH || level > gasAlertLevel) {
+    gasAlertLevel = level;
+  }
+}
+
+void publishGasAlert(GasLevel level, float ppm) {
+  Serial.print("GAS ALERT: ");
+  Serial.print(gasLevelName(level));
+  Serial.print(" - ");
+  Serial.print(ppm, 1);
+  Serial.println(" ppm");
+  
+  JsonDocument doc;
+  doc["device_id"] = DEVICE_ID;
+  doc["timestamp"] = getCurrentUnixTime();
+  doc["sensor_type"] = "MQ7";
+  doc["gas_type"] = "CO";
+  doc["level"] = gasLevelName(level);
+  doc["ppm"] = ppm;
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  String alertTopic = deviceHostname + "/sensors/airquality/alert";
+  if (mqttPublishOrQueue(alertTopic.c_str(), jsonString.c_str())) {
+    setLEDStatus(LED_MQTT_SENDING);
+    lastMQTTSend = millis();
+  }
+}
+
+// ===== MQ7 heater cycle and R0 calibration =====
+
+void initMQ7Heater() {
+  ledcSetup(MQ7_HEATER_LEDC_CHANNEL, MQ7_HEATER_PWM_HZ, 8);
+  ledcAttachPin(MQ7_HEATER_PIN, MQ7_HEATER_LEDC_CHANNEL);
+  
+  // LEDC stops in light sleep and the heater draws ~150 mA anyway, so hold
+  // the CPU awake while the cycle runs
+  if (lowPowerActive &&
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "mq7_heater", &mq7HeaterPmLock) == ESP_OK) {
+    esp_pm_lock_acquire(mq7HeaterPmLock);
+  }
+  
+  // Start with a purge; the first reading comes at the end of the first
+  // full 1.4 V phase
+  mq7HeaterPhase = MQ7_PHASE_HEAT;
+  mq7PhaseStartedAt = millis();
+  ledcWrite(MQ7_HEATER_LEDC_CHANNEL, MQ7_HEATER_DUTY_HIGH);
+  Serial.print("Heater cycle: ");
+  Serial.print(MQ7_HEAT_PHASE_MS / 1000);
+  Serial.print(" s at 5 V / ");
+  Serial.print(MQ7_MEASURE_PHASE_MS / 1000);
+  Serial.println(" s at 1.4 V");
+}
+
+// Scheduler task (one-shot, re-armed for each phase boundary)
+void taskMQ7Heater() {
+  unsigned long now = millis();
+  if (mq7HeaterPhase == MQ7_PHASE_HEAT) {
+    mq7HeaterPhase = MQ7_PHASE_MEASURE;
+    mq7PhaseStartedAt = now;
+    ledcWrite(MQ7_HEATER_LEDC_CHANNEL, MQ7_HEATER_DUTY_LOW);
+    armScheduledTask(mq7HeaterTaskId, MQ7_MEASURE_PHASE_MS);
+    return;
+  }
+  
+  // End of the measurement phase: this is the reading the cycle exists for
+  if (mqttConnected) {
+    readAndPublishSensor(SENSOR_MQ7_GAS);
+  }
+  mq7HeaterPhase = MQ7_PHASE_HEAT;
+  mq7PhaseStartedAt = now;
+  ledcWrite(MQ7_HEATER_LEDC_CHANNEL, MQ7_HEATER_DUTY_HIGH);
+  armScheduledTask(mq7HeaterTaskId, MQ7_HEAT_PHASE_MS);
+}
+
+bool mq7ReadingValid() {
+  if (!MQ7_HEATER_CYCLE) {
+    return true;
+  }
+  return mq7HeaterPhase == MQ7_PHASE_MEASURE &&
+         millis() - mq7PhaseStartedAt >= MQ7_MEASURE_PHASE_MS - MQ7_VALID_WINDOW_MS;
+}
+
+// Track the clean-air Rs peak in hourly buckets and move R0 to match
+void updateMQ7Baseline(float rs) {
+  if (!(rs > 0)) {
+    return;
+  }
+  rs = constrain(rs, MQ7_R0_MIN_KOHM, MQ7_R0_MAX_KOHM);
+  MQ7Baseline& b = mq7Baseline;
+  unsigned long now = millis();
+  if (b.filled == 0) {
+    b.filled = 1;
+    b.bucketStartedAt = now;
+  } else if (now - b.bucketStartedAt >= MQ7_BASELINE_BUCKET_MS) {
+    // Advance by the hours actually elapsed: after a gap in readings (heater
+    // cycle paused, sensor disabled, MQTT down) the skipped hours are empty,
+    // not credited to the bucket that was open
+    unsigned long hours = (now - b.bucketStartedAt) / MQ7_BASELINE_BUCKET_MS;
+    int steps = hours < (unsigned long)MQ7_BASELINE_BUCKETS ? hours : MQ7_BASELINE_BUCKETS;
+    for (int i = 0; i < steps; i++) {
+      b.current = (b.current + 1) % MQ7_BASELINE_BUCKETS;
+      b.rsMax[b.current] = 0;
+    }
+    b.bucketStartedAt += hours * MQ7_BASELINE_BUCKET_MS;
+    b.filled = min(b.filled + steps, MQ7_BASELINE_BUCKETS);
+    
+    // R0 is re-evaluated once per completed hour, which also bounds NVS
+    // writes; only hours that actually saw readings count as history
+    float rsClean = 0;
+    int withData = 0;
+    for (int i = 0; i < MQ7_BASELINE_BUCKETS; i++) {
+      if (i != b.current && b.rsMax[i] > 0) {
+        withData++;
+        rsClean = max(rsClean, b.rsMax[i]);
+      }
+    }
+    if (withData >= MQ7_BASELINE_MIN_BUCKETS) {
+      // Rs/R0 that the response curve maps to the clean-air background
+      float cleanRatio = pow(MQ7_CLEAN_AIR_PPM / CO_CURVE_A, 1.0 / CO_CURVE_B);
+      float r0 = rsClean / cleanRatio;
+      if (r0 > MQ7_R0_MIN_KOHM && r0 < MQ7_R0_MAX_KOHM &&
+          fabs(r0 - mq7R0) > mq7R0 * MQ7_R0_UPDATE_THRESHOLD) {
+        Serial.print("MQ7 auto-calibration: R0 ");
+        Serial.print(mq7R0, 2);
+        Serial.print(" -> ");
+        Serial.print(r0, 2);
+        Serial.println(" kΩ");
+        buildMQ7PpmTable(r0);
+        saveMQ7R0(r0);
+      }
+    }
+  }
+  if (rs > b.rsMax[b.current]) {
+    b.rsMax[b.current] = rs;
+  }
+}
+
+float loadMQ7R0() {
+  Preferences prefs;
+  float r0 = 0;
+  if (prefs.begin("mq7", true)) {
+    r0 = prefs.getFloat("r0", 0);
+    prefs.end();
+  }
+  // Reject anything outside the range an MQ7 can physically report
+  mq7R0FromNVS = r0 > MQ7_R0_MIN_KOHM && r0 < MQ7_R0_MAX_KOHM;
+  if (!mq7R0FromNVS) {
+    return MQ7_RO;
+  }
+  Serial.print("MQ7 R0 restored from NVS: ");
+  Serial.print(r0, 2);
+  Serial.println(" kΩ");
+  return r0;
+}
+
+void saveMQ7R0(float r0) {
+  Preferences prefs;
+  if (prefs.begin("mq7", false)) {
+    prefs.putFloat("r0", r0);
+    prefs.end();
+    mq7R0FromNVS = true;
+  }
+}
+
+// Update and publish events for the SENSOR_SENSE doorway tracker
+// Tick hook on the loop core (see SENSE_TICK_GAP_US)
+void IRAM_ATTR onSenseTick() {
+  uint32_t nowUs = micros();
+  if (nowUs - senseLastTickUs > SENSE_TICK_GAP_US) {
+    senseWakeTickUs = nowUs;
+  }
+  senseLastTickUs = nowUs;
+}
+
+static inline bool IRAM_ATTR senseEdgeWokeChip(uint32_t nowUs) {
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_GPIO) {
+    return false;
+  }
+  return nowUs - senseLastTickUs > SENSE_TICK_GAP_US || nowUs - senseWakeTickUs < SENSE_TICK_GAP_US / 2;
+}
+
+// Runs in interrupt context: timestamp the edge and hand it to the loop
+static inline void IRAM_ATTR pushSenseEdge(uint8_t beam, int pin) {
+  uint32_t head = senseEdgeHead;
+  if (head - __atomic_load_n(&senseEdgeTail, __ATOMIC_ACQUIRE) >= SENSE_EDGE_RING_SIZE) {
+    senseEdgeDropped++;
+  } else {
+    SenseEdge& edge = senseEdgeRing[head & (SENSE_EDGE_RING_SIZE - 1)];
+    edge.timeUs = micros();
+    edge.beam = beam;
+    edge.active = gpio_ll_get_level(&GPIO, pin) == (SENSE_ACTIVE_LOW ? 0 : 1);
+    edge.approximate = lightSleepEnabled && senseEdgeWokeChip(edge.timeUs);
+    __atomic_store_n(&senseEdgeHead, head + 1, __ATOMIC_RELEASE);
+  }
+  
+  senseEdgeEvent = true;
+  if (loopTaskHandle != NULL) {
+    BaseType_t higherPriorityWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(loopTaskHandle, &higherPriorityWoken);
+    portYIELD_FROM_ISR(higherPriorityWoken);
+  }
+}
+
+void IRAM_ATTR onSenseEdgeA() {
+  pushSenseEdge(0, SENSE_A_PIN);
+}
+
+void IRAM_ATTR onSenseEdgeB() {
+  pushSenseEdge(1, SENSE_B_PIN);
+}
+
+// Level-triggered variant for light sleep: re-arm for the opposite level
+// first. If the pin flips again in between, the new type already matches
+// and the interrupt fires straight away for that edge.
+static inline void IRAM_ATTR flipSenseLevel(int pin) {
+  gpio_ll_set_intr_type(&GPIO, (gpio_num_t)pin,
+                        gpio_ll_get_level(&GPIO, pin) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+}
+
+void IRAM_ATTR onSenseLevelA() {
+  flipSenseLevel(SENSE_A_PIN);
+  pushSenseEdge(0, SENSE_A_PIN);
+}
+
+void IRAM_ATTR onSenseLevelB() {
+  flipSenseLevel(SENSE_B_PIN);
+  pushSenseEdge(1, SENSE_B_PIN);
+}
+
+// Read back the GPIO matrix: light-sleep wakeup needs wakeup_enable and a
+// level interrupt type on both beam pins
+bool senseWakeupArmed() {
+  const int pins[] = { SENSE_A_PIN, SENSE_B_PIN };
+  for (int pin : pins) {
+    uint32_t type = GPIO.pin[pin].int_type;
+    if (!GPIO.pin[pin].wakeup_enable || (type != GPIO_INTR_LOW_LEVEL && type != GPIO_INTR_HIGH_LEVEL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void resetSenseDecoder() {
+  bool aActive = (digitalRead(SENSE_A_PIN) == (SENSE_ACTIVE_LOW ? LOW : HIGH));
+  bool bActive = (digitalRead(SENSE_B_PIN) == (SENSE_ACTIVE_LOW ? LOW : HIGH));
+  memset(senseBeams, 0, sizeof(senseBeams));
+  senseBeams[0].stable = aActive;
+  senseBeams[1].stable = bActive;
+  sensePendingCount[0] = 0;
+  sensePendingCount[1] = 0;
+  senseCrossingCount = 0;
+  memset(&trafficWindow, 0, sizeof(trafficWindow));
+  __atomic_store_n(&senseEdgeTail, __atomic_load_n(&senseEdgeHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+// Commit settled beam bursts in the order they started, so a bouncing beam
+// can't be reported after a cleaner one that actually broke later
+void settleSenseBeams(uint32_t nowUs) {
+  while (true) {
+    int next = -1;
+    for (int beam = 0; beam < 2; beam++) {
+      if (senseBeams[beam].pending &&
+          (next < 0 || (int32_t)(senseBeams[beam].pendingSince - senseBeams[next].pendingSince) < 0)) {
+        next = beam;
+      }
+    }
+    if (next < 0 || nowUs - senseBeams[next].lastEdgeUs < SENSE_DEBOUNCE_US) {
+      return;
+    }
+    
+    SenseBeam& b = senseBeams[next];
+    b.pending = false;
+    if (b.pendingLevel != b.stable) {
+      b.stable = b.pendingLevel;
+      onSenseBeamChange(next, b.stable, b.pendingSince, b.pendingApprox);
+    }
+  }
+}
+
+static SenseBreak popSensePending(int beam) {
+  SenseBreak oldest = sensePending[beam][0];
+  sensePendingCount[beam]--;
+  memmove(sensePending[beam], sensePending[beam] + 1, sensePendingCount[beam] * sizeof(SenseBreak));
+  return oldest;
+}
+
+// Drop breaks the other beam never followed up on, and give up on crossings
+// whose beams never cleared
+void expireSenseState(uint32_t nowUs) {
+  for (int i = 0; i < 2; i++) {
+    while (sensePendingCount[i] > 0 && nowUs - sensePending[i][0].rise > SENSE_TIMEOUT_MS * 1000) {
+      popSensePending(i);
+    }
+  }
+  while (senseCrossingCount > 0 && nowUs - senseCrossings[0].second.rise > SENSE_DWELL_TIMEOUT_MS * 1000) {
+    finishSenseCrossing(0, nowUs);
+  }
+}
+
+// Direction decoding on debounced beam breaks
+void onSenseBeamChange(int beam, bool active, uint32_t timeUs, bool approximate) {
+  expireSenseState(timeUs);
+  
+  if (!active) {
+    // A clear beam means everyone blocking it has moved on
+    for (int i = 0; i < sensePendingCount[beam]; i++) {
+      if (!sensePending[beam][i].cleared) {
+        sensePending[beam][i].fall = timeUs;
+        sensePending[beam][i].cleared = true;
+      }
+    }
+    for (int i = 0; i < senseCrossingCount; i++) {
+      SenseBreak& b = senseCrossings[i].firstBeam == beam ? senseCrossings[i].first : senseCrossings[i].second;
+      if (!b.cleared) {
+        b.fall = timeUs;
+        b.cleared = true;
       }
-      
-      reading.gasLevel = ppm;
-      reading.digitalThreshold = digitalThreshold;
-      reading.success = true;
-      
-      // Categorize gas level based on ppm thresholds
-      if (ppm < 5.0) {
-        reading.gasCategoryLevel = GAS_LOW;
-      } else if (ppm < 15.0) {
-        reading.gasCategoryLevel = GAS_MEDIUM;
-      } else if (ppm < 35.0) {
-        reading.gasCategoryLevel = GAS_HIGH;
+    }
+    for (int i = 0; i < senseCrossingCount; ) {
+      if (senseCrossings[i].first.cleared && senseCrossings[i].second.cleared) {
+        finishSenseCrossing(i, timeUs);
       } else {
-        reading.gasCategoryLevel = GAS_CRITICAL;
-      }
-      
-      // Update global gas level for LED status
-      currentGasLevel = reading.gasCategoryLevel;
-      
-      // Debug output
-      Serial.print("MQ7 - ADC Raw: ");
-      Serial.print(rawValue);
-      Serial.print(" | Voltage: ");
-      Serial.print(voltage, 2);
-      Serial.print("V | Rs: ");
-      Serial.print(rs, 1);
-      Serial.print("kΩ | Ratio: ");
-      Serial.print(ratio, 3);
-      Serial.print(" | CO Level: ");
-      Serial.print(ppm, 1);
-      Serial.print(" ppm (");
-      switch(reading.gasCategoryLevel) {
-        case GAS_LOW: Serial.print("LOW"); break;
-        case GAS_MEDIUM: Serial.print("MEDIUM"); break;
-        case GAS_HIGH: Serial.print("HIGH"); break;
-        case GAS_CRITICAL: Serial.print("CRITICAL"); break;
+        i++;
       }
-      Serial.print(") | Digital Threshold: ");
-      Serial.println(digitalThreshold ? "HIGH" : "LOW");
-      break;
     }
+    return;
   }
   
-  return reading;
+  int other = 1 - beam;
+  if (sensePendingCount[other] == 0) {
+    // First beam of a crossing: wait for the other one
+    if (sensePendingCount[beam] == SENSE_PENDING_MAX) {
+      popSensePending(beam);
+    }
+    SenseBreak& b = sensePending[beam][sensePendingCount[beam]++];
+    b.rise = timeUs;
+    b.fall = 0;
+    b.cleared = false;
+    b.approxRise = approximate;
+    return;
+  }
+  
+  SenseBreak first = popSensePending(other);
+  if (timeUs - first.rise < SENSE_MIN_GAP_US) {
+    // Both beams broke at once (something wide or electrical noise)
+    senseRejectedCount++;
+    return;
+  }
+  
+  if (senseCrossingCount == SENSE_CROSSINGS_MAX) {
+    finishSenseCrossing(0, timeUs);
+  }
+  bool crowded = senseCrossingCount > 0 || sensePendingCount[0] > 0 || sensePendingCount[1] > 0;
+  for (int i = 0; i < senseCrossingCount; i++) {
+    senseCrossings[i].overlapped |= crowded;
+  }
+  SenseCrossing& c = senseCrossings[senseCrossingCount++];
+  c.firstBeam = other;
+  c.first = first;
+  c.second.rise = timeUs;
+  c.second.fall = 0;
+  c.second.cleared = false;
+  c.second.approxRise = approximate;
+  c.overlapped = crowded;
 }
 
-void publishSensorData() {
-  // This is a convenience wrapper for readAndPublishTemperature
-  // Called automatically in the main loop
-  readAndPublishTemperature();
+// Measure a crossing, count it and remove it from the in-progress list
+void finishSenseCrossing(int index, uint32_t nowUs) {
+  SenseCrossing c = senseCrossings[index];
+  senseCrossingCount--;
+  memmove(senseCrossings + index, senseCrossings + index + 1, (senseCrossingCount - index) * sizeof(SenseCrossing));
+  
+  TrafficCrossing m;
+  m.entering = c.firstBeam == 0;
+  float riseLeadMs = (c.second.rise - c.first.rise) / 1000.0;
+  m.speed = SENSE_BEAM_SPACING_MM / riseLeadMs; // mm/ms == m/s
+  m.confidence = 1.0;
+  
+  if (c.first.cleared && c.second.cleared) {
+    m.dwellMs = (c.second.fall - c.first.rise) / 1000;
+    float fallLeadMs = (int32_t)(c.second.fall - c.first.fall) / 1000.0;
+    if (fallLeadMs > 0 && (c.first.approxRise || c.second.approxRise)) {
+      // The rise lead includes the wake-up latency; the clears are exact
+      m.speed = SENSE_BEAM_SPACING_MM / fallLeadMs;
+      m.confidence *= SENSE_WAKE_CONFIDENCE;
+    } else if (fallLeadMs > 0) {
+      // Beams clear in the same order and at a similar pace for a steady walker
+      m.speed = (m.speed + SENSE_BEAM_SPACING_MM / fallLeadMs) / 2.0;
+      m.confidence *= min(riseLeadMs, fallLeadMs) / max(riseLeadMs, fallLeadMs);
+    } else {
+      m.confidence *= 0.3; // cleared in reverse order: turned around or two people
+    }
+  } else {
+    m.dwellMs = (nowUs - c.first.rise) / 1000;
+    m.confidence *= 0.5; // never saw the beams clear
+  }
+  if (m.speed < 0.2 || m.speed > 3.0) {
+    m.confidence *= 0.5; // not a walking pace
+  }
+  if (c.overlapped) {
+    m.confidence *= 0.7;
+  }
+  
+  if (m.entering) {
+    senseInCount++;
+  } else {
+    senseOutCount++;
+  }
+  recordTrafficCrossing(m);
 }
 
-// Update and publish events for the SENSOR_SENSE doorway tracker
 void updateSenseSensor() {
-  unsigned long now = millis();
-
-  if (SENSOR == SENSOR_SENSE) {
-    bool aActive = (digitalRead(SENSE_A_PIN) == (SENSE_ACTIVE_LOW ? LOW : HIGH));
-    bool bActive = (digitalRead(SENSE_B_PIN) == (SENSE_ACTIVE_LOW ? LOW : HIGH));
-
-    switch (senseState) {
-      case SENSE_IDLE:
-        if (aActive && !bActive) {
-          senseState = SENSE_A_TRIGGERED;
-          senseLastTriggerTime = now;
-        } else if (bActive && !aActive) {
-          senseState = SENSE_B_TRIGGERED;
-          senseLastTriggerTime = now;
-        }
-        break;
-
-      case SENSE_A_TRIGGERED:
-        // Wait for B to trigger within timeout => entry (A -> B)
-        if (bActive) {
-          senseInCount++;
-          publishTrafficEvent("enter", senseInCount, senseOutCount);
-          senseState = SENSE_IDLE;
-        } else if (now - senseLastTriggerTime > SENSE_TIMEOUT_MS) {
-          // Timeout - reset
-          senseState = SENSE_IDLE;
-        }
-        break;
-
-      case SENSE_B_TRIGGERED:
-        // Wait for A to trigger within timeout => exit (B -> A)
-        if (aActive) {
-          senseOutCount++;
-          publishTrafficEvent("exit", senseInCount, senseOutCount);
-          senseState = SENSE_IDLE;
-        } else if (now - senseLastTriggerTime > SENSE_TIMEOUT_MS) {
-          // Timeout - reset
-          senseState = SENSE_IDLE;
-        }
-        break;
+  if (sensorActive(SENSOR_SENSE)) {
+    // Replay the edges captured since the last pass
+    uint32_t tail = senseEdgeTail;
+    while (tail != __atomic_load_n(&senseEdgeHead, __ATOMIC_ACQUIRE)) {
+      SenseEdge edge = senseEdgeRing[tail & (SENSE_EDGE_RING_SIZE - 1)];
+      tail++;
+      __atomic_store_n(&senseEdgeTail, tail, __ATOMIC_RELEASE);
+      
+      settleSenseBeams(edge.timeUs);
+      SenseBeam& b = senseBeams[edge.beam];
+      if (!b.pending) {
+        b.pendingSince = edge.timeUs;
+        b.pendingApprox = edge.approximate;
+      }
+      b.pending = true;
+      b.pendingLevel = edge.active;
+      b.lastEdgeUs = edge.timeUs;
+    }
+    settleSenseBeams(micros());
+    expireSenseState(micros());
+    
+    // Stay out of light sleep while a crossing is open. A beam left blocked
+    // times out of the pending list, so it can't hold the chip awake.
+    if (senseAwakePmLock != NULL) {
+      bool busy = senseBeams[0].pending || senseBeams[1].pending || sensePendingCount[0] > 0 ||
+                  sensePendingCount[1] > 0 || senseCrossingCount > 0;
+      if (busy && !senseAwakeHeld) {
+        esp_pm_lock_acquire(senseAwakePmLock);
+        senseAwakeHeld = true;
+      } else if (!busy && senseAwakeHeld) {
+        senseAwakeHeld = false;
+        esp_pm_lock_release(senseAwakePmLock);
+      }
     }
-  } else if (SENSOR == SENSOR_SENSE_CAMERA) {
+    
+    // Come back as soon as a still-bouncing beam can settle
+    if (senseBeams[0].pending || senseBeams[1].pending) {
+      armScheduledTask(senseTaskId, SENSE_DEBOUNCE_US / 1000 + 1);
+    }
+  } else if (sensorActive(SENSOR_SENSE_CAMERA)) {
     // Camera-based processing
     if (cameraAvailable) {
       processCameraFrame();
@@ -1800,7 +3835,7 @@ void updateSenseSensor() {
   }
 }
 
-void publishTrafficEvent(const char* event, int inCount, int outCount) {
+void publishTrafficEvent(const char* event, int inCount, int outCount, const TrafficCrossing* crossing) {
   Serial.print("Traffic event: "); Serial.println(event);
   Serial.print("Counts - In: "); Serial.print(inCount); Serial.print(" Out: "); Serial.println(outCount);
 
@@ -1810,24 +3845,106 @@ void publishTrafficEvent(const char* event, int inCount, int outCount) {
   doc["event"] = event;
   doc["in_count"] = inCount;
   doc["out_count"] = outCount;
+  if (crossing != NULL) {
+    doc["speed_mps"] = crossing->speed;
+    doc["dwell_ms"] = crossing->dwellMs;
+    doc["confidence"] = crossing->confidence;
+  }
 
   String jsonString;
   serializeJson(doc, jsonString);
 
   String sensorTopic = deviceHostname + "/sensors/traffic";
-  if (mqttClient.connected()) {
+  if (mqttPublishOrQueue(sensorTopic.c_str(), jsonString.c_str())) {
     setLEDStatus(LED_MQTT_SENDING);
     lastMQTTSend = millis();
-    mqttClient.publish(sensorTopic.c_str(), jsonString.c_str());
     Serial.print("Published traffic event to: "); Serial.println(sensorTopic);
+  }
+}
+
+// Add a crossing to the current window and publish it as a raw event while
+// the window is still quiet
+void recordTrafficCrossing(const TrafficCrossing& crossing) {
+  if (trafficWindow.startedAt == 0) {
+    trafficWindow.startedAt = getCurrentUnixTime();
+  }
+  if (crossing.entering) {
+    trafficWindow.enter++;
+  } else {
+    trafficWindow.exit++;
+  }
+  
+  int bucket = 0;
+  while (bucket < TRAFFIC_SPEED_BUCKETS - 1 && crossing.speed > TRAFFIC_SPEED_BOUNDS[bucket]) {
+    bucket++;
+  }
+  trafficWindow.speed[bucket]++;
+  trafficWindow.speedSum += crossing.speed;
+  
+  bucket = 0;
+  while (bucket < TRAFFIC_DWELL_BUCKETS - 1 && crossing.dwellMs > TRAFFIC_DWELL_BOUNDS_MS[bucket]) {
+    bucket++;
+  }
+  trafficWindow.dwell[bucket]++;
+  
+  bucket = 0;
+  while (bucket < TRAFFIC_CONFIDENCE_BUCKETS - 1 && crossing.confidence >= TRAFFIC_CONFIDENCE_BOUNDS[bucket]) {
+    bucket++;
+  }
+  trafficWindow.confidence[bucket]++;
+  
+  if (trafficWindow.rawPublished < TRAFFIC_RAW_EVENTS_PER_WINDOW) {
+    trafficWindow.rawPublished++;
+    publishTrafficEvent(crossing.entering ? "enter" : "exit", senseInCount, senseOutCount, &crossing);
   } else {
-    Serial.println("MQTT not connected - skipping publish");
+    trafficWindow.suppressed++;
+  }
+}
+
+// Runs every TRAFFIC_WINDOW_MS. Quiet windows were already sent event by
+// event; busy ones go out as a single histogram message.
+void publishTrafficWindow() {
+  if (trafficWindow.suppressed > 0) {
+    JsonDocument doc;
+    doc["device_id"] = DEVICE_ID;
+    doc["window_start"] = trafficWindow.startedAt;
+    doc["window_s"] = TRAFFIC_WINDOW_MS / 1000;
+    doc["enter"] = trafficWindow.enter;
+    doc["exit"] = trafficWindow.exit;
+    doc["in_count"] = senseInCount;
+    doc["out_count"] = senseOutCount;
+    doc["raw_events"] = trafficWindow.rawPublished;
+    doc["mean_speed_mps"] = trafficWindow.speedSum / (trafficWindow.enter + trafficWindow.exit);
+    JsonArray speed = doc["speed_hist"].to<JsonArray>();
+    for (int i = 0; i < TRAFFIC_SPEED_BUCKETS; i++) {
+      speed.add(trafficWindow.speed[i]);
+    }
+    JsonArray dwell = doc["dwell_hist"].to<JsonArray>();
+    for (int i = 0; i < TRAFFIC_DWELL_BUCKETS; i++) {
+      dwell.add(trafficWindow.dwell[i]);
+    }
+    JsonArray confidence = doc["confidence_hist"].to<JsonArray>();
+    for (int i = 0; i < TRAFFIC_CONFIDENCE_BUCKETS; i++) {
+      confidence.add(trafficWindow.confidence[i]);
+    }
+    
+    String jsonString;
+    serializeJson(doc, jsonString);
+    String summaryTopic = deviceHostname + "/sensors/traffic/summary";
+    if (mqttPublishOrQueue(summaryTopic.c_str(), jsonString.c_str())) {
+      setLEDStatus(LED_MQTT_SENDING);
+      lastMQTTSend = millis();
+      Serial.print("Published traffic summary to: "); Serial.println(summaryTopic);
+    }
   }
+  
+  memset(&trafficWindow, 0, sizeof(trafficWindow));
 }
 
 // -------- Camera helper implementations --------
 #ifdef ESP32
 #include "esp_camera.h"
+#include "img_converters.h"
 
 bool initializeCameraModule() {
   Serial.print("Camera init: free heap before init: "); Serial.println(ESP.getFreeHeap());
@@ -1911,15 +4028,57 @@ bool initializeCameraModule() {
   Serial.print("Test capture OK: format="); Serial.print(test_fb->format);
   Serial.print(" size="); Serial.println(test_fb->len);
   esp_camera_fb_return(test_fb);
+  cameraExposureLocked = false;
+  cameraExposureStableFrames = 0;
   return true;
 }
 
-// Capture a grayscale frame resized to w*h. If JPEG capture is returned,
-// we decode to grayscale by simple sampling of luminance from JPEG buffer —
-// for simplicity we request PIXFORMAT_RGB565 when supported; fallback to
-// converting JPEG to grayscale is expensive and not implemented fully here.
-bool captureGrayscaleFrame(uint8_t* buf, int w, int h) {
-  if (!buf) return false;
+// Switch AEC/AGC/AWB on (converging) or off (holding what they converged to)
+void setCameraAutoExposure(bool enabled) {
+  sensor_t* s = esp_camera_sensor_get();
+  if (s == NULL) {
+    return;
+  }
+  s->set_exposure_ctrl(s, enabled);
+  s->set_gain_ctrl(s, enabled);
+  s->set_whitebal(s, enabled);
+  s->set_awb_gain(s, enabled);
+  cameraExposureLocked = !enabled;
+  cameraExposureLockedAt = millis();
+  cameraExposureStableFrames = 0;
+  cameraExposureLastMean = -1;
+  Serial.println(enabled ? "Camera exposure: auto, converging" : "Camera exposure: locked");
+}
+
+// Time CAM_BENCH_FRAMES back-to-back captures. With one frame buffer each
+// get waits for a fresh frame, so this is the rate the sensor delivers.
+void benchmarkCameraCapture(const char* label) {
+  camera_fb_t* fb = esp_camera_fb_get(); // discard the frame started before any change
+  if (fb) esp_camera_fb_return(fb);
+  size_t bytes = 0;
+  int frames = 0;
+  unsigned long start = micros();
+  for (int i = 0; i < CAM_BENCH_FRAMES; i++) {
+    fb = esp_camera_fb_get();
+    if (!fb) continue;
+    bytes = fb->len;
+    frames++;
+    esp_camera_fb_return(fb);
+  }
+  unsigned long elapsed = micros() - start;
+  if (frames == 0) {
+    return;
+  }
+  cameraFrameBytes = bytes;
+  cameraCaptureFps = frames * 1000000.0 / elapsed;
+  Serial.print("Camera capture ("); Serial.print(label); Serial.print("): ");
+  Serial.print(bytes); Serial.print(" bytes/frame, ");
+  Serial.print(cameraCaptureFps, 1); Serial.println(" fps");
+}
+
+// Grab a frame buffer, retrying and reinitializing the camera once if the
+// driver keeps returning NULL. The caller returns it with esp_camera_fb_return().
+camera_fb_t* captureCameraFrame() {
   camera_fb_t* fb = NULL;
   // Retry a few times — sometimes the driver returns NULL briefly
   for (int attempt = 0; attempt < 4; attempt++) {
@@ -1939,7 +4098,7 @@ bool captureGrayscaleFrame(uint8_t* buf, int w, int h) {
     bool reinited = initializeCameraModule();
     if (!reinited) {
       Serial.println("Camera recovery failed (reinit unsuccessful)");
-      return false;
+      return NULL;
     }
 
     // Try capturing again after recovery
@@ -1951,38 +4110,134 @@ bool captureGrayscaleFrame(uint8_t* buf, int w, int h) {
     }
     if (!fb) {
       Serial.println("Camera capture failed after recovery");
-      return false;
+      return NULL;
     }
   }
+  return fb;
+}
 
+// Nearest-neighbour downsample of a frame buffer into w*h grayscale bytes.
+// If JPEG capture is returned, we decode to grayscale by simple sampling of
+// luminance from JPEG buffer — for simplicity we request PIXFORMAT_RGB565
+// when supported; fallback to converting JPEG to grayscale is expensive and
+// not implemented fully here.
+bool convertGrayscaleFrame(camera_fb_t* fb, uint8_t* buf, int w, int h) {
   // If framebuffer is in RGB565 format, convert to grayscale easily
   if (fb->format == PIXFORMAT_RGB565 && fb->width >= w && fb->height >= h) {
-    // Simple nearest-neighbor downsample
-    for (int y = 0; y < h; y++) {
-      for (int x = 0; x < w; x++) {
-        int sx = x * fb->width / w;
-        int sy = y * fb->height / h;
-        int idx = sy * fb->width + sx;
-        uint16_t pix = ((uint16_t*)fb->buf)[idx];
-        // RGB565 -> approximate grayscale
-        uint8_t r = ((pix >> 11) & 0x1F) << 3;
-        uint8_t g = ((pix >> 5) & 0x3F) << 2;
-        uint8_t b = (pix & 0x1F) << 3;
-        uint8_t gray = (uint8_t)((0.3 * r) + (0.59 * g) + (0.11 * b));
-        buf[y * w + x] = gray;
-      }
-    }
-    esp_camera_fb_return(fb);
+    rgb565ToGray((const uint16_t*)fb->buf, fb->width, fb->height, buf, w, h);
     return true;
   }
 
   // If JPEG, we can try to extract luminance by rough sampling — heavy.
   // For now, we fail gracefully and inform the caller.
-  Serial.println("captureGrayscaleFrame: unsupported pixel format (need RGB565) — try changing camera config");
+  Serial.println("convertGrayscaleFrame: unsupported pixel format (need RGB565) — try changing camera config");
+  return false;
+}
+
+// Capture a grayscale frame resized to w*h
+bool captureGrayscaleFrame(uint8_t* buf, int w, int h) {
+  if (!buf) return false;
+  camera_fb_t* fb = captureCameraFrame();
+  if (!fb) return false;
+  bool ok = convertGrayscaleFrame(fb, buf, w, h);
   esp_camera_fb_return(fb);
+  return ok;
+}
+
+// ----- Ambiguous-event thumbnails -----
+
+const char* cameraThumbnailFormatName(CameraThumbnailFormat format) {
+  switch (format) {
+    case THUMBNAIL_JPEG: return "jpeg";
+    default: return "none";
+  }
+}
+
+// Compress currFrame. On success *out is heap memory the caller frees.
+bool encodeCameraThumbnail(CameraThumbnailFormat format, uint8_t** out, size_t* len) {
+  if (format == THUMBNAIL_JPEG) {
+    return fmt2jpg(currFrame, CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT, CAM_FRAME_WIDTH, CAM_FRAME_HEIGHT,
+                   PIXFORMAT_GRAYSCALE, CAMERA_THUMBNAIL_JPEG_QUALITY, out, len);
+  }
   return false;
 }
 
+// Encode one live frame in CAMERA_THUMBNAIL_FORMAT at boot and log time and
+// size, so the quality can be tuned from numbers measured on this board and
+// doorway.
+void benchmarkThumbnailEncoder() {
+  if (CAMERA_THUMBNAIL_FORMAT == THUMBNAIL_NONE ||
+      !captureGrayscaleFrame(currFrame, CAM_FRAME_WIDTH, CAM_FRAME_HEIGHT)) {
+    return;
+  }
+  uint8_t* data = NULL;
+  size_t len = 0;
+  unsigned long start = micros();
+  bool ok = encodeCameraThumbnail(CAMERA_THUMBNAIL_FORMAT, &data, &len);
+  unsigned long elapsed = micros() - start;
+  Serial.print("Thumbnail encoder "); Serial.print(cameraThumbnailFormatName(CAMERA_THUMBNAIL_FORMAT));
+  if (!ok) {
+    Serial.println(": failed");
+    return;
+  }
+  Serial.print(": "); Serial.print(len); Serial.print(" bytes (raw ");
+  Serial.print(CAM_FRAME_WIDTH * CAM_FRAME_HEIGHT); Serial.print("), ");
+  Serial.print(elapsed); Serial.println(" us");
+  free(data);
+}
+
+// Publish the frame that was just diffed as a thumbnail: meta JSON on
+// <base>/meta, the image on <base>/thumb. The image is streamed, since it
+// is larger than the PubSubClient buffer.
+void publishCameraThumbnail(int motionPixels) {
+  if (CAMERA_THUMBNAIL_FORMAT == THUMBNAIL_NONE || !mqttClient.connected()) {
+    return;
+  }
+  unsigned long now = millis();
+  if (cameraThumbnailsPublished > 0 && now - cameraLastThumbnailAt < CAMERA_THUMBNAIL_MIN_INTERVAL_MS) {
+    return;
+  }
+  uint8_t* data = NULL;
+  size_t len = 0;
+  unsigned long start = micros();
+  if (!encodeCameraThumbnail(CAMERA_THUMBNAIL_FORMAT, &data, &len)) {
+    Serial.println("Thumbnail encode failed");
+    return;
+  }
+  cameraThumbnailEncodeUs = micros() - start;
+  
+  JsonDocument meta;
+  meta["device_id"] = DEVICE_ID;
+  meta["timestamp"] = getCurrentUnixTime();
+  meta["event"] = "ambiguous_thumbnail";
+  meta["format"] = cameraThumbnailFormatName(CAMERA_THUMBNAIL_FORMAT);
+  meta["width"] = CAM_FRAME_WIDTH;
+  meta["height"] = CAM_FRAME_HEIGHT;
+  meta["size"] = len;
+  meta["encode_us"] = cameraThumbnailEncodeUs;
+  meta["motion_pixels"] = motionPixels;
+  String metaStr;
+  serializeJson(meta, metaStr);
+  String metaTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/meta";
+  mqttClient.publish(metaTopic.c_str(), metaStr.c_str());
+  
+  String thumbTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/thumb";
+  bool sent = mqttClient.beginPublish(thumbTopic.c_str(), len, false) &&
+              mqttClient.write(data, len) == len &&
+              mqttClient.endPublish();
+  free(data);
+  if (!sent) {
+    Serial.println("Thumbnail publish failed");
+    return;
+  }
+  cameraThumbnailsPublished++;
+  cameraLastThumbnailAt = now;
+  cameraThumbnailBytes = len;
+  Serial.print("Published "); Serial.print(cameraThumbnailFormatName(CAMERA_THUMBNAIL_FORMAT));
+  Serial.print(" thumbnail, "); Serial.print(len); Serial.print(" bytes, encoded in ");
+  Serial.print(cameraThumbnailEncodeUs); Serial.println(" us");
+}
+
 // Upload raw frame buffer to configured HTTP endpoint using multipart/form-data
 // Upload raw frame buffer to configured HTTP endpoint. Returns HTTP response body on success, empty string on failure.
 String uploadFrameToServer(const uint8_t* data, size_t len, const char* filename, const char* mimetype) {
@@ -1997,9 +4252,8 @@ String uploadFrameToServer(const uint8_t* data, size_t len, const char* filename
 
   if (CAMERA_FRAME_UPLOAD_METHOD == UPLOAD_HTTP_JWT) {
     if (strlen(CAMERA_FRAME_HTTP_ENDPOINT) == 0) return String("");
-    String jwt = generateJWT();
     http.begin(CAMERA_FRAME_HTTP_ENDPOINT);
-    http.addHeader("Authorization", "Bearer " + jwt);
+    http.addHeader("Authorization", String("Bearer ") + getJWT());
 
     String boundary = "----ESP32CAM" + String(millis());
     String contentType = "multipart/form-data; boundary=" + boundary;
@@ -2070,218 +4324,188 @@ String uploadFrameToServer(const uint8_t* data, size_t len, const char* filename
 }
 
 void processCameraFrame() {
-  // Capture into currFrame
-  if (!captureGrayscaleFrame(currFrame, CAM_FRAME_WIDTH, CAM_FRAME_HEIGHT)) {
+  camera_fb_t* fb = captureCameraFrame();
+  if (!fb) {
     return;
   }
-
-  // Compute per-column motion energy by summing difference across rows
-  int width = CAM_FRAME_WIDTH;
-  int height = CAM_FRAME_HEIGHT;
-  int centerX = width / 2;
-
-  int maxColSum = 0;
-  int maxColIndex = -1;
-  int totalMotionPixels = 0;
-
-  for (int x = 0; x < width; x++) {
-    int colSum = 0;
-    for (int y = 0; y < height; y++) {
-      int idx = y * width + x;
-      int diff = abs((int)currFrame[idx] - (int)prevFrame[idx]);
-      if (diff > CAM_DIFF_THRESHOLD) {
-        colSum++;
-        totalMotionPixels++;
-      }
-    }
-    if (colSum > maxColSum) {
-      maxColSum = colSum;
-      maxColIndex = x;
-    }
-  }
-
-  // Shift current to prev for next iteration
-  memcpy(prevFrame, currFrame, width * height);
-
-  // If insufficient motion, ignore
-  if (totalMotionPixels < CAM_MOTION_MIN_PIXELS) {
-    prevMotionX = -1;
+  if (fb->format != PIXFORMAT_RGB565 || fb->width < CAM_FRAME_WIDTH || fb->height < CAM_FRAME_HEIGHT) {
+    Serial.println("processCameraFrame: unsupported pixel format (need RGB565) — try changing camera config");
+    esp_camera_fb_return(fb);
     return;
   }
+  int motionPixels = 0;
+  CameraFrameResult result = detectCameraMotion((const uint16_t*)fb->buf, fb->width, fb->height, &motionPixels);
+  esp_camera_fb_return(fb);
 
-  Serial.print("Camera motion pixels: "); Serial.print(totalMotionPixels);
-  Serial.print(" | maxColIndex: "); Serial.print(maxColIndex);
-  Serial.print(" | prevMotionX: "); Serial.println(prevMotionX);
-
-  // Determine crossing based on previous motion X
-  if (prevMotionX >= 0) {
-    if (prevMotionX < centerX && maxColIndex >= centerX) {
-      // left->right crossing => enter
-      senseInCount++;
-      publishTrafficEvent("enter", senseInCount, senseOutCount);
-    } else if (prevMotionX > centerX && maxColIndex <= centerX) {
-      // right->left crossing => exit
-      senseOutCount++;
-      publishTrafficEvent("exit", senseInCount, senseOutCount);
-    } else {
-      // No clear crossing; if motion very large, treat as ambiguous
-      if (totalMotionPixels > CAM_AMBIGUOUS_PIXELS) {
-        // Capture a full JPEG frame and publish to MQTT for server-side processing
-        // Try to capture a JPEG frame (temporarily reconfigure camera to JPEG)
-        Serial.println("Ambiguous motion detected - attempting JPEG capture for upload");
-        camera_fb_t* fb = NULL;
-        // First try to get whatever frame driver currently provides
-        fb = esp_camera_fb_get();
-        if (fb && fb->format == PIXFORMAT_JPEG) {
-          // Already JPEG - use it directly
-          Serial.print("Captured ambiguous JPEG frame, size="); Serial.println(fb->len);
-          String topic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE);
-          if (mqttClient.connected()) {
-            // Publish metadata first
-            JsonDocument meta;
-            meta["device_id"] = DEVICE_ID;
-            meta["timestamp"] = getCurrentUnixTime();
-            meta["event"] = "ambiguous_frame";
-            meta["size"] = fb->len;
-            meta["format"] = "jpeg";
-            String metaStr;
-            serializeJson(meta, metaStr);
-            String metaTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/meta";
-            mqttClient.publish(metaTopic.c_str(), metaStr.c_str());
-            // Then publish binary
-            String binTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/bin";
-            mqttClient.publish(binTopic.c_str(), (const uint8_t*)fb->buf, fb->len);
-            Serial.print("Published ambiguous frame to MQTT topic: "); Serial.println(binTopic);
-          }
-          if (strlen(CAMERA_FRAME_HTTP_ENDPOINT) > 0) {
-            String resp = uploadFrameToServer((const uint8_t*)fb->buf, fb->len, "frame.jpg", "image/jpeg");
-            Serial.print("HTTP upload response: "); Serial.println(resp);
-            if (resp.length() > 0 && mqttClient.connected()) {
-              String urlTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/url";
-              mqttClient.publish(urlTopic.c_str(), resp.c_str());
-            }
+  if (result == CAM_FRAME_ENTER) {
+    senseInCount++;
+    publishTrafficEvent("enter", senseInCount, senseOutCount);
+  } else if (result == CAM_FRAME_EXIT) {
+    senseOutCount++;
+    publishTrafficEvent("exit", senseInCount, senseOutCount);
+  } else if (result == CAM_FRAME_AMBIGUOUS) {
+    publishCameraThumbnail(motionPixels);
+    if (CAMERA_AMBIGUOUS_FULL_RES) {
+      // Capture a full JPEG frame and publish to MQTT for server-side processing
+      // Try to capture a JPEG frame (temporarily reconfigure camera to JPEG)
+      Serial.println("Ambiguous motion detected - attempting JPEG capture for upload");
+      // First try to get whatever frame driver currently provides
+      fb = esp_camera_fb_get();
+      if (fb && fb->format == PIXFORMAT_JPEG) {
+        // Already JPEG - use it directly
+        Serial.print("Captured ambiguous JPEG frame, size="); Serial.println(fb->len);
+        cameraLastUploadBytes = fb->len;
+        String topic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE);
+        if (mqttClient.connected()) {
+          // Publish metadata first
+          JsonDocument meta;
+          meta["device_id"] = DEVICE_ID;
+          meta["timestamp"] = getCurrentUnixTime();
+          meta["event"] = "ambiguous_frame";
+          meta["size"] = fb->len;
+          meta["format"] = "jpeg";
+          String metaStr;
+          serializeJson(meta, metaStr);
+          String metaTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/meta";
+          mqttClient.publish(metaTopic.c_str(), metaStr.c_str());
+          // Then publish binary
+          String binTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/bin";
+          mqttClient.publish(binTopic.c_str(), (const uint8_t*)fb->buf, fb->len);
+          Serial.print("Published ambiguous frame to MQTT topic: "); Serial.println(binTopic);
+        }
+        if (strlen(CAMERA_FRAME_HTTP_ENDPOINT) > 0) {
+          String resp = uploadFrameToServer((const uint8_t*)fb->buf, fb->len, "frame.jpg", "image/jpeg");
+          Serial.print("HTTP upload response: "); Serial.println(resp);
+          if (resp.length() > 0 && mqttClient.connected()) {
+            String urlTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/url";
+            mqttClient.publish(urlTopic.c_str(), resp.c_str());
           }
-          esp_camera_fb_return(fb);
-        } else {
-          if (fb) { esp_camera_fb_return(fb); fb = NULL; }
-          // Attempt to re-init camera in JPEG mode, capture one frame, then restore RGB565
-          Serial.println("Reinitializing camera to JPEG mode for capture...");
-          // Deinitialize camera first to avoid invalid-state errors
-          Serial.println("Calling esp_camera_deinit() before JPEG reinit...");
-          esp_err_t deinit_r = esp_camera_deinit();
-          Serial.print("esp_camera_deinit() returned: "); Serial.println(deinit_r);
-          delay(100);
+        }
+        esp_camera_fb_return(fb);
+      } else {
+        if (fb) { esp_camera_fb_return(fb); fb = NULL; }
+        // Attempt to re-init camera in JPEG mode, capture one frame, then restore RGB565
+        Serial.println("Reinitializing camera to JPEG mode for capture...");
+        // Deinitialize camera first to avoid invalid-state errors
+        Serial.println("Calling esp_camera_deinit() before JPEG reinit...");
+        esp_err_t deinit_r = esp_camera_deinit();
+        Serial.print("esp_camera_deinit() returned: "); Serial.println(deinit_r);
+        delay(100);
 
-          camera_config_t jpegConfig;
-          memset(&jpegConfig, 0, sizeof(jpegConfig));
-          jpegConfig.ledc_channel = LEDC_CHANNEL_0;
-          jpegConfig.ledc_timer = LEDC_TIMER_0;
-          jpegConfig.pin_d0 = CAM_PIN_D0;
-          jpegConfig.pin_d1 = CAM_PIN_D1;
-          jpegConfig.pin_d2 = CAM_PIN_D2;
-          jpegConfig.pin_d3 = CAM_PIN_D3;
-          jpegConfig.pin_d4 = CAM_PIN_D4;
-          jpegConfig.pin_d5 = CAM_PIN_D5;
-          jpegConfig.pin_d6 = CAM_PIN_D6;
-          jpegConfig.pin_d7 = CAM_PIN_D7;
-          jpegConfig.pin_xclk = CAM_PIN_XCLK;
-          jpegConfig.pin_pclk = CAM_PIN_PCLK;
-          jpegConfig.pin_vsync = CAM_PIN_VSYNC;
-          jpegConfig.pin_href = CAM_PIN_HREF;
-          jpegConfig.pin_sccb_sda = CAM_PIN_SIOD;
-          jpegConfig.pin_sccb_scl = CAM_PIN_SIOC;
-          jpegConfig.pin_pwdn = CAM_PIN_PWDN;
-          jpegConfig.pin_reset = CAM_PIN_RESET;
-          jpegConfig.xclk_freq_hz = CAMERA_JPEG_XCLK_HZ;
-          jpegConfig.pixel_format = PIXFORMAT_JPEG;
-          jpegConfig.frame_size = CAMERA_JPEG_FRAME_SIZE;
-          jpegConfig.jpeg_quality = CAMERA_JPEG_QUALITY;
-          jpegConfig.fb_count = 1;
-
-          // Try to init JPEG mode (try once, log error on failure)
-          esp_err_t r = esp_camera_init(&jpegConfig);
-          if (r == ESP_OK) {
-            camera_fb_t* jfb = esp_camera_fb_get();
-            if (jfb) {
-              Serial.print("Captured JPEG frame after reinit, size="); Serial.println(jfb->len);
-              if (mqttClient.connected()) {
-                // Publish metadata first
-                JsonDocument meta;
-                meta["device_id"] = DEVICE_ID;
-                meta["timestamp"] = getCurrentUnixTime();
-                meta["event"] = "ambiguous_frame";
-                meta["size"] = jfb->len;
-                meta["format"] = "jpeg";
-                String metaStr;
-                serializeJson(meta, metaStr);
-                String metaTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/meta";
-                mqttClient.publish(metaTopic.c_str(), metaStr.c_str());
-
-                // Then publish binary
-                String binTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/bin";
-                mqttClient.publish(binTopic.c_str(), (const uint8_t*)jfb->buf, jfb->len);
-              }
-              if (strlen(CAMERA_FRAME_HTTP_ENDPOINT) > 0) {
-                String resp = uploadFrameToServer((const uint8_t*)jfb->buf, jfb->len, "frame.jpg", "image/jpeg");
-                Serial.print("HTTP upload response: "); Serial.println(resp);
-                if (resp.length() > 0 && mqttClient.connected()) {
-                  String urlTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/url";
-                  mqttClient.publish(urlTopic.c_str(), resp.c_str());
-                }
-              }
-              esp_camera_fb_return(jfb);
-            } else {
-              Serial.println("Failed to capture JPEG frame after reinit");
+        camera_config_t jpegConfig;
+        memset(&jpegConfig, 0, sizeof(jpegConfig));
+        jpegConfig.ledc_channel = LEDC_CHANNEL_0;
+        jpegConfig.ledc_timer = LEDC_TIMER_0;
+        jpegConfig.pin_d0 = CAM_PIN_D0;
+        jpegConfig.pin_d1 = CAM_PIN_D1;
+        jpegConfig.pin_d2 = CAM_PIN_D2;
+        jpegConfig.pin_d3 = CAM_PIN_D3;
+        jpegConfig.pin_d4 = CAM_PIN_D4;
+        jpegConfig.pin_d5 = CAM_PIN_D5;
+        jpegConfig.pin_d6 = CAM_PIN_D6;
+        jpegConfig.pin_d7 = CAM_PIN_D7;
+        jpegConfig.pin_xclk = CAM_PIN_XCLK;
+        jpegConfig.pin_pclk = CAM_PIN_PCLK;
+        jpegConfig.pin_vsync = CAM_PIN_VSYNC;
+        jpegConfig.pin_href = CAM_PIN_HREF;
+        jpegConfig.pin_sccb_sda = CAM_PIN_SIOD;
+        jpegConfig.pin_sccb_scl = CAM_PIN_SIOC;
+        jpegConfig.pin_pwdn = CAM_PIN_PWDN;
+        jpegConfig.pin_reset = CAM_PIN_RESET;
+        jpegConfig.xclk_freq_hz = CAMERA_JPEG_XCLK_HZ;
+        jpegConfig.pixel_format = PIXFORMAT_JPEG;
+        jpegConfig.frame_size = CAMERA_JPEG_FRAME_SIZE;
+        jpegConfig.jpeg_quality = CAMERA_JPEG_QUALITY;
+        jpegConfig.fb_count = 1;
+
+        // Try to init JPEG mode (try once, log error on failure)
+        esp_err_t r = esp_camera_init(&jpegConfig);
+        if (r == ESP_OK) {
+          camera_fb_t* jfb = esp_camera_fb_get();
+          if (jfb) {
+            Serial.print("Captured JPEG frame after reinit, size="); Serial.println(jfb->len);
+            cameraLastUploadBytes = jfb->len;
+            if (mqttClient.connected()) {
+              // Publish metadata first
+              JsonDocument meta;
+              meta["device_id"] = DEVICE_ID;
+              meta["timestamp"] = getCurrentUnixTime();
+              meta["event"] = "ambiguous_frame";
+              meta["size"] = jfb->len;
+              meta["format"] = "jpeg";
+              String metaStr;
+              serializeJson(meta, metaStr);
+              String metaTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/meta";
+              mqttClient.publish(metaTopic.c_str(), metaStr.c_str());
+
+              // Then publish binary
+              String binTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/bin";
+              mqttClient.publish(binTopic.c_str(), (const uint8_t*)jfb->buf, jfb->len);
             }
-            // Attempt to restore RGB565 mode for continued frame-diff processing
-            Serial.println("Restoring camera to RGB565 mode...");
-            // Deinit before restoring
-            esp_err_t deinit2 = esp_camera_deinit();
-            Serial.print("esp_camera_deinit() returned (before restoring RGB): "); Serial.println(deinit2);
-            delay(100);
-            camera_config_t rgbConfig;
-            memset(&rgbConfig, 0, sizeof(rgbConfig));
-            rgbConfig.ledc_channel = LEDC_CHANNEL_0;
-            rgbConfig.ledc_timer = LEDC_TIMER_0;
-            rgbConfig.pin_d0 = CAM_PIN_D0;
-            rgbConfig.pin_d1 = CAM_PIN_D1;
-            rgbConfig.pin_d2 = CAM_PIN_D2;
-            rgbConfig.pin_d3 = CAM_PIN_D3;
-            rgbConfig.pin_d4 = CAM_PIN_D4;
-            rgbConfig.pin_d5 = CAM_PIN_D5;
-            rgbConfig.pin_d6 = CAM_PIN_D6;
-            rgbConfig.pin_d7 = CAM_PIN_D7;
-            rgbConfig.pin_xclk = CAM_PIN_XCLK;
-            rgbConfig.pin_pclk = CAM_PIN_PCLK;
-            rgbConfig.pin_vsync = CAM_PIN_VSYNC;
-            rgbConfig.pin_href = CAM_PIN_HREF;
-            rgbConfig.pin_sccb_sda = CAM_PIN_SIOD;
-            rgbConfig.pin_sccb_scl = CAM_PIN_SIOC;
-            rgbConfig.pin_pwdn = CAM_PIN_PWDN;
-            rgbConfig.pin_reset = CAM_PIN_RESET;
-            rgbConfig.xclk_freq_hz = 20000000;
-            rgbConfig.pixel_format = PIXFORMAT_RGB565;
-            rgbConfig.frame_size = FRAMESIZE_QQVGA;
-            rgbConfig.jpeg_quality = 12;
-            rgbConfig.fb_count = 1;
-            esp_err_t r2 = esp_camera_init(&rgbConfig);
-            if (r2 != ESP_OK) {
-              Serial.print("Failed to restore RGB565 camera mode: "); Serial.println(r2);
-              cameraAvailable = false;
+            if (strlen(CAMERA_FRAME_HTTP_ENDPOINT) > 0) {
+              String resp = uploadFrameToServer((const uint8_t*)jfb->buf, jfb->len, "frame.jpg", "image/jpeg");
+              Serial.print("HTTP upload response: "); Serial.println(resp);
+              if (resp.length() > 0 && mqttClient.connected()) {
+                String urlTopic = deviceHostname + "/" + String(CAMERA_FRAME_TOPIC_BASE) + "/url";
+                mqttClient.publish(urlTopic.c_str(), resp.c_str());
+              }
             }
+            esp_camera_fb_return(jfb);
+          } else {
+            Serial.println("Failed to capture JPEG frame after reinit");
+          }
+          // Attempt to restore RGB565 mode for continued frame-diff processing
+          Serial.println("Restoring camera to RGB565 mode...");
+          // Deinit before restoring
+          esp_err_t deinit2 = esp_camera_deinit();
+          Serial.print("esp_camera_deinit() returned (before restoring RGB): "); Serial.println(deinit2);
+          delay(100);
+          camera_config_t rgbConfig;
+          memset(&rgbConfig, 0, sizeof(rgbConfig));
+          rgbConfig.ledc_channel = LEDC_CHANNEL_0;
+          rgbConfig.ledc_timer = LEDC_TIMER_0;
+          rgbConfig.pin_d0 = CAM_PIN_D0;
+          rgbConfig.pin_d1 = CAM_PIN_D1;
+          rgbConfig.pin_d2 = CAM_PIN_D2;
+          rgbConfig.pin_d3 = CAM_PIN_D3;
+          rgbConfig.pin_d4 = CAM_PIN_D4;
+          rgbConfig.pin_d5 = CAM_PIN_D5;
+          rgbConfig.pin_d6 = CAM_PIN_D6;
+          rgbConfig.pin_d7 = CAM_PIN_D7;
+          rgbConfig.pin_xclk = CAM_PIN_XCLK;
+          rgbConfig.pin_pclk = CAM_PIN_PCLK;
+          rgbConfig.pin_vsync = CAM_PIN_VSYNC;
+          rgbConfig.pin_href = CAM_PIN_HREF;
+          rgbConfig.pin_sccb_sda = CAM_PIN_SIOD;
+          rgbConfig.pin_sccb_scl = CAM_PIN_SIOC;
+          rgbConfig.pin_pwdn = CAM_PIN_PWDN;
+          rgbConfig.pin_reset = CAM_PIN_RESET;
+          rgbConfig.xclk_freq_hz = 20000000;
+          rgbConfig.pixel_format = PIXFORMAT_RGB565;
+          rgbConfig.frame_size = FRAMESIZE_QQVGA;
+          rgbConfig.jpeg_quality = 12;
+          rgbConfig.fb_count = 1;
+          esp_err_t r2 = esp_camera_init(&rgbConfig);
+          if (r2 != ESP_OK) {
+            Serial.print("Failed to restore RGB565 camera mode: "); Serial.println(r2);
+            cameraAvailable = false;
           } else {
-            Serial.print("Failed to reinit camera to JPEG mode: "); Serial.println(r);
+            cameraExposureLocked = false; // fresh sensor state: converge and lock again
           }
+        } else {
+          Serial.print("Failed to reinit camera to JPEG mode: "); Serial.println(r);
         }
       }
     }
   }
-
-  prevMotionX = maxColIndex;
 }
 #else
 bool initializeCameraModule() { Serial.println("Camera not supported on this platform"); return false; }
 bool captureGrayscaleFrame(uint8_t* buf, int w, int h) { (void)buf; (void)w; (void)h; return false; }
+void setCameraAutoExposure(bool enabled) { (void)enabled; }
+void benchmarkCameraCapture(const char* label) { (void)label; }
+void benchmarkThumbnailEncoder() { }
+void publishCameraThumbnail(int motionPixels) { (void)motionPixels; }
 void processCameraFrame() { }
 #endif
 
@@ -2499,6 +4723,12 @@ void updateAttachments() {
     unsigned long timeSinceLastActivity = max(now - lastMQTTSend, now - lastMQTTReceive);
     if (timeSinceLastActivity > MQTT_FLASH_DURATION + MQTT_BLACKOUT_DURATION) {
       inMQTTBlackout = false;
+      if (otaInProgress) {
+        // Publishes during OTA briefly take over the LEDs; restore the OTA indicator
+        setLEDStatus(currentOTAStatus == OTA_VALIDATING ? LED_OTA_VALIDATING :
+                     currentOTAStatus == OTA_INSTALLING ? LED_OTA_INSTALLING : LED_OTA_DOWNLOADING);
+        return;
+      }
       Serial.println("Resuming breathing after blackout");
       setLEDStatus(LED_MQTT_CONNECTED);
       resetBreathingAnimation();
@@ -2521,7 +4751,7 @@ void updateAttachments() {
 
     case LED_MQTT_CONNECTED:
       // For MQ7 sensor, show air quality status with breathing LED
-      if (SENSOR == SENSOR_MQ7_GAS) {
+      if (sensorActive(SENSOR_MQ7_GAS)) {
         switch (currentGasLevel) {
           case GAS_LOW:
             attachmentBreathe(CRGB::Green, 5000);  // Green = safe
@@ -2551,8 +4781,8 @@ void updateAttachments() {
       break;
 
     case LED_OTA_DOWNLOADING:
-      // This will be updated with actual progress in OTA functions
-      attachmentSpinning(CRGB::Orange, 100); // Spinning (if supported)
+      // Progress bar driven by the OTA download slices
+      attachmentSetProgress(otaProgress, CRGB::Orange);
       break;
 
     case LED_OTA_VALIDATING:
@@ -0,0 +1,60 @@
+// MQ7 continuous sampling: the ADC DMA driver samples at 1 kHz, a 5-tap
+// median rejects spikes, blocks of 10 are averaged (100 Hz) and smoothed by a
+// single-pole IIR in fixed point. Plain C++, no Arduino dependencies; the
+// host tests in test/native replay and time it.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+const uint32_t MQ7_SAMPLE_RATE_HZ = 1000;
+const int MQ7_MEDIAN_TAPS = 5;
+const int MQ7_DECIMATION = 10;
+const int MQ7_IIR_SHIFT = 3;                    // y += (x - y) / 8
+struct GasFilter {
+  uint16_t median[MQ7_MEDIAN_TAPS];
+  int medianPos;
+  int medianFill;
+  uint32_t decimSum;
+  int decimCount;
+  int32_t iir; // ADC code << 8
+  bool primed;
+};
+GasFilter gasFilter;
+uint16_t gasFilteredCode = 0;
+
+// Feed one raw ADC code; returns true when a new filtered value is ready
+bool gasFilterPush(uint16_t code) {
+  GasFilter& f = gasFilter;
+  f.median[f.medianPos] = code;
+  f.medianPos = (f.medianPos + 1) % MQ7_MEDIAN_TAPS;
+  if (f.medianFill < MQ7_MEDIAN_TAPS) {
+    f.medianFill++;
+    return false;
+  }
+  
+  uint16_t sorted[MQ7_MEDIAN_TAPS];
+  memcpy(sorted, f.median, sizeof(sorted));
+  for (int i = 1; i < MQ7_MEDIAN_TAPS; i++) {
+    for (int j = i; j > 0 && sorted[j] < sorted[j - 1]; j--) {
+      uint16_t t = sorted[j]; sorted[j] = sorted[j - 1]; sorted[j - 1] = t;
+    }
+  }
+  
+  f.decimSum += sorted[MQ7_MEDIAN_TAPS / 2];
+  if (++f.decimCount < MQ7_DECIMATION) {
+    return false;
+  }
+  int32_t decimated = (int32_t)((f.decimSum << 8) / MQ7_DECIMATION);
+  f.decimSum = 0;
+  f.decimCount = 0;
+  
+  if (!f.primed) {
+    f.iir = decimated;
+    f.primed = true;
+  } else {
+    f.iir += (decimated - f.iir) >> MQ7_IIR_SHIFT;
+  }
+  gasFilteredCode = (uint16_t)((f.iir + 128) >> 8);
+  return true;
+}
@@ -0,0 +1,76 @@
+// MQ7 calibration constants and the ADC code -> ppm lookup table. Needs
+// micros() and Serial from the includer; the host tests in test/native
+// build it against arduino_shim.h.
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// MQ7 Calibration parameters
+const float MQ7_RL = 10.0;        // Load resistance in kOhms
+const float MQ7_RO = 10.0;        // R0 calibration (can be adjusted)
+const float MQ7_VCC = 3.3;        // Supply voltage
+const float MQ7_ADC_MAX = 4095.0; // ESP32 ADC resolution
+
+// MQ7 Gas Response Curve Parameters for CO (ppm)
+// Sensitivity: Rs/R0 = a * (ppm)^b
+const float CO_CURVE_A = 116.6;   // Curve coefficient
+const float CO_CURVE_B = -2.769;  // Curve exponent
+
+// ADC code -> ppm for the current calibration, so the 100 Hz filter output
+// costs a table read instead of a divide chain and pow()
+const int MQ7_PPM_TABLE_SIZE = 4096;
+float mq7PpmTable[MQ7_PPM_TABLE_SIZE];
+float mq7R0 = 0.0; // R0 the table was built for
+
+float mq7CodeToPpm(uint16_t code) {
+  if (code >= MQ7_PPM_TABLE_SIZE) {
+    code = MQ7_PPM_TABLE_SIZE - 1;
+  }
+  return mq7PpmTable[code];
+}
+
+// Reference conversion; only used to fill the table
+// (test/native/test_mq7_ppm_table.cpp checks the table against it)
+float mq7FormulaPpm(uint16_t code, float r0) {
+  // Full scale means Rs is below what the ADC can resolve (CO far off the
+  // curve); read it as the code below instead of letting Rs = 0 give 0 ppm
+  if (code >= MQ7_ADC_MAX) {
+    code = MQ7_ADC_MAX - 1;
+  }
+  float voltage = (code / MQ7_ADC_MAX) * MQ7_VCC;
+  if (voltage <= 0) {
+    return 0.0;
+  }
+  // Vout = VCC * RL / (RS + RL)  =>  RS = RL * (VCC / Vout - 1)
+  float rs = MQ7_RL * (MQ7_VCC / voltage - 1.0);
+  float ratio = rs / r0;
+  if (ratio <= 0) {
+    return 0.0;
+  }
+  // Rs/R0 = a * ppm^b, fitted as ppm = a * ratio^b
+  float ppm = CO_CURVE_A * pow(ratio, CO_CURVE_B);
+  return ppm < 0 ? 0.0 : ppm;
+}
+
+float mq7CodeToRs(uint16_t code) {
+  float voltage = (code / MQ7_ADC_MAX) * MQ7_VCC;
+  if (voltage <= 0) {
+    return 0.0;
+  }
+  return MQ7_RL * (MQ7_VCC / voltage - 1.0);
+}
+
+// Call again whenever R0 changes
+void buildMQ7PpmTable(float r0) {
+  unsigned long start = micros();
+  for (int code = 0; code < MQ7_PPM_TABLE_SIZE; code++) {
+    mq7PpmTable[code] = mq7FormulaPpm(code, r0);
+  }
+  mq7R0 = r0;
+  Serial.print("MQ7 ppm table built for R0 = ");
+  Serial.print(r0, 2);
+  Serial.print(" kΩ in ");
+  Serial.print(micros() - start);
+  Serial.println(" us");
+}
@@ -0,0 +1,66 @@
+// Outbound messages held while the MQTT session is down (including a failed
+// reconnect onto a fresh token), flushed as soon as it is back. Needs Serial from the includer; the host
+// tests in test/native build it against arduino_shim.h.
+#pragma once
+
+#include <string.h>
+
+// PubSubClient packet buffer: the CONNECT with its JWT password and the
+// largest sensor report both have to fit
+const int MQTT_BUFFER_SIZE = 1024;
+// Fixed header (up to 5 bytes) plus the topic length field
+const int MQTT_PACKET_OVERHEAD = 7;
+
+// A slot takes any payload PubSubClient could send in one packet, so every
+// report that can be published can also be queued
+// (test/native/test_report_payload.cpp checks the largest summaries). That
+// makes the outbox 8 x (64 + MQTT_BUFFER_SIZE) = 8.5 kB of static RAM, and
+// 8 messages is four minutes of 30 s temperature reports, less once gas
+// summaries, traffic events or alerts queue too; a longer outage loses the
+// oldest.
+const int MQTT_OUTBOX_SIZE = 8;
+struct MQTTOutboxMessage {
+  char topic[64];
+  char payload[MQTT_BUFFER_SIZE];
+};
+MQTTOutboxMessage mqttOutbox[MQTT_OUTBOX_SIZE];
+int mqttOutboxHead = 0;
+int mqttOutboxCount = 0;
+unsigned long mqttOutboxDropped = 0;
+
+// Queue a copy; the oldest message is overwritten when the outbox is full.
+// Returns false (and counts a drop) if the message doesn't fit a slot or
+// could never be sent in one packet, which would wedge the flush.
+bool mqttOutboxPush(const char* topic, const char* payload) {
+  size_t topicLen = strlen(topic);
+  size_t payloadLen = strlen(payload);
+  if (topicLen >= sizeof(mqttOutbox[0].topic) ||
+      MQTT_PACKET_OVERHEAD + topicLen + payloadLen > (size_t)MQTT_BUFFER_SIZE) {
+    Serial.println("Message too large for MQTT outbox - dropped");
+    mqttOutboxDropped++;
+    return false;
+  }
+  
+  if (mqttOutboxCount == MQTT_OUTBOX_SIZE) {
+    mqttOutboxHead = (mqttOutboxHead + 1) % MQTT_OUTBOX_SIZE;
+    mqttOutboxCount--;
+    mqttOutboxDropped++;
+  }
+  MQTTOutboxMessage& msg = mqttOutbox[(mqttOutboxHead + mqttOutboxCount) % MQTT_OUTBOX_SIZE];
+  memcpy(msg.topic, topic, topicLen + 1);
+  memcpy(msg.payload, payload, payloadLen + 1);
+  mqttOutboxCount++;
+  return true;
+}
+
+// Oldest queued message, or NULL when the outbox is empty
+const MQTTOutboxMessage* mqttOutboxFront() {
+  return mqttOutboxCount > 0 ? &mqttOutbox[mqttOutboxHead] : NULL;
+}
+
+void mqttOutboxPop() {
+  if (mqttOutboxCount > 0) {
+    mqttOutboxHead = (mqttOutboxHead + 1) % MQTT_OUTBOX_SIZE;
+    mqttOutboxCount--;
+  }
+}
@@ -0,0 +1,137 @@
+// Deadband reporting: a reading is published only when one of its metrics
+// moved at least its deadband away from the last value the backend got, or
+// when nothing has been published for REPORT_MAX_SILENCE_MS (heartbeat).
+// Each payload carries last_value_unchanged_since so the backend can tell a
+// quiet sensor from a dead one.
+//
+// Needs JsonDocument from the includer, which also defines
+// getCurrentUnixTime() and currentGasLevel; the host tests in test/native
+// build it against arduino_shim.h.
+#pragma once
+
+#include <math.h>
+#include "sensor_registry.h"
+
+const unsigned long REPORT_MAX_SILENCE_MS = 600000; // 10 minutes
+const float GAS_HYSTERESIS_FRACTION = 0.1; // step a gas level down only 10% below its threshold
+
+// Gas level thresholds (for MQ7)
+enum GasLevel {
+  GAS_LOW,        // < 5 ppm - Green (safe)
+  GAS_MEDIUM,     // 5-15 ppm - Yellow (caution)
+  GAS_HIGH,       // 15-35 ppm - Orange (warning)
+  GAS_CRITICAL    // > 35 ppm - Red (danger)
+};
+const float GAS_MEDIUM_PPM = 5.0;
+const float GAS_HIGH_PPM = 15.0;
+const float GAS_CRITICAL_PPM = 35.0;
+
+extern GasLevel currentGasLevel; // after hysteresis
+unsigned long getCurrentUnixTime();
+
+struct ReportMetric {
+  SensorType type;
+  const char* key; // numeric field in the serialized payload
+  float deadband;  // publish when it moves at least this far
+};
+// The window extremes carry their metric's deadband, so a short excursion
+// between two quiet reports goes out with the report that first sees it
+const ReportMetric REPORT_METRICS[] = {
+  {SENSOR_DHT_TEMP, "temperature", 0.2}, // °C
+  {SENSOR_DHT_TEMP, "temperature_min", 0.2},
+  {SENSOR_DHT_TEMP, "temperature_max", 0.2},
+  {SENSOR_DHT_TEMP, "humidity", 1.0},    // %RH
+  {SENSOR_DHT_TEMP, "humidity_min", 1.0},
+  {SENSOR_DHT_TEMP, "humidity_max", 1.0},
+  {SENSOR_MQ7_GAS, "ppm", 1.0},
+  {SENSOR_MQ7_GAS, "ppm_max", 2.0},      // spikes inside the window
+};
+const int REPORT_METRIC_COUNT = sizeof(REPORT_METRICS) / sizeof(REPORT_METRICS[0]);
+struct ReportState {
+  bool published;
+  unsigned long lastPublishAt;       // millis()
+  unsigned long changedAt;           // unix time of the last significant change
+  float last[REPORT_METRIC_COUNT];   // last published value, indexed like REPORT_METRICS
+  GasLevel lastGasLevel;
+};
+ReportState reportStates[MAX_SENSOR_DRIVERS];
+unsigned long reportsPublished = 0;
+unsigned long reportsSuppressed = 0;
+
+GasLevel categorizeGasLevel(float ppm) {
+  if (ppm < GAS_MEDIUM_PPM) {
+    return GAS_LOW;
+  } else if (ppm < GAS_HIGH_PPM) {
+    return GAS_MEDIUM;
+  } else if (ppm < GAS_CRITICAL_PPM) {
+    return GAS_HIGH;
+  }
+  return GAS_CRITICAL;
+}
+
+// Escalate at the thresholds, but only step down once the reading is
+// GAS_HYSTERESIS_FRACTION below them, so a value sitting on a threshold
+// doesn't flap the LED, the alerts and the reports
+GasLevel applyGasHysteresis(GasLevel current, float ppm) {
+  GasLevel raw = categorizeGasLevel(ppm);
+  if (raw >= current) {
+    return raw;
+  }
+  GasLevel lowered = categorizeGasLevel(ppm * (1.0 + GAS_HYSTERESIS_FRACTION));
+  return lowered < current ? lowered : current;
+}
+
+const char* gasLevelName(GasLevel level) {
+  switch (level) {
+    case GAS_LOW: return "LOW";
+    case GAS_MEDIUM: return "MEDIUM";
+    case GAS_HIGH: return "HIGH";
+    case GAS_CRITICAL: return "CRITICAL";
+  }
+  return "UNKNOWN";
+}
+
+// Decide whether a serialized reading is worth publishing (see
+// REPORT_METRICS); adds last_value_unchanged_since when it is. Nothing is
+// remembered until reportPublished() confirms the backend got it.
+bool reportDue(int driverIndex, JsonDocument& doc) {
+  ReportState& state = reportStates[driverIndex];
+  SensorType type = sensorDrivers[driverIndex].type;
+  unsigned long now = millis();
+
+  bool changed = !state.published;
+  for (int i = 0; i < REPORT_METRIC_COUNT; i++) {
+    if (REPORT_METRICS[i].type == type && doc[REPORT_METRICS[i].key].is<float>() &&
+        fabs(doc[REPORT_METRICS[i].key].as<float>() - state.last[i]) >= REPORT_METRICS[i].deadband) {
+      changed = true;
+    }
+  }
+  if (type == SENSOR_MQ7_GAS && currentGasLevel != state.lastGasLevel) {
+    changed = true;
+  }
+  if (!changed && now - state.lastPublishAt < REPORT_MAX_SILENCE_MS) {
+    reportsSuppressed++;
+    return false;
+  }
+
+  doc["last_value_unchanged_since"] = changed ? getCurrentUnixTime() : state.changedAt;
+  return true;
+}
+
+// The report reportDue() passed went out. Deadbands are measured from what
+// the backend last saw (heartbeats included), never from the previous
+// reading, so slow drift adds up.
+void reportPublished(int driverIndex, JsonDocument& doc) {
+  ReportState& state = reportStates[driverIndex];
+  SensorType type = sensorDrivers[driverIndex].type;
+  for (int i = 0; i < REPORT_METRIC_COUNT; i++) {
+    if (REPORT_METRICS[i].type == type && doc[REPORT_METRICS[i].key].is<float>()) {
+      state.last[i] = doc[REPORT_METRICS[i].key].as<float>();
+    }
+  }
+  state.lastGasLevel = currentGasLevel;
+  state.changedAt = doc["last_value_unchanged_since"].as<unsigned long>();
+  state.published = true;
+  state.lastPublishAt = millis();
+  reportsPublished++;
+}
@@ -0,0 +1,136 @@
+// Deadline scheduler: subsystems register periodic or one-shot tasks and
+// loop() sleeps until the earliest deadline, or until an event callback
+// wakes it with a task notification.
+//
+// Only needs millis(), micros() and Serial from the includer, so the host
+// tests in test/native build it against a fake clock (arduino_shim.h).
+#pragma once
+
+typedef void (*TaskCallback)();
+struct ScheduledTask {
+  const char* name;
+  TaskCallback callback;
+  unsigned long period; // 0 = one-shot, disarmed after it runs
+  unsigned long due;    // millis() deadline
+  bool armed;
+  int owner;            // index into sensorDrivers, -1 for system tasks
+};
+const int MAX_SCHEDULED_TASKS = 16;
+ScheduledTask scheduledTasks[MAX_SCHEDULED_TASKS];
+int scheduledTaskCount = 0;
+const unsigned long SCHEDULER_MAX_SLEEP_MS = 1000;
+
+// Scheduler instrumentation: how late tasks run against their deadline
+// (loop jitter) and how much of the time loop() spends asleep
+unsigned long schedLateMaxMs = 0;
+unsigned long schedLateTotalMs = 0;
+unsigned long schedRunCount = 0;
+unsigned long schedSleepTotalMs = 0;
+// Longest single task callback, i.e. the worst stall seen by everything else
+unsigned long schedStallMaxUs = 0;
+const char* schedStallTask = "";
+
+// Per-driver share of the above, for tasks with an owner
+struct SensorDriverStats {
+  unsigned long runs;
+  unsigned long lateMaxMs;
+  unsigned long runMaxUs;
+  unsigned long runTotalUs;
+};
+const int MAX_SENSOR_DRIVERS = 8;
+SensorDriverStats sensorDriverStats[MAX_SENSOR_DRIVERS];
+
+int addScheduledTask(const char* name, TaskCallback callback, unsigned long period,
+                     unsigned long firstDelay, bool armed) {
+  if (scheduledTaskCount >= MAX_SCHEDULED_TASKS) {
+    Serial.print("Scheduler full, dropping task: ");
+    Serial.println(name);
+    return -1;
+  }
+  ScheduledTask& task = scheduledTasks[scheduledTaskCount];
+  task.name = name;
+  task.callback = callback;
+  task.period = period;
+  task.due = millis() + firstDelay;
+  task.armed = armed;
+  task.owner = -1;
+  return scheduledTaskCount++;
+}
+
+// (Re)arm a task to run delayMs from now; for periodic tasks this also
+// restarts their cadence
+void armScheduledTask(int id, unsigned long delayMs) {
+  if (id < 0 || id >= scheduledTaskCount) {
+    return;
+  }
+  scheduledTasks[id].due = millis() + delayMs;
+  scheduledTasks[id].armed = true;
+}
+
+void disarmScheduledTask(int id) {
+  if (id >= 0 && id < scheduledTaskCount) {
+    scheduledTasks[id].armed = false;
+  }
+}
+
+// Run every task whose deadline has passed; returns ms until the next one
+unsigned long runDueTasks() {
+  for (int i = 0; i < scheduledTaskCount; i++) {
+    ScheduledTask& task = scheduledTasks[i];
+    unsigned long now = millis();
+    if (!task.armed || (long)(now - task.due) < 0) {
+      continue;
+    }
+
+    unsigned long late = now - task.due;
+    if (late > schedLateMaxMs) {
+      schedLateMaxMs = late;
+    }
+    schedLateTotalMs += late;
+    schedRunCount++;
+
+    if (task.period == 0) {
+      task.armed = false;
+    } else {
+      // Keep the cadence, but don't replay missed periods in a burst
+      task.due += task.period;
+      if ((long)(now - task.due) >= 0) {
+        task.due = now + task.period;
+      }
+    }
+    unsigned long started = micros();
+    task.callback();
+    unsigned long ranUs = micros() - started;
+    if (ranUs > schedStallMaxUs) {
+      schedStallMaxUs = ranUs;
+      schedStallTask = task.name;
+    }
+    if (task.owner >= 0) {
+      SensorDriverStats& stats = sensorDriverStats[task.owner];
+      stats.runs++;
+      stats.runTotalUs += ranUs;
+      if (ranUs > stats.runMaxUs) {
+        stats.runMaxUs = ranUs;
+      }
+      if (late > stats.lateMaxMs) {
+        stats.lateMaxMs = late;
+      }
+    }
+  }
+
+  unsigned long now = millis();
+  unsigned long sleepMs = SCHEDULER_MAX_SLEEP_MS;
+  for (int i = 0; i < scheduledTaskCount; i++) {
+    if (!scheduledTasks[i].armed) {
+      continue;
+    }
+    long untilDue = (long)(scheduledTasks[i].due - now);
+    if (untilDue <= 0) {
+      return 0;
+    }
+    if ((unsigned long)untilDue < sleepMs) {
+      sleepMs = untilDue;
+    }
+  }
+  return sleepMs;
+}
@@ -0,0 +1,128 @@
+// Sensor driver registry: the driver descriptor, the enabled-driver mask
+// read from NVS, and the scheduler tasks each enabled driver gets.
+//
+// The table itself (sensorDrivers[]) is defined next to the driver functions
+// in main.cpp; the host tests in test/native define a table of mock drivers
+// instead. Needs String, Serial and JsonDocument from the includer.
+#pragma once
+
+#include "scheduler.h"
+
+// Sensor configuration
+enum SensorType {
+  SENSOR_DHT_TEMP,        // Temperature and Humidity (DHT22 or similar)
+  SENSOR_MQ7_GAS,         // MQ7 Gas Sensor (CO detector)
+  SENSOR_SENSE,           // Overhead doorway sense (two-beam direction sensor)
+  SENSOR_SENSE_CAMERA     // Camera-based overhead doorway sensor (OV5640/OV2640)
+};
+
+// Sensor drivers. Each enabled driver gets a poll task (fast servicing such
+// as edge replay or DMA draining) and a sample task (take or start a reading)
+// at its own period; serialize fills the payload for <host>/sensors/<topic>
+// and published clears the report window once that payload actually went out.
+struct SensorDriver {
+  SensorType type;
+  const char* name;           // used in the NVS/MQTT sensor list
+  const char* topic;          // NULL if the driver publishes on its own topics
+  void (*init)();
+  void (*poll)();
+  unsigned long pollPeriod;   // 0 = no poll task (init may clear it)
+  void (*sample)();
+  unsigned long samplePeriod; // 0 = no sample task (init may clear it)
+  bool (*serialize)(JsonDocument& doc);
+  void (*published)();        // NULL if nothing accumulates between reports
+};
+uint32_t enabledSensors = 0; // bit per SensorType
+extern SensorDriver sensorDrivers[]; // registry, defined with the driver functions
+extern const int SENSOR_DRIVER_COUNT;
+
+bool sensorActive(SensorType type) {
+  return enabledSensors & (1UL << type);
+}
+
+SensorDriver* findSensorDriver(SensorType type) {
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    if (sensorDrivers[i].type == type) {
+      return &sensorDrivers[i];
+    }
+  }
+  return NULL;
+}
+
+// "mq7,sense_camera" -> bitmask; unknown names are reported and skipped
+uint32_t parseSensorList(const String& list) {
+  uint32_t mask = 0;
+  int start = 0;
+  while (start <= (int)list.length()) {
+    int comma = list.indexOf(',', start);
+    if (comma < 0) {
+      comma = list.length();
+    }
+    String name = list.substring(start, comma);
+    name.trim();
+    start = comma + 1;
+    if (name.length() == 0) {
+      continue;
+    }
+    bool known = false;
+    for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+      if (name == sensorDrivers[i].name) {
+        mask |= 1UL << sensorDrivers[i].type;
+        known = true;
+      }
+    }
+    if (!known) {
+      Serial.print("Unknown sensor driver: ");
+      Serial.println(name);
+    }
+  }
+  // Both doorway drivers feed the same in/out counters
+  if ((mask & (1UL << SENSOR_SENSE)) && (mask & (1UL << SENSOR_SENSE_CAMERA))) {
+    Serial.println("sense and sense_camera are exclusive - keeping sense");
+    mask &= ~(1UL << SENSOR_SENSE_CAMERA);
+  }
+  return mask;
+}
+
+String sensorListString(uint32_t mask) {
+  String list;
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    if (mask & (1UL << sensorDrivers[i].type)) {
+      if (list.length() > 0) {
+        list += ",";
+      }
+      list += sensorDrivers[i].name;
+    }
+  }
+  return list;
+}
+
+// Poll and sample tasks for every enabled driver; polls run no faster than
+// minPollPeriod. Returns the doorway driver's poll task (edge ISRs arm it),
+// or -1 when no doorway driver is enabled.
+int addSensorDriverTasks(unsigned long minPollPeriod) {
+  int senseTask = -1;
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    SensorDriver& d = sensorDrivers[i];
+    if (!sensorActive(d.type)) {
+      continue;
+    }
+    if (d.poll != NULL && d.pollPeriod > 0) {
+      unsigned long period = d.pollPeriod > minPollPeriod ? d.pollPeriod : minPollPeriod;
+      int id = addScheduledTask(d.name, d.poll, period, 0, true);
+      if (id >= 0) {
+        scheduledTasks[id].owner = i;
+      }
+      if (d.type == SENSOR_SENSE || d.type == SENSOR_SENSE_CAMERA) {
+        senseTask = id;
+      }
+    }
+    if (d.sample != NULL && d.samplePeriod > 0) {
+      int id = addScheduledTask(d.name, d.sample, d.samplePeriod, d.samplePeriod, true);
+      if (id >= 0) {
+        scheduledTasks[id].owner = i;
+      }
+    }
+  }
+  return senseTask;
+}
@@ -0,0 +1,131 @@
+// Report window statistics (see WindowStats). Needs String and JsonDocument
+// from the includer; the host tests in test/native build it against
+// arduino_shim.h.
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+// Streaming summary of one metric over a report window: min/max, Welford
+// mean/variance and WINDOW_QUANTILE (published as _p95). The quantile is
+// exact for the first WINDOW_EXACT_SAMPLES, then a P-square estimate seeded
+// from them. Fixed size, so a 100 Hz stream costs the same memory as a
+// 5 s one.
+const float WINDOW_QUANTILE = 0.95;
+const int WINDOW_EXACT_SAMPLES = 32;
+struct WindowStats {
+  uint32_t count;
+  float min;
+  float max;
+  float mean;
+  float m2;         // sum of squared differences from the mean
+  float first[WINDOW_EXACT_SAMPLES]; // sorted, while count <= WINDOW_EXACT_SAMPLES
+  float q[5];       // P-square marker heights
+  int32_t n[5];     // marker positions
+  float np[5];      // desired marker positions
+};
+
+void windowStatsReset(WindowStats& w) {
+  memset(&w, 0, sizeof(w));
+}
+
+// Welford's update for mean/variance, and the P-square algorithm (Jain &
+// Chlamtac, 1985) for the quantile: five markers track the min, p/2, p,
+// (1+p)/2 and max, nudged towards their ideal positions with a parabolic
+// fit.
+void windowStatsAdd(WindowStats& w, float x) {
+  if (w.count == 0 || x < w.min) {
+    w.min = x;
+  }
+  if (w.count == 0 || x > w.max) {
+    w.max = x;
+  }
+  w.count++;
+  float delta = x - w.mean;
+  w.mean += delta / w.count;
+  w.m2 += delta * (x - w.mean);
+  
+  const float p = WINDOW_QUANTILE;
+  const float increment[5] = {0, p / 2, p, (1 + p) / 2, 1};
+  if (w.count <= WINDOW_EXACT_SAMPLES) {
+    // Keep the first samples sorted; small windows get an exact quantile
+    int i = w.count - 1;
+    for (; i > 0 && w.first[i - 1] > x; i--) {
+      w.first[i] = w.first[i - 1];
+    }
+    w.first[i] = x;
+    return;
+  }
+  if (w.count == WINDOW_EXACT_SAMPLES + 1) {
+    // Seed the markers at their ranks in the buffered samples. Seeding from
+    // five samples, as in the paper, leaves the p95 marker a few percentile
+    // points off for thousands of samples.
+    for (int j = 0; j < 5; j++) {
+      w.np[j] = increment[j] * (WINDOW_EXACT_SAMPLES - 1);
+      w.n[j] = lroundf(w.np[j]);
+      w.q[j] = w.first[w.n[j]];
+    }
+  }
+  
+  // Cell the sample falls in; the extreme markers follow min and max
+  int k;
+  if (x < w.q[0]) {
+    w.q[0] = x;
+    k = 0;
+  } else if (x >= w.q[4]) {
+    w.q[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (k < 3 && x >= w.q[k + 1]) {
+      k++;
+    }
+  }
+  for (int j = k + 1; j < 5; j++) {
+    w.n[j]++;
+  }
+  for (int j = 0; j < 5; j++) {
+    w.np[j] += increment[j];
+  }
+  
+  for (int j = 1; j < 4; j++) {
+    float d = w.np[j] - w.n[j];
+    if ((d >= 1 && w.n[j + 1] - w.n[j] > 1) || (d <= -1 && w.n[j - 1] - w.n[j] < -1)) {
+      int s = d > 0 ? 1 : -1;
+      float qp = w.q[j] + (float)s / (w.n[j + 1] - w.n[j - 1]) *
+                 ((w.n[j] - w.n[j - 1] + s) * (w.q[j + 1] - w.q[j]) / (w.n[j + 1] - w.n[j]) +
+                  (w.n[j + 1] - w.n[j] - s) * (w.q[j] - w.q[j - 1]) / (w.n[j] - w.n[j - 1]));
+      if (w.q[j - 1] < qp && qp < w.q[j + 1]) {
+        w.q[j] = qp;
+      } else {
+        // Parabola overshot a neighbour; fall back to linear
+        w.q[j] += s * (w.q[j + s] - w.q[j]) / (w.n[j + s] - w.n[j]);
+      }
+      w.n[j] += s;
+    }
+  }
+}
+
+float windowStatsQuantile(const WindowStats& w) {
+  if (w.count == 0) {
+    return 0.0;
+  }
+  if (w.count <= WINDOW_EXACT_SAMPLES) {
+    // Interpolate between the neighbouring order statistics
+    float pos = WINDOW_QUANTILE * (w.count - 1);
+    int lo = (int)pos;
+    int hi = lo + 1 < (int)w.count ? lo + 1 : (int)w.count - 1;
+    return w.first[lo] + (w.first[hi] - w.first[lo]) * (pos - lo);
+  }
+  return w.q[2];
+}
+
+// <key>_min/_max/_mean/_variance/_p95 (sample variance, 0 below 2 samples)
+void serializeWindowStats(JsonDocument& doc, const char* key, const WindowStats& w) {
+  String prefix = String(key) + "_";
+  doc[prefix + "min"] = w.min;
+  doc[prefix + "max"] = w.max;
+  doc[prefix + "mean"] = w.mean;
+  doc[prefix + "variance"] = w.count > 1 ? w.m2 / (w.count - 1) : 0.0;
+  doc[prefix + "p95"] = windowStatsQuantile(w);
+}
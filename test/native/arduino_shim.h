@@ -0,0 +1,319 @@
+// Just enough of the Arduino core to build the firmware headers in src/ on
+// the host: a fake millis()/micros() clock the tests advance by hand, a
+// String over std::string, a Serial that prints to stdout (or nowhere), and
+// a small JsonDocument with ArduinoJson 7's interface and number format.
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fake clock. unsigned long is 64-bit here, so the millis() wrap happens at
+// 2^64 instead of 2^32; the signed-difference arithmetic is the same.
+unsigned long shimNowMs = 0;
+unsigned long shimNowUs = 0;
+
+unsigned long millis() { return shimNowMs; }
+unsigned long micros() { return shimNowUs; }
+
+void shimAdvanceMs(unsigned long ms) {
+  shimNowMs += ms;
+  shimNowUs += ms * 1000;
+}
+
+void shimSetMillis(unsigned long ms) {
+  shimNowMs = ms;
+}
+
+// newlib has strlcpy(); older glibc doesn't
+inline size_t shimStrlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#define strlcpy shimStrlcpy
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  unsigned int length() const { return s_.size(); }
+  const char* c_str() const { return s_.c_str(); }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t at = s_.find(c, from);
+    return at == std::string::npos ? -1 : (int)at;
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > s_.size()) {
+      return String();
+    }
+    return String(s_.substr(from, to - from));
+  }
+  void trim() {
+    size_t first = s_.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+      s_.clear();
+      return;
+    }
+    s_ = s_.substr(first, s_.find_last_not_of(" \t\r\n") - first + 1);
+  }
+  bool operator==(const char* other) const { return s_ == other; }
+  bool operator==(const String& other) const { return s_ == other.s_; }
+  String& operator+=(const char* other) {
+    s_ += other;
+    return *this;
+  }
+  String operator+(const char* other) const { return String(s_ + other); }
+
+ private:
+  std::string s_;
+};
+
+struct ShimSerial {
+  bool quiet = true;
+  void print(const char* s) { if (!quiet) fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void print(long v) { if (!quiet) printf("%ld", v); }
+  void print(unsigned long v) { if (!quiet) printf("%lu", v); }
+  void print(int v) { print((long)v); }
+  void print(double v, int digits = 2) { if (!quiet) printf("%.*f", digits, v); }
+  template <typename T>
+  void println(T v) {
+    print(v);
+    print("\n");
+  }
+  void println() { print("\n"); }
+};
+ShimSerial Serial;
+
+// JSON tree. Members are created on assignment, as in ArduinoJson, so
+// reading a missing key doesn't add a null to the output.
+struct JsonNode {
+  enum Kind { NUL, FLOAT, DOUBLE, SIGNED, UNSIGNED, STRING, BOOLEAN, OBJECT, ARRAY };
+  Kind kind = NUL;
+  double number = 0;
+  long long integer = 0;
+  std::string text;
+  std::vector<std::string> keys; // OBJECT
+  std::vector<std::unique_ptr<JsonNode>> values; // OBJECT members or ARRAY items
+
+  JsonNode* find(const std::string& key) const {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] == key) {
+        return values[i].get();
+      }
+    }
+    return NULL;
+  }
+  JsonNode* member(const std::string& key) {
+    if (kind != OBJECT) {
+      *this = JsonNode();
+      kind = OBJECT;
+    }
+    JsonNode* node = find(key);
+    if (node == NULL) {
+      keys.push_back(key);
+      values.emplace_back(new JsonNode());
+      node = values.back().get();
+    }
+    return node;
+  }
+};
+
+class JsonObject;
+
+class JsonArray {
+ public:
+  JsonArray(JsonNode* node = NULL) : node_(node) {}
+  template <typename T>
+  T add() {
+    node_->values.emplace_back(new JsonNode());
+    JsonNode* item = node_->values.back().get();
+    item->kind = JsonNode::OBJECT;
+    return T(item);
+  }
+
+ private:
+  JsonNode* node_;
+};
+
+class JsonVariant {
+ public:
+  JsonVariant(JsonNode* parent, const std::string& key) : parent_(parent), key_(key) {}
+
+  JsonVariant& operator=(float v) { return set(JsonNode::FLOAT, v); }
+  JsonVariant& operator=(double v) { return set(JsonNode::DOUBLE, v); }
+  JsonVariant& operator=(int v) { return setInteger(JsonNode::SIGNED, v); }
+  JsonVariant& operator=(long v) { return setInteger(JsonNode::SIGNED, v); }
+  JsonVariant& operator=(unsigned int v) { return setInteger(JsonNode::UNSIGNED, v); }
+  JsonVariant& operator=(unsigned long v) { return setInteger(JsonNode::UNSIGNED, v); }
+  JsonVariant& operator=(bool v) { return setInteger(JsonNode::BOOLEAN, v); }
+  JsonVariant& operator=(const char* v) {
+    JsonNode* node = parent_->member(key_);
+    *node = JsonNode();
+    node->kind = JsonNode::STRING;
+    node->text = v;
+    return *this;
+  }
+  JsonVariant& operator=(const String& v) { return *this = v.c_str(); }
+
+  template <typename T>
+  bool is() const; // only is<float>() is used
+  template <typename T>
+  T as() const;
+  template <typename T>
+  T to() {
+    JsonNode* node = parent_->member(key_);
+    *node = JsonNode();
+    node->kind = JsonNode::ARRAY;
+    return T(node);
+  }
+
+ private:
+  JsonVariant& set(JsonNode::Kind kind, double v) {
+    JsonNode* node = parent_->member(key_);
+    *node = JsonNode();
+    node->kind = kind;
+    node->number = v;
+    return *this;
+  }
+  JsonVariant& setInteger(JsonNode::Kind kind, long long v) {
+    JsonNode* node = parent_->member(key_);
+    *node = JsonNode();
+    node->kind = kind;
+    node->integer = v;
+    node->number = (double)v;
+    return *this;
+  }
+
+  JsonNode* parent_;
+  std::string key_;
+};
+
+template <>
+inline bool JsonVariant::is<float>() const {
+  const JsonNode* node = parent_->kind == JsonNode::OBJECT ? parent_->find(key_) : NULL;
+  return node != NULL && (node->kind == JsonNode::FLOAT || node->kind == JsonNode::DOUBLE ||
+                          node->kind == JsonNode::SIGNED || node->kind == JsonNode::UNSIGNED);
+}
+
+template <>
+inline float JsonVariant::as<float>() const {
+  return is<float>() ? (float)parent_->find(key_)->number : 0.0f;
+}
+
+template <>
+inline unsigned long JsonVariant::as<unsigned long>() const {
+  return is<float>() ? (unsigned long)parent_->find(key_)->integer : 0;
+}
+
+class JsonObject {
+ public:
+  JsonObject(JsonNode* node = NULL) : node_(node) {}
+  JsonVariant operator[](const char* key) { return JsonVariant(node_, key); }
+
+ private:
+  JsonNode* node_;
+};
+
+class JsonDocument {
+ public:
+  JsonDocument() { root_.kind = JsonNode::OBJECT; }
+  JsonVariant operator[](const char* key) { return JsonVariant(&root_, key); }
+  JsonVariant operator[](const String& key) { return JsonVariant(&root_, key.c_str()); }
+  const JsonNode& root() const { return root_; }
+
+ private:
+  JsonNode root_;
+};
+
+// ArduinoJson 7's number writer: floats keep 6 significant digits and
+// doubles 9, trailing zeros trimmed, exponent form outside [1e-5, 1e7)
+inline void jsonWriteNumber(std::string& out, double value, int digits) {
+  if (std::isnan(value) || std::isinf(value)) {
+    out += "null";
+    return;
+  }
+  if (value < 0) {
+    out += '-';
+    value = -value;
+  }
+  int exponent = 0;
+  if (value >= 1e7 || (value > 0 && value < 1e-5)) {
+    exponent = (int)std::floor(std::log10(value));
+    value /= std::pow(10.0, exponent);
+  }
+  unsigned long long integral = (unsigned long long)value;
+  int decimals = digits;
+  for (unsigned long long tmp = integral; tmp >= 10; tmp /= 10) {
+    decimals--;
+  }
+  double scale = std::pow(10.0, decimals > 0 ? decimals : 0);
+  unsigned long long decimal = (unsigned long long)std::llround((value - integral) * scale);
+  if (decimal >= (unsigned long long)scale) {
+    integral++;
+    decimal = 0;
+  }
+  while (decimals > 0 && decimal % 10 == 0) {
+    decimal /= 10;
+    decimals--;
+  }
+  out += std::to_string(integral);
+  if (decimals > 0) {
+    std::string frac = std::to_string(decimal);
+    out += '.';
+    out += std::string(decimals - frac.size(), '0') + frac;
+  }
+  if (exponent != 0) {
+    out += 'e' + std::to_string(exponent);
+  }
+}
+
+inline void jsonWrite(std::string& out, const JsonNode& node) {
+  switch (node.kind) {
+    case JsonNode::NUL: out += "null"; break;
+    case JsonNode::FLOAT: jsonWriteNumber(out, node.number, 6); break;
+    case JsonNode::DOUBLE: jsonWriteNumber(out, node.number, 9); break;
+    case JsonNode::SIGNED: out += std::to_string(node.integer); break;
+    case JsonNode::UNSIGNED: out += std::to_string((unsigned long long)node.integer); break;
+    case JsonNode::BOOLEAN: out += node.integer ? "true" : "false"; break;
+    case JsonNode::STRING: out += '"' + node.text + '"'; break;
+    case JsonNode::OBJECT:
+    case JsonNode::ARRAY:
+      out += node.kind == JsonNode::OBJECT ? '{' : '[';
+      for (size_t i = 0; i < node.values.size(); i++) {
+        if (i > 0) {
+          out += ',';
+        }
+        if (node.kind == JsonNode::OBJECT) {
+          out += '"' + node.keys[i] + "\":";
+        }
+        jsonWrite(out, *node.values[i]);
+      }
+      out += node.kind == JsonNode::OBJECT ? '}' : ']';
+      break;
+  }
+}
+
+inline size_t serializeJson(const JsonDocument& doc, String& output) {
+  std::string out;
+  jsonWrite(out, doc.root());
+  output = String(out);
+  return out.size();
+}
+
+inline size_t measureJson(const JsonDocument& doc) {
+  std::string out;
+  jsonWrite(out, doc.root());
+  return out.size();
+}
@@ -0,0 +1,210 @@
+// MQ7 sample filter replay and benchmark
+//
+// Builds gasFilterPush() from src/mq7_filter.h - a 5-tap median on the raw
+// 1 kHz ADC codes, blocks of 10 averaged (100 Hz), then a fixed-point
+// single-pole IIR (1/8). Synthetic MQ7 traces - a noisy baseline with
+// single-sample and paired spikes, a CO step, a short CO puff - are replayed
+// through it to check that spikes never reach the filtered value, that noise
+// is reduced, that a real rise still reaches the alert path quickly, and that
+// the fixed-point IIR tracks a float reference.
+//
+// It then times gasFilterPush() over 200k codes at -O2. That is host time,
+// not ESP32-S3 time; the device reports its own cost as
+// gas_sampling.filter_us_per_sample in the status payload.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/mq7_filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+const int ADC_MAX = 4095;
+
+int failed = 0;
+int total = 0;
+
+void check(const char* name, bool ok, const char* detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name, detail);
+}
+
+struct Filtered {
+  size_t index; // raw sample that produced it
+  uint16_t code;
+};
+
+std::vector<Filtered> run(const std::vector<uint16_t>& samples) {
+  memset(&gasFilter, 0, sizeof(gasFilter));
+  std::vector<Filtered> out;
+  for (size_t i = 0; i < samples.size(); i++) {
+    if (gasFilterPush(samples[i])) {
+      out.push_back({i, gasFilteredCode});
+    }
+  }
+  return out;
+}
+
+uint16_t clampCode(double code) {
+  return (uint16_t)std::max(0.0, std::min((double)ADC_MAX, std::round(code)));
+}
+
+std::vector<uint16_t> baseline(std::mt19937& rng, int n, double level = 600, double noise = 12) {
+  std::normal_distribution<double> gauss(level, noise);
+  std::vector<uint16_t> out;
+  for (int i = 0; i < n; i++) {
+    out.push_back(clampCode(gauss(rng)));
+  }
+  return out;
+}
+
+std::vector<uint16_t> concat(std::initializer_list<std::vector<uint16_t>> parts) {
+  std::vector<uint16_t> out;
+  for (const std::vector<uint16_t>& p : parts) {
+    out.insert(out.end(), p.begin(), p.end());
+  }
+  return out;
+}
+
+// Full-scale glitches (relay/WiFi TX coupling) of `width` samples, isolated
+// so the median window never holds two
+std::vector<uint16_t> withSpikes(std::mt19937& rng, std::vector<uint16_t> samples, double rate, int width,
+                                 int* spikes) {
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  *spikes = 0;
+  for (size_t i = MQ7_MEDIAN_TAPS; i + width < samples.size(); i++) {
+    if (uniform(rng) < rate) {
+      uint16_t level = uniform(rng) < 0.5 ? 0 : ADC_MAX;
+      for (int j = 0; j < width; j++) {
+        samples[i + j] = level;
+      }
+      (*spikes)++;
+      i += MQ7_MEDIAN_TAPS;
+    }
+  }
+  return samples;
+}
+
+double stdev(const std::vector<double>& values) {
+  double mean = 0;
+  for (double v : values) mean += v;
+  mean /= values.size();
+  double var = 0;
+  for (double v : values) var += (v - mean) * (v - mean);
+  return sqrt(var / values.size());
+}
+
+int main() {
+  std::mt19937 rng(38);
+  char detail[256];
+  const int n = 60 * MQ7_SAMPLE_RATE_HZ; // one minute at 1 kHz
+
+  // Spikes: single and paired full-scale samples at 0.2% leave the output
+  // on the clean trace. A spike only displaces the median by one rank, so the
+  // output may move by a code or two, never towards full scale.
+  std::vector<uint16_t> clean = baseline(rng, n);
+  std::vector<Filtered> reference = run(clean);
+  for (int width = 1; width <= 2; width++) {
+    int spikes;
+    std::vector<Filtered> filtered = run(withSpikes(rng, clean, 0.002, width, &spikes));
+    int worst = 0;
+    for (size_t i = 0; i < filtered.size(); i++) {
+      worst = std::max(worst, abs(filtered[i].code - reference[i].code));
+    }
+    snprintf(detail, sizeof(detail), "%d spikes, output within %d codes of the clean trace", spikes, worst);
+    check(width == 1 ? "1-sample spikes rejected" : "2-sample spikes rejected", worst <= 3, detail);
+  }
+
+  // Noise: the filtered value is far steadier than single analogRead() calls
+  {
+    std::vector<double> raw(clean.begin(), clean.end());
+    std::vector<double> settled;
+    for (const Filtered& f : reference) {
+      if (f.index > 2 * MQ7_SAMPLE_RATE_HZ) {
+        settled.push_back(f.code);
+      }
+    }
+    double rawSd = stdev(raw);
+    double outSd = stdev(settled);
+    snprintf(detail, sizeof(detail), "raw sd %.1f codes, filtered sd %.2f codes (%.0fx)", rawSd, outSd,
+             rawSd / outSd);
+    check("noise reduced", outSd < rawSd / 8, detail);
+  }
+
+  // Step: CO rises at 10 s; 90% of the step within 300 ms
+  std::vector<uint16_t> step = concat({baseline(rng, 10000), baseline(rng, 5000, 1600)});
+  {
+    size_t reached = step.size();
+    for (const Filtered& f : run(step)) {
+      if (f.index >= 10000 && f.code >= 600 + 0.9 * 1000) {
+        reached = f.index;
+        break;
+      }
+    }
+    snprintf(detail, sizeof(detail), "%zu ms to 90%% of a 1000-code step", reached - 10000);
+    check("step reaches 90% quickly", reached - 10000 <= 300, detail);
+  }
+
+  // Puff: a 150 ms burst of gas is still seen (the old 30 s single read
+  // would almost always miss it)
+  {
+    std::vector<uint16_t> puff = concat({baseline(rng, 5000), baseline(rng, 150, 2000), baseline(rng, 2000)});
+    int peak = 0;
+    for (const Filtered& f : run(puff)) {
+      peak = std::max(peak, (int)f.code);
+    }
+    snprintf(detail, sizeof(detail), "peak %d codes for a 2000-code puff over a 600 baseline", peak);
+    check("150 ms puff reaches the alert path", peak >= 600 + 0.6 * 1400, detail);
+  }
+
+  // Fixed point: the << 8 IIR stays within a code of a float IIR on the
+  // same decimated stream
+  {
+    memset(&gasFilter, 0, sizeof(gasFilter));
+    double ref = -1;
+    double worst = 0;
+    bool aligned = true;
+    for (uint16_t s : step) {
+      int countBefore = gasFilter.decimCount;
+      uint32_t sumBefore = gasFilter.decimSum;
+      if (gasFilterPush(s)) {
+        uint16_t window[MQ7_MEDIAN_TAPS];
+        memcpy(window, gasFilter.median, sizeof(window));
+        std::sort(window, window + MQ7_MEDIAN_TAPS);
+        double decimated = (double)(sumBefore + window[MQ7_MEDIAN_TAPS / 2]) / MQ7_DECIMATION;
+        aligned &= countBefore == MQ7_DECIMATION - 1;
+        ref = ref < 0 ? decimated : ref + (decimated - ref) / (1 << MQ7_IIR_SHIFT);
+        worst = std::max(worst, fabs(gasFilteredCode - ref));
+      }
+    }
+    snprintf(detail, sizeof(detail), "worst difference %.2f codes", worst);
+    check("fixed-point IIR matches float", aligned && worst <= 1.0, detail);
+  }
+
+  // Host timing: best of 5 passes over 200k spiky codes
+  {
+    int spikes;
+    std::vector<uint16_t> codes = withSpikes(rng, baseline(rng, 200000), 0.002, 1, &spikes);
+    double best = 1e9;
+    unsigned long outputs = 0;
+    for (int pass = 0; pass < 5; pass++) {
+      memset(&gasFilter, 0, sizeof(gasFilter));
+      outputs = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (uint16_t code : codes) {
+        outputs += gasFilterPush(code);
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / codes.size());
+    }
+    printf("\nHost (g++ -O2): %.1f ns/sample over %zu samples (%lu filtered values, last code %u); "
+           "on the device see filter_us_per_sample\n",
+           best, codes.size(), outputs, gasFilteredCode);
+  }
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+// JWT signing and cache check
+//
+// Builds generateJWT() / getJWT() from src/jwt_token.h - the HMAC pads
+// absorbed into SHA-256 contexts once, cloned per token, the snprintf claims
+// and the base64url encoder - with mbedtls' SHA-256 calls mapped onto
+// OpenSSL. Tokens are checked against OpenSSL's one-shot HMAC() and an
+// independent base64url, for short, block-sized and over-long (hashed)
+// keys. getJWT() has to reuse the cached token until JWT_REFRESH_MARGIN_SEC
+// before expiry. The cost of a fresh token, a cache hit and the HMAC with
+// and without the precomputed pads is timed on the host.
+//
+// Run: make -C test/native
+
+#define OPENSSL_SUPPRESS_DEPRECATED // SHA256_Init() and friends: the mbedtls-shaped API
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include "arduino_shim.h"
+
+#include <chrono>
+
+// mbedtls/sha256.h
+typedef SHA256_CTX mbedtls_sha256_context;
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) { memset(ctx, 0, sizeof(*ctx)); }
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {}
+void mbedtls_sha256_clone(mbedtls_sha256_context* dst, const mbedtls_sha256_context* src) { *dst = *src; }
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) { return !SHA256_Init(ctx); }
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len) {
+  return !SHA256_Update(ctx, input, len);
+}
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+  return !SHA256_Final(output, ctx);
+}
+int mbedtls_sha256(const unsigned char* input, size_t len, unsigned char output[32], int is224) {
+  SHA256(input, len, output);
+  return 0;
+}
+
+struct ShimWiFi {
+  String macAddress() { return "DC:54:75:C8:12:34"; }
+};
+ShimWiFi WiFi;
+
+// main.cpp configuration and state the header reads
+#define FIRMWARE_VERSION "1.6.0"
+#define BUILD_TIMESTAMP "Oct 18 2026 12:00:00"
+const char* JWT_SECRET = "JWTSecret";
+const char* DEVICE_ID = "esp32s3_sensor_01";
+const unsigned long JWT_LIFETIME_SEC = 3600;
+const unsigned long JWT_REFRESH_MARGIN_SEC = 300;
+String deviceHostname = "sensor_C81234";
+bool timeSynced = true;
+unsigned long unixNow = 1792324800; // 2026-10-18
+unsigned long getCurrentUnixTime() { return unixNow; }
+unsigned long jwtExpiresAt = 0;
+unsigned long jwtGeneratedCount = 0;
+unsigned long jwtCacheHits = 0;
+unsigned long jwtLastGenerateMicros = 0;
+
+#include "../../src/jwt_token.h"
+
+int failed = 0;
+int total = 0;
+
+void check(const std::string& name, bool ok, const std::string& detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name.c_str(), detail.c_str());
+}
+
+// Straightforward base64url, for comparison with the firmware's encoder
+std::string referenceBase64Url(const std::string& data) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string bits;
+  for (unsigned char c : data) {
+    for (int b = 7; b >= 0; b--) bits += (c >> b) & 1 ? '1' : '0';
+  }
+  while (bits.size() % 6) bits += '0';
+  std::string out;
+  for (size_t i = 0; i < bits.size(); i += 6) {
+    out += alphabet[std::stoi(bits.substr(i, 6), nullptr, 2)];
+  }
+  return out;
+}
+
+std::string referenceBase64UrlDecode(const std::string& text) {
+  static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string out;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : text) {
+    acc = (acc << 6) | alphabet.find(c);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out += (char)((acc >> bits) & 0xFF);
+    }
+  }
+  return out;
+}
+
+// header.payload.signature the way PyJWT would check it: one-shot HMAC with
+// the raw secret
+bool signatureValid(const std::string& token, const char* secret) {
+  size_t dot = token.rfind('.');
+  std::string signingInput = token.substr(0, dot);
+  unsigned char mac[32];
+  unsigned int macLen = 0;
+  HMAC(EVP_sha256(), secret, strlen(secret), (const unsigned char*)signingInput.data(), signingInput.size(), mac,
+       &macLen);
+  return token.substr(dot + 1) == referenceBase64Url(std::string((const char*)mac, macLen));
+}
+
+void resetJWT() {
+  jwtKeyReady = false;
+  jwtToken[0] = '\0';
+  jwtExpiresAt = 0;
+  jwtGeneratedCount = 0;
+  jwtCacheHits = 0;
+}
+
+template <typename F>
+double nsPerCall(F fn, int iterations) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main() {
+  // base64url against the reference for every length mod 3
+  {
+    bool same = true;
+    char out[128];
+    std::string data;
+    for (int len = 0; len <= 64; len++) {
+      base64UrlEncode((const uint8_t*)data.data(), data.size(), out);
+      same &= out == referenceBase64Url(data);
+      data += (char)(len * 37 + 200);
+    }
+    check("base64url, lengths 0-64", same, same ? "matches" : "differs");
+  }
+
+  // Signatures for short, exactly block-sized and over-long keys
+  std::string longKey(100, 'k');
+  std::string blockKey(64, 'b');
+  const char* keys[] = {"JWTSecret", blockKey.c_str(), longKey.c_str()};
+  const char* keyNames[] = {"9-byte key", "64-byte key", "100-byte key (hashed first)"};
+  for (int k = 0; k < 3; k++) {
+    JWT_SECRET = keys[k];
+    resetJWT();
+    std::string token = generateJWT();
+    check("HS256 signature, " + std::string(keyNames[k]), signatureValid(token, JWT_SECRET),
+          token.substr(token.rfind('.') + 1));
+  }
+  JWT_SECRET = "JWTSecret";
+  resetJWT();
+
+  // Claims
+  {
+    std::string token = generateJWT();
+    size_t first = token.find('.');
+    size_t second = token.rfind('.');
+    std::string header = referenceBase64UrlDecode(token.substr(0, first));
+    std::string payload = referenceBase64UrlDecode(token.substr(first + 1, second - first - 1));
+    std::string expected = "{\"iss\":\"esp32-sensor\",\"sub\":\"sensor_C81234\",\"aud\":\"emqx\",\"exp\":" +
+                           std::to_string(unixNow + JWT_LIFETIME_SEC) + ",\"iat\":" + std::to_string(unixNow) +
+                           ",\"device_id\":\"esp32s3_sensor_01\",\"mac_address\":\"DC:54:75:C8:12:34\","
+                           "\"firmware_version\":\"1.6.0\",\"build_timestamp\":\"Oct 18 2026 12:00:00\"}";
+    check("header", header == "{\"alg\":\"HS256\",\"typ\":\"JWT\"}", header);
+    check("claims", payload == expected && jwtExpiresAt == unixNow + JWT_LIFETIME_SEC,
+          std::to_string(payload.size()) + " B payload, " + std::to_string(token.size()) + " B token");
+  }
+
+  // Cache: reused until JWT_REFRESH_MARGIN_SEC before expiry
+  {
+    resetJWT();
+    unsigned long start = unixNow;
+    std::string first = getJWT();
+    bool reused = true;
+    for (unsigned long t = start; t + JWT_REFRESH_MARGIN_SEC < start + JWT_LIFETIME_SEC; t += 60) {
+      unixNow = t;
+      reused &= first == getJWT();
+    }
+    unsigned long hits = jwtCacheHits;
+    unixNow = start + JWT_LIFETIME_SEC - JWT_REFRESH_MARGIN_SEC;
+    std::string second = getJWT();
+    bool renewed = second != first && jwtExpiresAt == unixNow + JWT_LIFETIME_SEC && signatureValid(second, JWT_SECRET);
+    check("cached until the refresh margin", reused && jwtGeneratedCount == 2 && renewed,
+          std::to_string(jwtGeneratedCount) + " generated, " + std::to_string(hits) + " cache hits over " +
+              std::to_string((JWT_LIFETIME_SEC - JWT_REFRESH_MARGIN_SEC) / 60) + " min");
+    unixNow = start;
+  }
+
+  // Host timings. Serial is quiet, so the log lines generateJWT() prints
+  // cost nothing here; on the device they cost more than the signing.
+  {
+    const int iterations = 200000;
+    resetJWT();
+    volatile char sink = 0;
+    double fresh = nsPerCall([&] { sink ^= generateJWT()[0]; }, iterations);
+    double hit = nsPerCall([&] { sink ^= getJWT()[0]; }, iterations);
+    std::string signingInput(jwtToken, strrchr(jwtToken, '.') - jwtToken);
+    uint8_t mac[32];
+    double precomputed = nsPerCall([&] { hmacSha256((const uint8_t*)signingInput.data(), signingInput.size(), mac); },
+                                   iterations);
+    // The same HMAC with the key padded and both pads hashed on every call
+    double rehashed = nsPerCall([&] {
+      uint8_t key[64] = {0};
+      memcpy(key, JWT_SECRET, strlen(JWT_SECRET));
+      uint8_t pad[64];
+      uint8_t inner[32];
+      SHA256_CTX ctx;
+      for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+      SHA256_Init(&ctx);
+      SHA256_Update(&ctx, pad, sizeof(pad));
+      SHA256_Update(&ctx, signingInput.data(), signingInput.size());
+      SHA256_Final(inner, &ctx);
+      for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+      SHA256_Init(&ctx);
+      SHA256_Update(&ctx, pad, sizeof(pad));
+      SHA256_Update(&ctx, inner, sizeof(inner));
+      SHA256_Final(mac, &ctx);
+    }, iterations);
+    char detail[256];
+    snprintf(detail, sizeof(detail),
+             "fresh token %.0f ns, cache hit %.0f ns; HMAC over %zu B: %.0f ns from cloned pads, %.0f ns rehashing them",
+             fresh, hit, signingInput.size(), precomputed, rehashed);
+    check("host timings", hit < fresh, detail);
+  }
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+// MQ7 ppm lookup table check
+//
+// Builds the 4096-entry ADC code -> ppm table with buildMQ7PpmTable() from
+// src/mq7_ppm_table.h, in float like the ESP32-S3 FPU, and compares every
+// entry against the response curve evaluated in double precision from the
+// same constants. Inside the MQ7's rated range the two must agree to
+// TOLERANCE; outside it the entries must still be finite, non-negative and
+// monotonic, including the codes next to 0 and full scale. The table is
+// then rebuilt for other R0 values, as after a recalibration, and must hold
+// no entry from the previous R0.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/mq7_ppm_table.h"
+
+#include <algorithm>
+
+// MQ7 datasheet range; beyond it the curve is extrapolated anyway
+const double RATED_MIN_PPM = 20.0;
+const double RATED_MAX_PPM = 2000.0;
+const double TOLERANCE = 1e-4;
+
+int failed = 0;
+int total = 0;
+
+void check(const std::string& name, bool ok, const char* detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name.c_str(), detail);
+}
+
+// The response curve in double precision. Full scale reads as the code
+// below it, as mq7FormulaPpm() does.
+double referencePpm(int code, double r0) {
+  code = std::min(code, (int)MQ7_ADC_MAX - 1);
+  double voltage = code / (double)MQ7_ADC_MAX * MQ7_VCC;
+  if (voltage <= 0) {
+    return 0.0;
+  }
+  double ratio = MQ7_RL * (MQ7_VCC / voltage - 1.0) / r0;
+  return CO_CURVE_A * pow(ratio, (double)CO_CURVE_B);
+}
+
+double relativeError(double value, double reference) {
+  return reference == 0 ? fabs(value) : fabs(value - reference) / reference;
+}
+
+// Compares the live table with the reference for r0 entry by entry
+void checkTable(float r0) {
+  char detail[256];
+  int inRange = 0;
+  int worstCode = -1;
+  double worst = 0;
+  std::string problems;
+  for (int code = 0; code < MQ7_PPM_TABLE_SIZE; code++) {
+    float ppm = mq7PpmTable[code];
+    double ref = referencePpm(code, r0);
+    if (!std::isfinite(ppm) || ppm < 0) {
+      problems += " code " + std::to_string(code) + " not finite/non-negative;";
+    }
+    if (code > 0 && ppm < mq7PpmTable[code - 1]) {
+      problems += " code " + std::to_string(code) + " not monotonic;";
+    }
+    if (ref >= RATED_MIN_PPM && ref <= RATED_MAX_PPM) {
+      inRange++;
+      if (relativeError(ppm, ref) > worst) {
+        worst = relativeError(ppm, ref);
+        worstCode = code;
+      }
+    }
+  }
+  snprintf(detail, sizeof(detail), "%d codes in %.0f-%.0f ppm, max relative error %.2e at code %d%s", inRange,
+           RATED_MIN_PPM, RATED_MAX_PPM, worst, worstCode, problems.substr(0, 120).c_str());
+  check("R0 = " + std::to_string(r0).substr(0, 5) + " kΩ table", mq7R0 == r0 && inRange > 0 &&
+        worst <= TOLERANCE && problems.empty(), detail);
+
+  // The ends of the ADC range, entry by entry: near 0 the curve is far
+  // below a ppm, near full scale far above the rated range
+  const int edges[] = {0, 1, 2, 3, 4092, 4093, 4094, 4095};
+  std::string values;
+  bool edgesOk = true;
+  for (int code : edges) {
+    double ref = referencePpm(code, r0);
+    float ppm = mq7PpmTable[code];
+    edgesOk &= ref < 1.0 ? fabs(ppm - ref) < 1e-6 : relativeError(ppm, ref) <= TOLERANCE;
+    snprintf(detail, sizeof(detail), " %d:%.3g", code, ppm);
+    values += detail;
+  }
+  edgesOk &= mq7CodeToPpm(4095) == mq7PpmTable[4095] && mq7CodeToPpm(65535) == mq7PpmTable[4095];
+  check("R0 = " + std::to_string(r0).substr(0, 5) + " kΩ codes near 0 and 4095", edgesOk, values.c_str());
+}
+
+int main() {
+  char detail[256];
+  printf("RL=%.1f kΩ, VCC=%.2f V, curve %.1f * ratio^%.3f\n\n", MQ7_RL, MQ7_VCC, CO_CURVE_A, CO_CURVE_B);
+
+  buildMQ7PpmTable(MQ7_RO);
+  checkTable(MQ7_RO);
+
+  // Recalibration: the rebuilt table must match the new R0 everywhere
+  float previous[MQ7_PPM_TABLE_SIZE];
+  const float r0s[] = {2.5, 5.0, 20.0, 40.0};
+  for (float r0 : r0s) {
+    memcpy(previous, mq7PpmTable, sizeof(previous));
+    buildMQ7PpmTable(r0);
+    int changed = 0;
+    for (int code = 0; code < MQ7_PPM_TABLE_SIZE; code++) {
+      changed += mq7PpmTable[code] != previous[code];
+    }
+    checkTable(r0);
+    snprintf(detail, sizeof(detail), "%d of %d entries changed (code 0 stays 0)", changed, MQ7_PPM_TABLE_SIZE);
+    check("rebuild for R0 = " + std::to_string(r0).substr(0, 5) + " kΩ", changed == MQ7_PPM_TABLE_SIZE - 1,
+          detail);
+  }
+
+  // The table entries are exactly what the conversion it replaced returns
+  buildMQ7PpmTable(MQ7_RO);
+  int mismatches = 0;
+  for (int code = 0; code < MQ7_PPM_TABLE_SIZE; code++) {
+    mismatches += mq7CodeToPpm(code) != mq7FormulaPpm(code, MQ7_RO);
+  }
+  snprintf(detail, sizeof(detail), "%d mismatches against mq7FormulaPpm()", mismatches);
+  check("lookup equals the formula", mismatches == 0, detail);
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
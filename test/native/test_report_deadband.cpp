@@ -0,0 +1,370 @@
+// Deadband reporting replay
+//
+// Builds reportDue() / reportPublished() and applyGasHysteresis() from
+// src/report_policy.h, with the report windows from src/window_stats.h, and
+// replays synthetic 24 h traces for a quiet room and a room with events (a
+// heating cycle, a CO spike, CO hovering on the HIGH threshold) the way
+// readAndPublishSensor() drives them: 5 s temperature samples into the
+// window, a report every 30 s, the window cleared once a report is handed
+// to MQTT. It counts how many messages the deadband + heartbeat scheme
+// sends compared with publishing every reading, and checks that every real
+// change is still reported promptly, that a short spike goes out with the
+// very next report, that a publish the broker never got doesn't move the
+// deadband, that a quiet sensor still heartbeats, and that hysteresis stops
+// the gas level from flapping.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/report_policy.h"
+#include "../../src/window_stats.h"
+
+#include <map>
+#include <random>
+
+const unsigned long TEMP_SAMPLE_INTERVAL_MS = 5000;
+const unsigned long TEMP_READ_INTERVAL_MS = 30000;
+const unsigned long DAY_MS = 24UL * 3600 * 1000;
+
+SensorDriver sensorDrivers[] = {
+  {SENSOR_DHT_TEMP, "temperature", "temperature", NULL, NULL, 0, NULL, 0, NULL, NULL},
+  {SENSOR_MQ7_GAS, "mq7", "airquality", NULL, NULL, 0, NULL, 0, NULL, NULL},
+};
+const int SENSOR_DRIVER_COUNT = sizeof(sensorDrivers) / sizeof(sensorDrivers[0]);
+const int TEMP_DRIVER = 0;
+const int GAS_DRIVER = 1;
+
+GasLevel currentGasLevel = GAS_LOW;
+unsigned long getCurrentUnixTime() {
+  return 1700000000UL + millis() / 1000;
+}
+
+typedef std::map<std::string, float> Values;
+
+// What went out, and what the backend actually received
+struct Reporter {
+  explicit Reporter(int driverIndex) : driver(driverIndex) {}
+  int driver;
+  std::vector<std::pair<unsigned long, Values>> sent; // delivered reports
+  int queued = 0;                                     // handed over while the broker was down
+};
+
+void resetReporting() {
+  memset(reportStates, 0, sizeof(reportStates));
+  reportsPublished = reportsSuppressed = 0;
+  currentGasLevel = GAS_LOW;
+  shimNowMs = 0;
+}
+
+Values metricsOf(int driver, JsonDocument& doc) {
+  Values values;
+  for (int i = 0; i < REPORT_METRIC_COUNT; i++) {
+    if (REPORT_METRICS[i].type == sensorDrivers[driver].type && doc[REPORT_METRICS[i].key].is<float>()) {
+      values[REPORT_METRICS[i].key] = doc[REPORT_METRICS[i].key].as<float>();
+    }
+  }
+  if (doc["samples"].is<float>()) {
+    values["samples"] = doc["samples"].as<float>();
+  }
+  return values;
+}
+
+// readAndPublishSensor() from reportDue() on; returns true when the report
+// was handed to MQTT (sent or queued)
+bool publish(Reporter& r, JsonDocument& doc, bool brokerUp = true) {
+  if (!reportDue(r.driver, doc)) {
+    return false;
+  }
+  if (brokerUp) {
+    reportPublished(r.driver, doc);
+    r.sent.push_back({millis(), metricsOf(r.driver, doc)});
+  } else {
+    r.queued++;
+  }
+  return true;
+}
+
+// Count readings whose metrics differ from the backend's last copy by more
+// than the deadband
+int missedAgainst(const Reporter& r, const Values& reading) {
+  if (r.sent.empty()) {
+    return 1;
+  }
+  const Values& seen = r.sent.back().second;
+  int missed = 0;
+  for (int i = 0; i < REPORT_METRIC_COUNT; i++) {
+    auto key = REPORT_METRICS[i].key;
+    if (reading.count(key) && seen.count(key) &&
+        fabs(reading.at(key) - seen.at(key)) >= REPORT_METRICS[i].deadband + 1e-4) {
+      missed++;
+    }
+  }
+  return missed;
+}
+
+unsigned long maxGap(const Reporter& r) {
+  unsigned long gap = 0;
+  for (size_t i = 1; i < r.sent.size(); i++) {
+    gap = std::max(gap, r.sent[i].first - r.sent[i - 1].first);
+  }
+  return gap;
+}
+
+float round1(double v) {
+  return (float)(round(v * 10) / 10);
+}
+
+// Temperature driver: a DHT22-like sample every 5 s into the window and a
+// report every 30 s; sample(t) gives (temperature, humidity)
+struct TempReplay {
+  Reporter reporter{TEMP_DRIVER};
+  int readings = 0;
+  int missed = 0;
+};
+
+template <typename Sample>
+TempReplay replayTemperature(unsigned long durationMs, Sample sample) {
+  resetReporting();
+  TempReplay out;
+  WindowStats temp, humidity;
+  windowStatsReset(temp);
+  windowStatsReset(humidity);
+  for (unsigned long t = 0; t < durationMs; t += TEMP_SAMPLE_INTERVAL_MS) {
+    shimSetMillis(t);
+    std::pair<float, float> s = sample(t);
+    windowStatsAdd(temp, s.first);
+    windowStatsAdd(humidity, s.second);
+    if (t % TEMP_READ_INTERVAL_MS != 0) {
+      continue;
+    }
+    JsonDocument doc;
+    doc["temperature"] = s.first;
+    doc["humidity"] = s.second;
+    serializeWindowStats(doc, "temperature", temp);
+    serializeWindowStats(doc, "humidity", humidity);
+    doc["samples"] = temp.count;
+    out.readings++;
+    if (publish(out.reporter, doc)) {
+      windowStatsReset(temp);
+      windowStatsReset(humidity);
+    }
+    out.missed += missedAgainst(out.reporter, metricsOf(TEMP_DRIVER, doc));
+  }
+  return out;
+}
+
+// MQ7 window reports: ~2 ppm background; with events a 40 ppm CO spike at
+// noon and an hour hovering around the 15 ppm HIGH threshold
+struct GasReplay {
+  Reporter reporter{GAS_DRIVER};
+  int readings = 0;
+  int missed = 0;
+  int levelChanges = 0;
+};
+
+GasReplay replayGas(bool events, bool hysteresis, unsigned long fromMs = 0, unsigned long toMs = DAY_MS) {
+  resetReporting();
+  GasReplay out;
+  std::mt19937 rng(1);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  for (unsigned long t = 0; t < toMs; t += TEMP_READ_INTERVAL_MS) {
+    double hours = t / 3600000.0;
+    double ppm = 2.0 + 0.2 * gauss(rng);
+    if (events && hours >= 12.0 && hours < 12.25) {
+      ppm = 40.0 * exp(-(hours - 12.0) * 12) + 2.0;
+    }
+    if (events && hours >= 18.0 && hours < 19.0) {
+      ppm = 15.0 + 0.6 * gauss(rng);
+    }
+    ppm = std::max(0.0, ppm);
+    double ppmMax = ppm + fabs(0.3 * gauss(rng));
+    if (t < fromMs) {
+      continue;
+    }
+    shimSetMillis(t);
+    GasLevel level = hysteresis ? applyGasHysteresis(currentGasLevel, ppm) : categorizeGasLevel(ppm);
+    out.levelChanges += level != currentGasLevel;
+    currentGasLevel = level;
+    JsonDocument doc;
+    doc["ppm"] = (float)ppm;
+    doc["ppm_max"] = (float)ppmMax;
+    doc["level"] = gasLevelName(level);
+    out.readings++;
+    publish(out.reporter, doc);
+    out.missed += missedAgainst(out.reporter, metricsOf(GAS_DRIVER, doc));
+  }
+  return out;
+}
+
+int failed = 0;
+int total = 0;
+
+void check(const std::string& name, bool ok, const char* detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name.c_str(), detail);
+}
+
+int main() {
+  char detail[256];
+  printf("Baseline: one message per reading every %lus (%lu per sensor per day)\n\n",
+         TEMP_READ_INTERVAL_MS / 1000, DAY_MS / TEMP_READ_INTERVAL_MS);
+
+  int sentTotal = 0;
+  int baselineTotal = 0;
+  for (int events = 0; events < 2; events++) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    // Slow daily drift, sensor noise at 0.1 resolution and (with events) a
+    // heating cycle in the morning
+    TempReplay r = replayTemperature(DAY_MS, [&](unsigned long t) {
+      double hours = t / 3600000.0;
+      double temp = 21.0 + 0.8 * sin(2 * M_PI * hours / 24) + 0.05 * gauss(rng);
+      double hum = 45.0 + 2.0 * sin(2 * M_PI * hours / 24 + 1) + 0.3 * gauss(rng);
+      if (events && hours >= 7.0 && hours < 9.0) {
+        temp += 3.0 * std::min(1.0, (hours - 7.0) * 2);
+      }
+      return std::make_pair(round1(temp), round1(hum));
+    });
+    int sent = r.reporter.sent.size();
+    sentTotal += sent;
+    baselineTotal += r.readings;
+    snprintf(detail, sizeof(detail), "%d/%d messages (%.1f%% saved), longest silence %.1f min, changes missed %d",
+             sent, r.readings, 100.0 * (r.readings - sent) / r.readings, maxGap(r.reporter) / 60000.0, r.missed);
+    check(events ? "temperature, room with events" : "temperature, stable room",
+          r.missed == 0 && maxGap(r.reporter) <= REPORT_MAX_SILENCE_MS, detail);
+  }
+  for (int events = 0; events < 2; events++) {
+    GasReplay r = replayGas(events, true);
+    int sent = r.reporter.sent.size();
+    sentTotal += sent;
+    baselineTotal += r.readings;
+    snprintf(detail, sizeof(detail), "%d/%d messages (%.1f%% saved), longest silence %.1f min, changes missed %d",
+             sent, r.readings, 100.0 * (r.readings - sent) / r.readings, maxGap(r.reporter) / 60000.0, r.missed);
+    check(events ? "MQ7, room with events" : "MQ7, stable room",
+          r.missed == 0 && maxGap(r.reporter) <= REPORT_MAX_SILENCE_MS, detail);
+  }
+  printf("\nAll traces: %d/%d messages (%.1f%% saved)\n\n", sentTotal, baselineTotal,
+         100.0 * (baselineTotal - sentTotal) / baselineTotal);
+
+  // A quiet sensor still heartbeats so the backend can tell it from a dead one
+  {
+    TempReplay r = replayTemperature(DAY_MS, [](unsigned long) { return std::make_pair(21.0f, 45.0f); });
+    unsigned long expected = DAY_MS / REPORT_MAX_SILENCE_MS;
+    snprintf(detail, sizeof(detail), "%zu messages (expected %lu)", r.reporter.sent.size(), expected);
+    check("flat signal heartbeats", r.reporter.sent.size() == expected, detail);
+  }
+
+  // Drift far below the deadband per reading still gets reported once it adds up
+  {
+    TempReplay r = replayTemperature(3 * 3600000UL, [](unsigned long t) {
+      return std::make_pair(round1(20.0 + 2.0 * t / 3600000.0), 45.0f);
+    });
+    float largest = 0;
+    for (size_t i = 1; i < r.reporter.sent.size(); i++) {
+      largest = std::max(largest, r.reporter.sent[i].second.at("temperature") -
+                                      r.reporter.sent[i - 1].second.at("temperature"));
+    }
+    snprintf(detail, sizeof(detail), "%zu messages, largest step %.1f °C, changes missed %d",
+             r.reporter.sent.size(), largest, r.missed);
+    check("2 °C/h drift reported in small steps", r.missed == 0 && largest <= 0.3 + 1e-4, detail);
+  }
+
+  // The spike: the first reading above CRITICAL is published immediately
+  {
+    GasReplay r = replayGas(true, true);
+    unsigned long spikeMs = 12 * 3600000UL;
+    unsigned long first = 0;
+    for (auto& s : r.reporter.sent) {
+      if (s.first >= spikeMs) {
+        first = s.first;
+        break;
+      }
+    }
+    snprintf(detail, sizeof(detail), "first message %lus after the spike starts", (first - spikeMs) / 1000);
+    check("CO spike published on the first reading", first == spikeMs, detail);
+  }
+
+  // A one-sample 23 °C blip between two flat 21 °C reports: the report that
+  // covers it has a flat current reading, and must still go out at once
+  // with the blip as temperature_max
+  {
+    unsigned long blipMs = 23 * 60000UL + 10000;
+    TempReplay r = replayTemperature(3600000UL, [&](unsigned long t) {
+      return std::make_pair(t == blipMs ? 23.0f : 21.0f, 45.0f);
+    });
+    unsigned long nextReport = (blipMs / TEMP_READ_INTERVAL_MS + 1) * TEMP_READ_INTERVAL_MS;
+    unsigned long previous = 0;
+    const Values* blip = NULL;
+    for (auto& s : r.reporter.sent) {
+      if (s.first > blipMs) {
+        if (s.first == nextReport) {
+          blip = &s.second;
+        }
+        break;
+      }
+      previous = s.first;
+    }
+    float max = blip ? blip->at("temperature_max") : 0;
+    float samples = blip ? blip->at("samples") : 0;
+    snprintf(detail, sizeof(detail), "report at +%lus with max %.1f °C over %.0f samples since the one at %lu min",
+             blip ? (nextReport - blipMs) / 1000 : 0, max, samples, previous / 60000);
+    check("spike reaches the first report after it",
+          blip != NULL && max == 23.0f &&
+              samples == (float)((nextReport - previous) / TEMP_SAMPLE_INTERVAL_MS),
+          detail);
+  }
+
+  // The broker is down for one report: it is queued but the deadband still
+  // counts from 21.0, so the same 22.0 reading is reported again once the
+  // broker is back, and the heartbeat clock keeps running from the last
+  // delivered report
+  {
+    resetReporting();
+    Reporter r{TEMP_DRIVER};
+    auto reading = [&](unsigned long t, float temp, bool brokerUp) {
+      shimSetMillis(t);
+      JsonDocument doc;
+      doc["temperature"] = temp;
+      doc["humidity"] = 45.0f;
+      return publish(r, doc, brokerUp);
+    };
+    bool first = reading(0, 21.0f, true);
+    bool queued = reading(30000, 22.0f, false);
+    bool resent = reading(60000, 22.0f, true);
+    bool quiet = !reading(90000, 22.0f, true);
+    bool heartbeat = reading(60000 + REPORT_MAX_SILENCE_MS, 22.0f, true);
+    snprintf(detail, sizeof(detail), "%zu delivered, %d queued, re-sent after the outage: %s",
+             r.sent.size(), r.queued, resent ? "yes" : "no");
+    check("undelivered report doesn't move the deadband",
+          first && queued && resent && quiet && heartbeat && r.sent.size() == 3 && reportsPublished == 3, detail);
+  }
+
+  // Hovering around the HIGH threshold: level flaps without hysteresis
+  {
+    GasReplay plain = replayGas(true, false, 18 * 3600000UL, 19 * 3600000UL);
+    GasReplay damped = replayGas(true, true, 18 * 3600000UL, 19 * 3600000UL);
+    snprintf(detail, sizeof(detail), "%d level changes without, %d with (%zu vs %zu messages)",
+             plain.levelChanges, damped.levelChanges, plain.reporter.sent.size(), damped.reporter.sent.size());
+    check("hysteresis stops level flapping at 15 ppm", damped.levelChanges * 10 <= plain.levelChanges, detail);
+  }
+
+  // Hysteresis never delays escalation
+  {
+    const float ppm[] = {2, 6, 16, 36, 34, 32, 31, 30, 14, 13, 4.6, 4.4};
+    const GasLevel expected[] = {GAS_LOW, GAS_MEDIUM, GAS_HIGH, GAS_CRITICAL, GAS_CRITICAL, GAS_CRITICAL,
+                                 GAS_HIGH, GAS_HIGH, GAS_HIGH, GAS_MEDIUM, GAS_MEDIUM, GAS_LOW};
+    GasLevel level = GAS_LOW;
+    bool ok = true;
+    std::string levels;
+    for (int i = 0; i < 12; i++) {
+      level = applyGasHysteresis(level, ppm[i]);
+      ok &= level == expected[i];
+      levels += std::string(i ? " " : "") + "LMHC"[level];
+    }
+    check("escalates at once, steps down 10% below the threshold", ok, levels.c_str());
+  }
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
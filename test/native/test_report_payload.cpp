@@ -0,0 +1,154 @@
+// Report payload sizing test
+//
+// Fills the report windows with worst-case readings through the real
+// windowStatsAdd()/serializeWindowStats() (src/window_stats.h), builds the
+// largest temperature and MQ7 summary reports with every field the
+// firmware adds (full-width numbers, four DS18B20 probes), and queues them
+// through mqttOutboxPush() (src/mqtt_outbox.h). Every report must fit an
+// outbox slot and a single PubSubClient packet, and the outbox must keep
+// its drop-oldest behaviour.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/window_stats.h"
+#include "../../src/mqtt_outbox.h"
+
+#include <random>
+
+const char* DEVICE_ID = "esp32s3_sensor_01";
+const unsigned long LATE_TIMESTAMP = 4102444799UL; // 2099-12-31, widest unix time
+const char* TEMPERATURE_TOPIC = "sensor_ABCDEF/sensors/temperature";
+const char* GAS_TOPIC = "sensor_ABCDEF/sensors/airquality";
+
+int failed = 0;
+int total = 0;
+
+void check(const char* name, bool ok, const std::string& detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name, detail.c_str());
+}
+
+// readAndPublishSensor(): envelope, then the driver's fields, then reportDue()
+void addEnvelope(JsonDocument& doc) {
+  doc["device_id"] = DEVICE_ID;
+  doc["timestamp"] = LATE_TIMESTAMP;
+}
+
+// serializeTemperature() for a DHT22 over a 30 s report (6 reads), readings
+// chosen so every number prints at full width
+std::string temperatureReport(bool dht22, std::mt19937& rng) {
+  std::normal_distribution<float> noise(0.0f, 0.37f);
+  WindowStats temp;
+  WindowStats humidity;
+  windowStatsReset(temp);
+  windowStatsReset(humidity);
+  for (int i = 0; i < 6; i++) {
+    windowStatsAdd(temp, -12.3456f + noise(rng));
+    windowStatsAdd(humidity, 87.6543f + noise(rng));
+  }
+  JsonDocument doc;
+  addEnvelope(doc);
+  doc["temperature"] = -12.3456f;
+  doc["humidity"] = dht22 ? 87.6543f : 0.0f;
+  doc["unit"] = "celsius";
+  serializeWindowStats(doc, "temperature", temp);
+  if (dht22) {
+    serializeWindowStats(doc, "humidity", humidity);
+  }
+  doc["samples"] = temp.count;
+  if (!dht22) {
+    JsonArray probes = doc["sensors"].to<JsonArray>();
+    for (int i = 0; i < 4; i++) {
+      JsonObject probe = probes.add<JsonObject>();
+      probe["rom"] = "28FF1234567890AB";
+      probe["temperature"] = -12.3456f + i;
+    }
+  }
+  doc["last_value_unchanged_since"] = LATE_TIMESTAMP;
+  String json;
+  serializeJson(doc, json);
+  return json.c_str();
+}
+
+// serializeGas() after a 30 s window of the 100 Hz filtered stream
+std::string gasReport(std::mt19937& rng) {
+  std::normal_distribution<float> noise(0.0f, 3.7f);
+  WindowStats gas;
+  windowStatsReset(gas);
+  for (int i = 0; i < 3000; i++) {
+    windowStatsAdd(gas, 1234.567f + noise(rng));
+  }
+  JsonDocument doc;
+  addEnvelope(doc);
+  doc["sensor_type"] = "MQ7";
+  doc["gas_type"] = "CO";
+  doc["ppm"] = 1234.567f;
+  doc["unit"] = "ppm";
+  doc["level"] = "CRITICAL";
+  doc["r0_kohm"] = 123.4567f;
+  doc["r0_source"] = "default";
+  serializeWindowStats(doc, "ppm", gas);
+  doc["samples"] = gas.count;
+  doc["last_value_unchanged_since"] = LATE_TIMESTAMP;
+  String json;
+  serializeJson(doc, json);
+  return json.c_str();
+}
+
+void resetOutbox() {
+  mqttOutboxHead = 0;
+  mqttOutboxCount = 0;
+  mqttOutboxDropped = 0;
+}
+
+void checkQueued(const char* name, const char* topic, const std::string& payload) {
+  resetOutbox();
+  bool queued = mqttOutboxPush(topic, payload.c_str());
+  const MQTTOutboxMessage* msg = mqttOutboxFront();
+  bool intact = queued && msg != NULL && payload == msg->payload;
+  size_t packet = MQTT_PACKET_OVERHEAD + strlen(topic) + payload.size();
+  check(name, intact && packet <= (size_t)MQTT_BUFFER_SIZE,
+        std::to_string(payload.size()) + " B payload, " + std::to_string(packet) + "/" +
+            std::to_string(MQTT_BUFFER_SIZE) + " B packet" + (payload.size() >= 320 ? " (the old 320 B slot dropped it)" : ""));
+}
+
+int main() {
+  std::mt19937 rng(45);
+
+  std::string dht22 = temperatureReport(true, rng);
+  std::string ds18b20 = temperatureReport(false, rng);
+  std::string gas = gasReport(rng);
+  printf("DHT22 report: %s\n\n", dht22.c_str());
+
+  checkQueued("DHT22 summary fits a slot", TEMPERATURE_TOPIC, dht22);
+  checkQueued("4x DS18B20 summary fits a slot", TEMPERATURE_TOPIC, ds18b20);
+  checkQueued("MQ7 summary fits a slot", GAS_TOPIC, gas);
+
+  // A payload that could never be sent is refused rather than wedging the
+  // flush at the head of the queue
+  resetOutbox();
+  std::string huge(MQTT_BUFFER_SIZE, 'x');
+  bool refused = !mqttOutboxPush(GAS_TOPIC, huge.c_str()) && mqttOutboxCount == 0 && mqttOutboxDropped == 1;
+  check("unsendable payload refused", refused, std::to_string(mqttOutboxDropped) + " dropped");
+
+  // Full outbox: the oldest report goes, the rest flush in order
+  resetOutbox();
+  for (int i = 0; i < MQTT_OUTBOX_SIZE + 2; i++) {
+    std::string payload = gas;
+    payload.replace(payload.find("CRITICAL"), 8, "LEVEL" + std::to_string(100 + i));
+    mqttOutboxPush(GAS_TOPIC, payload.c_str());
+  }
+  bool order = mqttOutboxCount == MQTT_OUTBOX_SIZE && mqttOutboxDropped == 2;
+  for (int i = 2; order && i < MQTT_OUTBOX_SIZE + 2; i++) {
+    const MQTTOutboxMessage* msg = mqttOutboxFront();
+    order = msg != NULL && strstr(msg->payload, ("LEVEL" + std::to_string(100 + i)).c_str()) != NULL;
+    mqttOutboxPop();
+  }
+  check("full outbox drops the oldest", order && mqttOutboxFront() == NULL,
+        std::to_string(mqttOutboxDropped) + " dropped, " + std::to_string(MQTT_OUTBOX_SIZE) + " flushed in order");
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
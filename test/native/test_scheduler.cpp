@@ -0,0 +1,241 @@
+// Deadline scheduler fake-clock test
+//
+// Builds addScheduledTask() / armScheduledTask() / runDueTasks() from
+// src/scheduler.h against the shim's fake millis() clock. Callbacks advance
+// the clock by their cost, and loop() sleeps for whatever runDueTasks()
+// returns unless an event wakes it early. It checks that periodic tasks run
+// on their deadlines, that lateness is measured and bounded, that a stall
+// doesn't replay missed periods in a burst, that one-shot tasks run once and
+// can be re-armed, and that deadlines survive the millis() wrap.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/scheduler.h"
+
+#include <climits>
+#include <set>
+#include <string>
+#include <vector>
+
+struct Run {
+  std::string name;
+  unsigned long at;  // millis() when it ran
+  unsigned long due; // the deadline it ran for
+};
+std::vector<Run> runLog;
+
+// Mock callbacks, one slot per task id: each run costs mockCostMs[slot]
+unsigned long mockCostMs[MAX_SCHEDULED_TASKS];
+
+template <int SLOT>
+void mockTask() {
+  const ScheduledTask& task = scheduledTasks[SLOT];
+  // runDueTasks() has already moved a periodic task's deadline on, so log
+  // the one it ran for (now, if it was rescheduled after a stall)
+  unsigned long due = task.period == 0 ? task.due : task.due - task.period;
+  runLog.push_back({task.name, millis(), due});
+  shimAdvanceMs(mockCostMs[SLOT]);
+}
+
+const TaskCallback MOCK_TASKS[] = {mockTask<0>, mockTask<1>, mockTask<2>, mockTask<3>};
+
+void reset(unsigned long startMs = 0) {
+  scheduledTaskCount = 0;
+  schedLateMaxMs = schedLateTotalMs = schedRunCount = 0;
+  runLog.clear();
+  shimNowMs = startMs;
+  shimNowUs = 0;
+}
+
+int add(const char* name, unsigned long costMs, unsigned long period, unsigned long firstDelay,
+        bool armed = true) {
+  mockCostMs[scheduledTaskCount] = costMs;
+  return addScheduledTask(name, MOCK_TASKS[scheduledTaskCount], period, firstDelay, armed);
+}
+
+struct Event {
+  unsigned long atMs; // offset from the start of loopFor()
+  int taskId;
+};
+
+// loop(): run, then sleep until the next deadline or an event armed with
+// delay 0 through wakeLoop()
+void loopFor(unsigned long durationMs, std::vector<Event> events = {}) {
+  unsigned long elapsed = 0;
+  size_t next = 0;
+  while (elapsed < durationMs) {
+    unsigned long before = millis();
+    unsigned long sleepMs = runDueTasks();
+    elapsed += millis() - before;
+    if (next < events.size() && events[next].atMs <= elapsed + sleepMs) {
+      unsigned long step = events[next].atMs > elapsed ? events[next].atMs - elapsed : 0;
+      shimAdvanceMs(step);
+      elapsed += step;
+      armScheduledTask(events[next].taskId, 0);
+      next++;
+    } else {
+      shimAdvanceMs(sleepMs);
+      elapsed += sleepMs;
+    }
+  }
+}
+
+std::vector<Run> runsOf(const char* name) {
+  std::vector<Run> out;
+  for (const Run& r : runLog) {
+    if (r.name == name) {
+      out.push_back(r);
+    }
+  }
+  return out;
+}
+
+std::string times(const std::vector<Run>& runs, unsigned long origin = 0) {
+  std::string out = "[";
+  for (size_t i = 0; i < runs.size() && i < 8; i++) {
+    out += (i ? ", " : "") + std::to_string(runs[i].at - origin);
+  }
+  return out + (runs.size() > 8 ? ", ...]" : "]");
+}
+
+int failed = 0;
+int total = 0;
+
+void check(const char* name, bool ok, const std::string& detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name, detail.c_str());
+}
+
+int main() {
+  // Periodic tasks alone run exactly on their deadlines
+  reset();
+  add("display", 0, 100, 0);
+  add("sensor", 0, 30000, 30000);
+  loopFor(120000);
+  {
+    std::vector<Run> display = runsOf("display");
+    std::vector<Run> sensor = runsOf("sensor");
+    bool onGrid = display.size() == 1200;
+    for (size_t i = 0; i < display.size(); i++) {
+      onGrid &= display[i].at == i * 100;
+    }
+    bool ok = onGrid && sensor.size() == 3 && sensor[0].at == 30000 && sensor[1].at == 60000 &&
+              sensor[2].at == 90000 && schedLateMaxMs == 0;
+    check("periodic deadlines", ok,
+          "display " + std::to_string(display.size()) + " runs, sensor at " + times(sensor) +
+              ", late max " + std::to_string(schedLateMaxMs) + " ms");
+  }
+
+  // Sleep is the time to the earliest deadline, capped, and 0 when overdue
+  {
+    reset();
+    add("slow", 0, 5000, 2500);
+    unsigned long first = runDueTasks();
+    shimAdvanceMs(1000);
+    add("soon", 0, 300, 40);
+    unsigned long second = runDueTasks();
+    reset();
+    add("display", 0, 100, 0);
+    add("camera", 150, 100, 0); // runs past the display's next deadline
+    unsigned long third = runDueTasks();
+    check("sleep until the next deadline", first == 1000 && second == 40 && third == 0,
+          std::to_string(first) + " ms with nothing due soon, " + std::to_string(second) +
+              " ms to a 40 ms deadline, " + std::to_string(third) + " ms when overdue");
+  }
+
+  // Lateness: a costly task delays the others by at most its own cost, and
+  // the cadence is kept (deadlines stay on the 100 ms grid)
+  {
+    reset();
+    add("camera", 60, 100, 0);
+    add("mqtt", 2, 100, 0);
+    add("display", 1, 100, 0);
+    loopFor(60000);
+    std::vector<Run> mqtt = runsOf("mqtt");
+    std::vector<Run> display = runsOf("display");
+    bool grid = true;
+    for (const Run& r : mqtt) grid &= r.due % 100 == 0;
+    for (const Run& r : display) grid &= r.due % 100 == 0;
+    char avg[32];
+    snprintf(avg, sizeof(avg), "%.1f", (double)schedLateTotalMs / schedRunCount);
+    check("lateness bounded, cadence kept",
+          schedLateMaxMs <= 60 + 2 && grid && display.size() == 600 && mqtt.size() == 600,
+          "late max " + std::to_string(schedLateMaxMs) + " ms, avg " + avg + " ms, display " +
+              std::to_string(display.size()) + "/600 runs, mqtt " + std::to_string(mqtt.size()) +
+              "/600 runs");
+  }
+
+  // A 5 s stall runs an overdue 100 ms task once, then resumes from now
+  {
+    reset();
+    add("display", 0, 100, 0);
+    add("ota", 5000, 0, 250);
+    loopFor(6000);
+    std::vector<Run> after;
+    for (const Run& r : runsOf("display")) {
+      if (r.at > 250 && r.at <= 5400) {
+        after.push_back(r);
+      }
+    }
+    check("no burst after a stall", after.size() == 2 && after[0].at == 5250 && after[1].at == 5350,
+          "display runs after the stall at " + times(after) + ", ota ran " +
+              std::to_string(runsOf("ota").size()) + "x, late max " + std::to_string(schedLateMaxMs) +
+              " ms");
+  }
+
+  // One-shot: runs once, stays disarmed until re-armed; tasks created
+  // disarmed never run until armed
+  {
+    reset();
+    add("display", 0, 100, 0);
+    int otaStart = add("ota_start", 0, 0, 1500);
+    add("ota_service", 0, 1, 0, false);
+    loopFor(5000);
+    size_t once = runsOf("ota_start").size();
+    armScheduledTask(otaStart, 200);
+    loopFor(1000);
+    std::vector<Run> again = runsOf("ota_start");
+    check("one-shot runs once and re-arms",
+          once == 1 && again.size() == 2 && again[0].at == 1500 && again[1].at == 5200 &&
+              runsOf("ota_service").empty(),
+          "ran at " + times(again) + ", disarmed task ran " +
+              std::to_string(runsOf("ota_service").size()) + "x");
+  }
+
+  // An event arms a task with delay 0 and cuts the sleep short
+  {
+    reset();
+    add("display", 0, 1000, 0);
+    int conn = add("connections", 0, 0, 0, false);
+    loopFor(3000, {{1234, conn}});
+    std::vector<Run> runs = runsOf("connections");
+    check("event wakes the loop", runs.size() == 1 && runs[0].at == 1234,
+          "connections ran at " + times(runs) + ", late max " + std::to_string(schedLateMaxMs) + " ms");
+  }
+
+  // millis() wraps (at 2^32 on the ESP32, 2^64 here); signed differences
+  // keep deadlines across it
+  {
+    unsigned long start = ULONG_MAX - 249;
+    reset(start);
+    add("display", 0, 100, 0);
+    add("sensor", 0, 30000, 30000);
+    loopFor(61000);
+    std::vector<Run> display = runsOf("display");
+    std::set<unsigned long> steps;
+    for (size_t i = 1; i < display.size(); i++) {
+      steps.insert(display[i].at - display[i - 1].at);
+    }
+    bool ok = steps.size() == 1 && *steps.begin() == 100 && runsOf("sensor").size() == 2 &&
+              schedLateMaxMs == 0;
+    check("millis() wraparound", ok,
+          std::to_string(display.size()) + " display runs, step " +
+              (steps.size() == 1 ? std::to_string(*steps.begin()) : std::string("uneven")) +
+              " ms, sensor " + std::to_string(runsOf("sensor").size()) + " runs");
+  }
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
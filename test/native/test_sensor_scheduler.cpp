@@ -0,0 +1,163 @@
+// Sensor driver scheduling test
+//
+// Builds the scheduler (src/scheduler.h) and the driver registry
+// (src/sensor_registry.h) as they are compiled into the firmware, and runs
+// them against mock sensor drivers whose callbacks advance the fake clock by
+// a fixed cost. It checks that several drivers enabled together each get
+// their full sample rate, that a slow driver (the camera) can't starve the
+// others, and that lateness stays bounded by one pass over the other tasks,
+// using the per-driver stats the status payload publishes. The NVS/MQTT
+// sensor list parsing (parseSensorList) is covered as well.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/sensor_registry.h"
+
+#include <cstring>
+
+const unsigned long SIM_MS = 10 * 60 * 1000;
+
+// Mock callbacks, one slot per task: each run costs mockCostMs[slot]
+const int MOCK_SLOTS = 16;
+unsigned long mockCostMs[MOCK_SLOTS];
+unsigned long mockRuns[MOCK_SLOTS];
+
+template <int SLOT>
+void mockTask() {
+  mockRuns[SLOT]++;
+  shimAdvanceMs(mockCostMs[SLOT]);
+}
+
+// Same names, types and periods as the firmware table; costs from the
+// stall_max figures each path reports: camera frame diff, DMA drain,
+// ADC->ppm + publish. Driver i polls in slot 2i and samples in slot 2i+1.
+SensorDriver sensorDrivers[] = {
+  {SENSOR_DHT_TEMP, "temperature", "temperature", NULL, NULL, 0, mockTask<1>, 30000, NULL, NULL},
+  {SENSOR_MQ7_GAS, "mq7", "airquality", NULL, mockTask<2>, 100, mockTask<3>, 30000, NULL, NULL},
+  {SENSOR_SENSE, "sense", NULL, NULL, mockTask<4>, 100, mockTask<5>, 60000, NULL, NULL},
+  {SENSOR_SENSE_CAMERA, "sense_camera", NULL, NULL, mockTask<6>, 100, NULL, 0, NULL, NULL},
+};
+const int SENSOR_DRIVER_COUNT = sizeof(sensorDrivers) / sizeof(sensorDrivers[0]);
+const unsigned long DRIVER_COST_MS[] = {0, 4, 2, 15, 1, 10, 60, 0};
+
+int failed = 0;
+int total = 0;
+
+void check(const char* name, bool ok, const std::string& detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name, detail.c_str());
+}
+
+void resetScheduler() {
+  scheduledTaskCount = 0;
+  schedLateMaxMs = schedLateTotalMs = schedRunCount = schedSleepTotalMs = 0;
+  schedStallMaxUs = 0;
+  memset(sensorDriverStats, 0, sizeof(sensorDriverStats));
+  memset(mockRuns, 0, sizeof(mockRuns));
+  shimNowMs = shimNowUs = 0;
+}
+
+// initScheduler(): display, then each enabled driver's poll and sample, then
+// the system tasks (jwt and ota_check wait one period before their first run)
+void buildScheduler() {
+  for (int i = 0; i < 8; i++) {
+    mockCostMs[i] = DRIVER_COST_MS[i];
+  }
+  mockCostMs[8] = 1;
+  addScheduledTask("display", mockTask<8>, 100, 0, true);
+  addSensorDriverTasks(0);
+  mockCostMs[9] = 1;
+  mockCostMs[10] = 2;
+  mockCostMs[11] = 1;
+  mockCostMs[12] = 1;
+  addScheduledTask("connections", mockTask<9>, 1000, 0, true);
+  addScheduledTask("mqtt", mockTask<10>, 50, 0, true);
+  addScheduledTask("jwt", mockTask<11>, 60000, 60000, true);
+  addScheduledTask("ota_check", mockTask<12>, 3600000, 3600000, true);
+}
+
+int slotOf(TaskCallback cb) {
+  TaskCallback slots[] = {mockTask<0>, mockTask<1>, mockTask<2>, mockTask<3>,
+                          mockTask<4>, mockTask<5>, mockTask<6>, mockTask<7>,
+                          mockTask<8>, mockTask<9>, mockTask<10>, mockTask<11>,
+                          mockTask<12>};
+  for (int i = 0; i < (int)(sizeof(slots) / sizeof(slots[0])); i++) {
+    if (slots[i] == cb) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void checkCombo(const char* list) {
+  resetScheduler();
+  enabledSensors = parseSensorList(list);
+  buildScheduler();
+  unsigned long firstDue[MAX_SCHEDULED_TASKS];
+  unsigned long costSum = 0;
+  for (int i = 0; i < scheduledTaskCount; i++) {
+    firstDue[i] = scheduledTasks[i].due;
+    costSum += mockCostMs[slotOf(scheduledTasks[i].callback)];
+  }
+
+  while (millis() < SIM_MS) {
+    shimAdvanceMs(runDueTasks());
+  }
+
+  printf("\n=== %s ===\n", list);
+  printf("  %-22s %6s %8s\n", "task", "runs", "expected");
+  bool ok = true;
+  for (int i = 0; i < scheduledTaskCount; i++) {
+    const ScheduledTask& task = scheduledTasks[i];
+    unsigned long runs = mockRuns[slotOf(task.callback)];
+    unsigned long expected = SIM_MS > firstDue[i] ? (SIM_MS - firstDue[i] - 1) / task.period + 1 : 0;
+    // Every periodic task keeps at least 95% of its rate
+    bool starved = runs < expected * 95 / 100;
+    ok &= !starved;
+    std::string name = task.name;
+    if (task.owner >= 0) {
+      name += slotOf(task.callback) % 2 == 0 ? ".poll" : ".sample";
+    }
+    printf("  %-22s %6lu %8lu%s\n", name.c_str(), runs, expected, starved ? "  <-- starved" : "");
+  }
+  for (int i = 0; i < SENSOR_DRIVER_COUNT; i++) {
+    const SensorDriverStats& stats = sensorDriverStats[i];
+    if (stats.runs > 0) {
+      printf("  driver %-14s late_max %3lu ms, run_max %3lu ms, %lu runs\n", sensorDrivers[i].name,
+             stats.lateMaxMs, stats.runMaxUs / 1000, stats.runs);
+    }
+  }
+  // A pass never waits for a task twice, so lateness is bounded by one pass
+  // of every task's cost
+  ok &= schedLateMaxMs <= costSum;
+  printf("  worst lateness %lu ms (bound %lu ms), worst stall %lu ms in %s\n", schedLateMaxMs, costSum,
+         schedStallMaxUs / 1000, schedStallTask);
+  check(list, ok, "rates and lateness");
+}
+
+int main() {
+  struct {
+    const char* list;
+    const char* expected;
+  } cases[] = {
+    {"mq7,sense_camera", "mq7,sense_camera"},
+    {"temperature, mq7 ,bogus", "temperature,mq7"},
+    {"sense,sense_camera", "sense"},
+    {"", ""},
+  };
+  for (auto& c : cases) {
+    String got = sensorListString(parseSensorList(c.list));
+    check((std::string("parse '") + c.list + "'").c_str(), got == c.expected,
+          std::string("'") + got.c_str() + "'");
+  }
+
+  checkCombo("sense_camera");
+  checkCombo("mq7,sense_camera");
+  checkCombo("temperature,mq7,sense_camera");
+  checkCombo("temperature,mq7,sense");
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
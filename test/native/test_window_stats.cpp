@@ -0,0 +1,164 @@
+// Report window statistics check
+//
+// Builds windowStatsAdd() / windowStatsQuantile() from src/window_stats.h
+// (Welford mean/variance plus the P-square p95 estimator) in float, like the
+// ESP32-S3 FPU runs them. It feeds the window sizes the firmware actually
+// sees - the 100 Hz MQ7 filter output over a 30 s report (3000 samples) and
+// the 5 s temperature reads over the same window (6 samples, inside the
+// exact buffer) - and compares the summaries with exact statistics over the
+// same data. P-square errors are given both as quantile rank and as a share
+// of the window's range, since a trending window (rising CO) is its known
+// weak spot.
+//
+// Run: make -C test/native
+
+#include "arduino_shim.h"
+#include "../../src/window_stats.h"
+
+#include <algorithm>
+#include <random>
+
+int failed = 0;
+int total = 0;
+
+void check(const std::string& name, bool ok, const char* detail) {
+  total++;
+  failed += !ok;
+  printf("%s %s: %s\n", ok ? "✅" : "❌", name.c_str(), detail);
+}
+
+// Linear interpolation between order statistics (numpy's default)
+double exactQuantile(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  double pos = WINDOW_QUANTILE * (values.size() - 1);
+  size_t lo = (size_t)pos;
+  size_t hi = std::min(lo + 1, values.size() - 1);
+  return values[lo] + (values[hi] - values[lo]) * (pos - lo);
+}
+
+double sampleVariance(const WindowStats& w) {
+  return w.count > 1 ? w.m2 / (w.count - 1) : 0.0;
+}
+
+// 3000 filtered MQ7 values (100 Hz x 30 s), already rounded to float
+std::vector<double> gasWindow(std::mt19937& rng, const std::string& kind) {
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  std::vector<double> values;
+  for (int i = 0; i < 3000; i++) {
+    double v;
+    if (kind == "steady") {
+      v = 2.0 + 0.2 * gauss(rng);
+    } else if (kind == "rising") {
+      v = 2.0 + 10.0 * i / 3000 + 0.3 * gauss(rng);
+    } else if (kind == "spike") {
+      // 4 s burst of CO in the middle of the window
+      v = 2.0 + 0.2 * gauss(rng) + (i >= 1500 ? 30.0 * exp(-(i - 1500) / 150.0) : 0.0);
+    } else {
+      // heavy tail: lognormal around 5 ppm
+      v = 5.0 * exp(0.5 * gauss(rng));
+    }
+    values.push_back((float)v);
+  }
+  return values;
+}
+
+int main() {
+  std::mt19937 rng(7);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  char detail[256];
+
+  const char* kinds[] = {"steady", "rising", "spike", "lognormal"};
+  for (const char* kind : kinds) {
+    double worstRank = 0, worstValue = 0, worstMean = 0, worstVar = 0;
+    bool extremes = true;
+    for (int run = 0; run < 20; run++) {
+      std::vector<double> values = gasWindow(rng, kind);
+      WindowStats w;
+      windowStatsReset(w);
+      for (double v : values) {
+        windowStatsAdd(w, v);
+      }
+      double mean = 0;
+      for (double v : values) mean += v;
+      mean /= values.size();
+      double var = 0;
+      for (double v : values) var += (v - mean) * (v - mean);
+      var /= values.size() - 1;
+      std::vector<double> ordered = values;
+      std::sort(ordered.begin(), ordered.end());
+      double p95 = windowStatsQuantile(w);
+      // Error expressed as quantile rank: where the estimate lands in the data
+      double rank = (double)(std::upper_bound(ordered.begin(), ordered.end(), p95) - ordered.begin()) /
+                    ordered.size();
+      worstRank = std::max(worstRank, fabs(rank - WINDOW_QUANTILE));
+      worstValue = std::max(worstValue, fabs(p95 - exactQuantile(values)) / (w.max - w.min));
+      worstMean = std::max(worstMean, fabs(w.mean - mean) / std::max(fabs(mean), 1e-9));
+      worstVar = std::max(worstVar, fabs(sampleVariance(w) - var) / var);
+      extremes &= w.min == ordered.front() && w.max == ordered.back();
+    }
+    snprintf(detail, sizeof(detail),
+             "p95 rank error %.2f pts (%.2f%% of range), mean rel err %.1e, variance rel err %.1e",
+             worstRank * 100, worstValue * 100, worstMean, worstVar);
+    check(std::string("MQ7 ") + kind + " window (3000 samples x 20)",
+          extremes && worstRank <= 0.02 && worstValue <= 0.05 && worstMean < 1e-4 && worstVar < 1e-3,
+          detail);
+  }
+
+  // DHT22 window: 6 reads at 0.1 degree resolution
+  double worst = 0;
+  for (int run = 0; run < 200; run++) {
+    std::vector<double> values;
+    WindowStats w;
+    windowStatsReset(w);
+    for (int i = 0; i < 6; i++) {
+      double v = (float)(round((21.0 + 0.15 * gauss(rng)) * 10) / 10);
+      values.push_back(v);
+      windowStatsAdd(w, v);
+    }
+    worst = std::max(worst, fabs(windowStatsQuantile(w) - exactQuantile(values)));
+  }
+  snprintf(detail, sizeof(detail), "worst p95 error %.3f °C against interpolated p95", worst);
+  check("temperature window (6 samples x 200)", worst <= 1e-5, detail);
+
+  // Three samples: 90% of the way from the middle one to the top one
+  {
+    WindowStats w;
+    windowStatsReset(w);
+    windowStatsAdd(w, 21.3f);
+    windowStatsAdd(w, 20.9f);
+    windowStatsAdd(w, 21.1f);
+    float p95 = windowStatsQuantile(w);
+    snprintf(detail, sizeof(detail), "p95 %.2f, mean %.2f, variance %.3f", p95, w.mean, sampleVariance(w));
+    check("short window",
+          fabs(p95 - 21.28) < 1e-5 && fabs(w.mean - 21.1) < 1e-5 && fabs(sampleVariance(w) - 0.04) < 1e-5,
+          detail);
+  }
+
+  // Welford in float stays accurate on a large offset where the naive
+  // sum-of-squares formula cancels catastrophically
+  {
+    std::vector<double> values;
+    WindowStats w;
+    windowStatsReset(w);
+    float naiveSum = 0, naiveSq = 0;
+    for (int i = 0; i < 3000; i++) {
+      float v = 1000.0 + 0.01 * gauss(rng);
+      values.push_back(v);
+      windowStatsAdd(w, v);
+      naiveSum += v;
+      naiveSq += v * v;
+    }
+    double mean = 0;
+    for (double v : values) mean += v;
+    mean /= values.size();
+    double var = 0;
+    for (double v : values) var += (v - mean) * (v - mean);
+    var /= values.size() - 1;
+    double naive = (naiveSq - naiveSum * naiveSum / values.size()) / (values.size() - 1);
+    snprintf(detail, sizeof(detail), "exact %.2e, Welford %.2e, naive float %.2e", var, sampleVariance(w), naive);
+    check("Welford vs naive variance at a 1000 offset", fabs(sampleVariance(w) - var) / var < 0.05, detail);
+  }
+
+  printf("\n%d/%d checks passed\n", total - failed, total);
+  return failed ? 1 : 0;
+}
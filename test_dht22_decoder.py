@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+DHT22 RMT frame decoder test
+
+Python port of decodeDHT22() in src/main.cpp. It decodes RMT captures of the
+DHT22 reply, given as rmt_item32_t words (level0, duration0, level1,
+duration1) in microseconds, the way the RMT receiver hands them over at
+clk_div 80. The captures cover clean frames, sensor-to-sensor timing spread,
+negative temperatures, and frames that must be rejected: a bad checksum,
+truncation, no response and a glitch inside a bit.
+
+Run: python3 test_dht22_decoder.py
+"""
+
+import random
+import sys
+
+# Keep in sync with src/main.cpp
+DHT22_BIT_THRESHOLD_US = 48
+DHT22_MAX_PULSES = 96
+
+
+def decode_dht22(items):
+    """Returns (temperature, humidity) or None"""
+    durations, levels = [], []
+    for level0, duration0, level1, duration1 in items:
+        for d, l in ((duration0, level0), (duration1, level1)):
+            if d == 0:
+                continue
+            if levels and levels[-1] == l:
+                durations[-1] += d
+            elif len(levels) < DHT22_MAX_PULSES:
+                durations.append(d)
+                levels.append(l)
+    pulses = len(levels)
+
+    p = 0
+    while p + 1 < pulses and not (levels[p] == 0 and 60 <= durations[p] <= 110 and
+                                  60 <= durations[p + 1] <= 110):
+        p += 1
+    p += 2
+    if p + 80 > pulses:
+        return None
+
+    data = [0] * 5
+    for bit in range(40):
+        low, high = durations[p], durations[p + 1]
+        if low < 30 or low > 80 or high < 10 or high > 95:
+            return None
+        data[bit // 8] = ((data[bit // 8] << 1) | (1 if high > DHT22_BIT_THRESHOLD_US else 0)) & 0xFF
+        p += 2
+    if (data[0] + data[1] + data[2] + data[3]) & 0xFF != data[4]:
+        return None
+
+    humidity = ((data[0] << 8) | data[1]) / 10.0
+    temp = (((data[2] & 0x7F) << 8) | data[3]) / 10.0
+    temperature = -temp if data[2] & 0x80 else temp
+    return (temperature, humidity) if humidity <= 100.0 else None
+
+
+def frame_bytes(temperature, humidity, corrupt_checksum=False):
+    h = round(humidity * 10)
+    t = round(abs(temperature) * 10) | (0x8000 if temperature < 0 else 0)
+    data = [h >> 8, h & 0xFF, t >> 8, t & 0xFF]
+    checksum = sum(data) & 0xFF
+    return data + [(checksum ^ 0x01) if corrupt_checksum else checksum]
+
+
+def capture(data, seed=0, zero_us=26, one_us=70, low_us=50, response_us=80, jitter=4):
+    """Build the RMT item words for a reply, as the receiver records it.
+
+    Capture starts at the end of the start signal (line still low), then the
+    pull-up (~30 us), the 80/80 us response, 40 bits and the 50 us end pulse,
+    after which the idle threshold ends the capture with a zero duration."""
+    rng = random.Random(seed)
+
+    def j(us):
+        return max(1, us + rng.randint(-jitter, jitter))
+
+    pulses = [(0, rng.randint(3, 20)), (1, j(30)), (0, j(response_us)), (1, j(response_us))]
+    for byte in data:
+        for bit in range(7, -1, -1):
+            pulses += [(0, j(low_us)), (1, j(one_us if byte >> bit & 1 else zero_us))]
+    pulses += [(0, j(50)), (1, 0)]
+    if len(pulses) % 2:
+        pulses.append((1, 0))
+    return [(pulses[i][0], pulses[i][1], pulses[i + 1][0], pulses[i + 1][1]) for i in range(0, len(pulses), 2)]
+
+
+def with_glitch(items, pulse_index, split_us=2):
+    """Split one pulse with a short opposite-level blip the filter let through"""
+    flat = [(l, d) for l0, d0, l1, d1 in items for l, d in ((l0, d0), (l1, d1))]
+    level, duration = flat[pulse_index]
+    flat[pulse_index:pulse_index + 1] = [(level, duration // 2), (1 - level, split_us),
+                                         (level, duration - duration // 2 - split_us)]
+    if len(flat) % 2:
+        flat.append((1, 0))
+    return [(flat[i][0], flat[i][1], flat[i + 1][0], flat[i + 1][1]) for i in range(0, len(flat), 2)]
+
+
+CASES = [
+    ("room air", capture(frame_bytes(21.4, 45.2)), (21.4, 45.2)),
+    ("humid and warm", capture(frame_bytes(35.0, 99.9), seed=1), (35.0, 99.9)),
+    ("freezer, negative temperature", capture(frame_bytes(-12.7, 60.0), seed=2), (-12.7, 60.0)),
+    ("-0.1 C sign bit only", capture(frame_bytes(-0.1, 80.5), seed=3), (-0.1, 80.5)),
+    ("slow sensor (zero 32 us, one 78 us, low 56 us)",
+     capture(frame_bytes(18.0, 30.0), seed=4, zero_us=32, one_us=78, low_us=56), (18.0, 30.0)),
+    ("fast sensor (zero 22 us, one 64 us, low 46 us)",
+     capture(frame_bytes(18.0, 30.0), seed=5, zero_us=22, one_us=64, low_us=46), (18.0, 30.0)),
+    ("heavy jitter (+-8 us)", capture(frame_bytes(24.9, 51.1), seed=6, jitter=8), (24.9, 51.1)),
+    ("bad checksum", capture(frame_bytes(21.4, 45.2, corrupt_checksum=True)), None),
+    ("truncated after 3 bytes", capture(frame_bytes(21.4, 45.2))[:26], None),
+    ("no response (line stays high)", [(1, 0, 1, 0)], None),
+    ("no response (empty capture)", [], None),
+    ("glitch inside a data bit", with_glitch(capture(frame_bytes(21.4, 45.2), seed=7), 30), None),
+    ("humidity over 100% rejected", capture([0x03, 0xF0, 0x00, 0xC8, (0x03 + 0xF0 + 0xC8) & 0xFF]), None),
+]
+
+
+def main():
+    failed = 0
+    for name, items, expected in CASES:
+        got = decode_dht22(items)
+        ok = got == expected if expected is None or got is None else (
+            abs(got[0] - expected[0]) < 0.05 and abs(got[1] - expected[1]) < 0.05)
+        failed += not ok
+        shown = "rejected" if got is None else f"{got[0]:.1f} C, {got[1]:.1f} %RH"
+        print(f"{'✅' if ok else '❌'} {name}: {shown}" + ("" if ok else f" (expected {expected})"))
+
+    print(f"\n{len(CASES) - failed}/{len(CASES)} captures decoded as expected")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+MQTT reconnect storm simulation
+
+Simulates a fleet of sensors losing the broker at the same moment (EMQX
+restart) and reconnecting, using the same scheduling as checkConnections() /
+scheduleMQTTReconnect() in src/main.cpp: capped exponential backoff with full
+jitter from a MAC-seeded xorshift32, plus the auth-failure circuit breaker.
+The old behaviour (immediate retry, then a fixed 10 s interval) is simulated
+alongside for comparison.
+
+The broker is modelled as down for --outage seconds and then able to answer
+--auth-rate JWT checks per second; attempts beyond that are refused with
+"server unavailable" (state 3). With --reject-auth the broker rejects every
+token (state 5) for the whole run, to exercise the circuit breaker.
+
+Example:
+  python3 test_mqtt_reconnect_storm.py --clients 500 --outage 30 --auth-rate 50
+  python3 test_mqtt_reconnect_storm.py --clients 500 --reject-auth --duration 900
+"""
+
+import argparse
+import random
+
+# Keep in sync with src/main.cpp
+MQTT_BACKOFF_BASE_MS = 2000
+MQTT_BACKOFF_MAX_MS = 120000
+MQTT_AUTH_BREAKER_THRESHOLD = 3
+MQTT_AUTH_BREAKER_OPEN_MS = 300000
+LEGACY_RETRY_INTERVAL_MS = 10000
+
+TICK_MS = 100
+MASK32 = 0xFFFFFFFF
+
+
+def seed_from_mac(mac):
+    """FNV-1a over the MAC string, as seedMQTTJitter()"""
+    state = 2166136261
+    for ch in mac.encode():
+        state = ((state ^ ch) * 16777619) & MASK32
+    return state or 1
+
+
+class BackoffClient:
+    """Port of the firmware reconnect scheduler"""
+
+    def __init__(self, mac):
+        self.state = seed_from_mac(mac)
+        self.failures = 0
+        self.auth_failures = 0
+        self.next_attempt = 0
+        self.connected = True
+        self.breaker_trips = 0
+
+    def random(self):
+        x = self.state
+        x ^= (x << 13) & MASK32
+        x ^= x >> 17
+        x ^= (x << 5) & MASK32
+        self.state = x
+        return x
+
+    def schedule(self, now, auth_failure):
+        if auth_failure:
+            self.auth_failures += 1
+            if self.auth_failures >= MQTT_AUTH_BREAKER_THRESHOLD:
+                self.next_attempt = now + MQTT_AUTH_BREAKER_OPEN_MS + self.random() % MQTT_BACKOFF_MAX_MS
+                self.breaker_trips += 1
+                return
+        else:
+            self.auth_failures = 0
+        window = MQTT_BACKOFF_MAX_MS
+        if self.failures < 16:
+            window = min(MQTT_BACKOFF_MAX_MS, MQTT_BACKOFF_BASE_MS << self.failures)
+        self.failures += 1
+        self.next_attempt = now + self.random() % (window + 1)
+
+    def on_session_lost(self, now):
+        self.connected = False
+        self.failures = 0
+        self.schedule(now, False)
+
+    def due(self, now):
+        return not self.connected and now >= self.next_attempt
+
+    def on_result(self, now, rc):
+        if rc == 0:
+            self.connected = True
+            self.failures = 0
+            self.auth_failures = 0
+        else:
+            self.schedule(now, rc in (4, 5))
+
+
+class LegacyClient:
+    """The previous fixed-interval loop: retry at once, then every 10 s"""
+
+    def __init__(self, mac, loop_phase_ms):
+        self.connected = True
+        self.next_attempt = 0
+        self.phase = loop_phase_ms
+        self.breaker_trips = 0
+
+    def on_session_lost(self, now):
+        self.connected = False
+        # Detected on the next pass through loop(); attempt goes out at once
+        self.next_attempt = now + self.phase
+
+    def due(self, now):
+        return not self.connected and now >= self.next_attempt
+
+    def on_result(self, now, rc):
+        if rc == 0:
+            self.connected = True
+        else:
+            self.next_attempt = now + LEGACY_RETRY_INTERVAL_MS + 1000  # + delay(1000)
+
+
+def simulate(clients, outage_s, auth_rate, reject_auth, duration_s):
+    per_second = [0] * duration_s
+    accepted = [0] * duration_s
+    now = 0
+    for c in clients:
+        c.on_session_lost(0)
+
+    all_connected_at = None
+    end = duration_s * 1000
+    while now < end:
+        sec = now // 1000
+        for c in clients:
+            if not c.due(now):
+                continue
+            per_second[sec] += 1
+            if now < outage_s * 1000:
+                rc = -2  # TCP connect refused while the broker is down
+            elif reject_auth:
+                rc = 5
+            elif accepted[sec] >= auth_rate:
+                rc = 3  # broker shedding load
+            else:
+                rc = 0
+                accepted[sec] += 1
+            c.on_result(now, rc)
+        if all_connected_at is None and all(c.connected for c in clients):
+            all_connected_at = now
+        now += TICK_MS
+    return per_second, all_connected_at
+
+
+def print_histogram(per_second, bucket_s=5, width=50):
+    buckets = [sum(per_second[i:i + bucket_s]) for i in range(0, len(per_second), bucket_s)]
+    top = max(buckets) or 1
+    for i, count in enumerate(buckets):
+        if count == 0:
+            continue
+        bar = "#" * max(1, count * width // top)
+        print(f"  {i * bucket_s:5d}s {count:6d} {bar}")
+
+
+def report(name, clients, outage_s, per_second, all_connected_at):
+    total = sum(per_second)
+    print(f"\n=== {name} ===")
+    print(f"Connect attempts: {total} total, peak {max(per_second)}/s")
+    print(f"Peak once the broker is back: {max(per_second[outage_s:] or [0])}/s")
+    if all_connected_at is not None:
+        print(f"Whole fleet reconnected after {all_connected_at / 1000:.1f}s")
+    else:
+        connected = sum(1 for c in clients if c.connected)
+        print(f"Not all reconnected: {connected}/{len(clients)}")
+    trips = sum(c.breaker_trips for c in clients)
+    if trips:
+        print(f"Auth circuit breaker trips: {trips}")
+    print("Attempts per 5 s:")
+    print_histogram(per_second)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate a fleet reconnecting after a broker restart")
+    parser.add_argument('--clients', type=int, default=500)
+    parser.add_argument('--outage', type=int, default=30, help="Seconds the broker is down")
+    parser.add_argument('--auth-rate', type=int, default=50, help="JWT checks the broker answers per second")
+    parser.add_argument('--reject-auth', action='store_true', help="Broker rejects every token")
+    parser.add_argument('--duration', type=int, default=300, help="Simulated seconds")
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    macs = [f"8CBFEA{rng.getrandbits(24):06X}" for _ in range(args.clients)]
+
+    print(f"{args.clients} clients, broker down {args.outage}s, "
+          f"{args.auth_rate} auth checks/s{', rejecting all tokens' if args.reject_auth else ''}")
+
+    legacy = [LegacyClient(mac, rng.randrange(0, 200)) for mac in macs]
+    report("Fixed 10 s retry (previous)", legacy, args.outage,
+           *simulate(legacy, args.outage, args.auth_rate, args.reject_auth, args.duration))
+
+    backoff = [BackoffClient(mac) for mac in macs]
+    report("Exponential backoff + full jitter", backoff, args.outage,
+           *simulate(backoff, args.outage, args.auth_rate, args.reject_auth, args.duration))
+
+
+if __name__ == "__main__":
+    main()
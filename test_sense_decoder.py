@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""
+Doorway two-beam decoder trace replay
+
+Python port of the SENSOR_SENSE edge decoder in src/main.cpp
+(settleSenseBeams / onSenseBeamChange / finishSenseCrossing). It replays
+synthetic beam edge traces - bouncing edges, glitches, fast passes and people
+overlapping in the doorway - and checks the enter/exit counts and the
+speed/dwell/confidence measured for each crossing.
+
+With light sleep on, the edge that wakes the chip is stamped only once the
+ISR runs, so it carries the wake-up latency and is flagged approximate; the
+wake traces delay that edge and check the decoder takes the speed from the
+clears instead. The direction still comes from the rise order, so a pass
+whose lead is shorter than the wake-up latency (a few ms on the S3) can't be
+told apart.
+
+Run: python3 test_sense_decoder.py
+"""
+
+import sys
+
+# Keep in sync with src/main.cpp
+SENSE_TIMEOUT_MS = 1000
+SENSE_DEBOUNCE_US = 3000
+SENSE_MIN_GAP_US = 2000
+SENSE_PENDING_MAX = 4
+SENSE_BEAM_SPACING_MM = 150.0
+SENSE_DWELL_TIMEOUT_MS = 5000
+SENSE_CROSSINGS_MAX = 4
+SENSE_WAKE_CONFIDENCE = 0.8
+
+A, B = 0, 1
+
+
+class SenseDecoder:
+    def __init__(self):
+        self.stable = [False, False]
+        self.pending = [False, False]
+        self.pending_level = [False, False]
+        self.pending_since = [0, 0]
+        self.pending_approx = [False, False]
+        self.last_edge = [0, 0]
+        self.waiting = [[], []]
+        self.crossings = []
+        self.events = []
+        self.crossings_measured = []
+        self.rejected = 0
+
+    def settle(self, now_us):
+        while True:
+            waiting = [b for b in (A, B) if self.pending[b]]
+            if not waiting:
+                return
+            beam = min(waiting, key=lambda b: self.pending_since[b])
+            if now_us - self.last_edge[beam] < SENSE_DEBOUNCE_US:
+                return
+            self.pending[beam] = False
+            if self.pending_level[beam] != self.stable[beam]:
+                self.stable[beam] = self.pending_level[beam]
+                self.on_change(beam, self.stable[beam], self.pending_since[beam], self.pending_approx[beam])
+
+    def expire(self, now_us):
+        for q in self.waiting:
+            while q and now_us - q[0]["rise"] > SENSE_TIMEOUT_MS * 1000:
+                q.pop(0)
+        while self.crossings and now_us - self.crossings[0]["second"]["rise"] > SENSE_DWELL_TIMEOUT_MS * 1000:
+            self.finish(0, now_us)
+
+    def on_change(self, beam, active, time_us, approximate=False):
+        self.expire(time_us)
+        if not active:
+            breaks = list(self.waiting[beam])
+            breaks += [c["first"] if c["first_beam"] == beam else c["second"] for c in self.crossings]
+            for b in breaks:
+                if not b["cleared"]:
+                    b["fall"], b["cleared"] = time_us, True
+            i = 0
+            while i < len(self.crossings):
+                c = self.crossings[i]
+                if c["first"]["cleared"] and c["second"]["cleared"]:
+                    self.finish(i, time_us)
+                else:
+                    i += 1
+            return
+        other = 1 - beam
+        if not self.waiting[other]:
+            if len(self.waiting[beam]) == SENSE_PENDING_MAX:
+                self.waiting[beam].pop(0)
+            self.waiting[beam].append({"rise": time_us, "fall": 0, "cleared": False, "approx": approximate})
+            return
+        first = self.waiting[other].pop(0)
+        if time_us - first["rise"] < SENSE_MIN_GAP_US:
+            self.rejected += 1
+            return
+        if len(self.crossings) == SENSE_CROSSINGS_MAX:
+            self.finish(0, time_us)
+        crowded = bool(self.crossings or self.waiting[A] or self.waiting[B])
+        for c in self.crossings:
+            c["overlapped"] |= crowded
+        self.crossings.append({"first_beam": other, "first": first, "overlapped": crowded,
+                               "second": {"rise": time_us, "fall": 0, "cleared": False, "approx": approximate}})
+
+    def finish(self, index, now_us):
+        c = self.crossings.pop(index)
+        first, second = c["first"], c["second"]
+        rise_lead = (second["rise"] - first["rise"]) / 1000.0
+        speed = SENSE_BEAM_SPACING_MM / rise_lead
+        confidence = 1.0
+        if first["cleared"] and second["cleared"]:
+            dwell = (second["fall"] - first["rise"]) // 1000
+            fall_lead = (second["fall"] - first["fall"]) / 1000.0
+            if fall_lead > 0 and (first["approx"] or second["approx"]):
+                speed = SENSE_BEAM_SPACING_MM / fall_lead
+                confidence *= SENSE_WAKE_CONFIDENCE
+            elif fall_lead > 0:
+                speed = (speed + SENSE_BEAM_SPACING_MM / fall_lead) / 2.0
+                confidence *= min(rise_lead, fall_lead) / max(rise_lead, fall_lead)
+            else:
+                confidence *= 0.3
+        else:
+            dwell = (now_us - first["rise"]) // 1000
+            confidence *= 0.5
+        if speed < 0.2 or speed > 3.0:
+            confidence *= 0.5
+        if c["overlapped"]:
+            confidence *= 0.7
+        self.events.append("enter" if c["first_beam"] == A else "exit")
+        self.crossings_measured.append((speed, dwell, confidence))
+
+    def edge(self, time_us, beam, active, approximate=False):
+        self.settle(time_us)
+        if not self.pending[beam]:
+            self.pending_since[beam] = time_us
+            self.pending_approx[beam] = approximate
+        self.pending[beam] = True
+        self.pending_level[beam] = active
+        self.last_edge[beam] = time_us
+
+    def replay(self, trace):
+        """trace: list of (time_ms, beam, active[, approximate]), in capture order"""
+        for t_ms, beam, active, *approximate in trace:
+            self.edge(int(t_ms * 1000), beam, active, *approximate)
+        end = trace[-1][0] if trace else 0
+        self.settle(int((end + 100) * 1000))
+        self.expire(int((end + SENSE_DWELL_TIMEOUT_MS + 100) * 1000))
+        return self.events
+
+
+def person(start_ms, direction, beam_ms=300, lead_ms=120):
+    """A single walker: the first beam breaks, the second follows lead_ms later"""
+    first, second = (A, B) if direction == "enter" else (B, A)
+    return [(start_ms, first, True), (start_ms + lead_ms, second, True),
+            (start_ms + beam_ms, first, False), (start_ms + lead_ms + beam_ms, second, False)]
+
+
+def bounce(t_ms, beam, active, count=3, spacing_ms=0.4):
+    """Mechanical/optical chatter: the level flips a few times before settling"""
+    edges = []
+    level = active
+    for i in range(count * 2 + 1):
+        edges.append((t_ms + i * spacing_ms, beam, level))
+        level = not level
+    return edges
+
+
+def woken(trace, latency_ms=30):
+    """The first edge wakes the chip from light sleep and is stamped late"""
+    t_ms, beam, active = trace[0]
+    return merged([(t_ms + latency_ms, beam, active, True)], trace[1:])
+
+
+def merged(*traces):
+    return sorted((e for t in traces for e in t), key=lambda e: e[0])
+
+
+CASES = [
+    ("single enter", person(0, "enter"), ["enter"]),
+    ("single exit", person(0, "exit"), ["exit"]),
+    ("fast pass (10 ms lead, 40 ms in beam)", person(0, "enter", beam_ms=40, lead_ms=10), ["enter"]),
+    ("bouncing edges",
+     merged(bounce(0, A, True), bounce(120, B, True), bounce(300, A, False), bounce(420, B, False)),
+     ["enter"]),
+    ("bouncy A breaks first, clean B right after",
+     merged(bounce(0, A, True, count=4, spacing_ms=1), [(6, B, True), (300, A, False), (310, B, False)]),
+     ["enter"]),
+    ("1 ms glitch on A only", [(0, A, True), (1, A, False)], []),
+    ("both beams at once (rejected by min gap)",
+     [(0, A, True), (0.5, B, True), (200, A, False), (200.5, B, False)], []),
+    ("A then B after the timeout", [(0, A, True), (100, A, False), (1500, B, True), (1700, B, False)], []),
+    ("two people overlapping, same direction",
+     merged(person(0, "enter"), person(350, "enter")), ["enter", "enter"]),
+    ("next person breaks A while previous still blocks B",
+     [(0, A, True), (120, B, True), (300, A, False), (320, A, True), (420, B, False),
+      (440, B, True), (600, A, False), (760, B, False)],
+     ["enter", "enter"]),
+    ("three tailgaters, each breaking B while the previous is still in A",
+     merged(person(0, "exit", beam_ms=250), person(320, "exit", beam_ms=250), person(640, "exit", beam_ms=250)),
+     ["exit", "exit", "exit"]),
+    ("enter then exit back to back", merged(person(0, "enter"), person(700, "exit")), ["enter", "exit"]),
+    ("woken by A, 30 ms wake-up latency", woken(person(0, "enter")), ["enter"]),
+    ("woken by B on a fast pass, 5 ms latency", woken(person(0, "exit", beam_ms=80, lead_ms=20), 5), ["exit"]),
+]
+
+
+# (name, trace, expected (speed m/s, dwell ms, minimum confidence, maximum confidence))
+MEASUREMENTS = [
+    ("steady walker 1.25 m/s", person(0, "enter"), (1.25, 420, 0.99, 1.0)),
+    ("fast pass 15 m/s", person(0, "enter", beam_ms=40, lead_ms=10), (15.0, 50, 0.0, 0.5)),
+    ("slowing down in the doorway",
+     [(0, A, True), (100, B, True), (400, A, False), (700, B, False)], (1.0, 700, 0.33, 0.34)),
+    ("turned around under B",
+     [(0, A, True), (150, B, True), (500, B, False), (600, A, False)], (1.0, 500, 0.29, 0.31)),
+    # measured until the replay's final expiry pass, 5.1 s after the last edge
+    ("never cleared", [(0, A, True), (150, B, True)], (1.0, 5250, 0.49, 0.51)),
+    # the rise lead reads 90 ms (1.67 m/s); the clears give the true pace
+    ("woken by A, 30 ms late", woken(person(0, "enter")), (1.25, 390, 0.79, 0.81)),
+    ("woken and never cleared", woken([(0, A, True), (150, B, True)]), (1.25, 5220, 0.49, 0.51)),
+]
+
+
+def main():
+    failed = 0
+    total = len(CASES) + len(MEASUREMENTS)
+    for name, trace, expected in CASES:
+        got = SenseDecoder().replay(trace)
+        ok = got == expected
+        failed += not ok
+        print(f"{'✅' if ok else '❌'} {name}: {got}" + ("" if ok else f" (expected {expected})"))
+
+    for name, trace, (speed, dwell, conf_min, conf_max) in MEASUREMENTS:
+        decoder = SenseDecoder()
+        decoder.replay(trace)
+        got = decoder.crossings_measured
+        ok = (len(got) == 1 and abs(got[0][0] - speed) < 0.01 and abs(got[0][1] - dwell) <= 1 and
+              conf_min <= got[0][2] <= conf_max)
+        failed += not ok
+        shown = [f"{s:.2f} m/s, {d} ms, confidence {c:.2f}" for s, d, c in got]
+        print(f"{'✅' if ok else '❌'} {name}: {shown}")
+
+    print(f"\n{total - failed}/{total} traces passed")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()